@@ -1,10 +1,21 @@
-#include <QtGui>
-#include <QDir>
+#include <QBuffer>
+#include <QFile>
+#include <QMutex>
+#include <QRunnable>
+#include <QThread>
+#include <QThreadPool>
+#include <QWaitCondition>
+
+#include <string.h>
 
 #include "adclistreader.h"
-#include "util.h"
+#include "adclistscanner.h"
+#include "listingstore.h"
 
 using ShowListing::AdcListReader;
+using ShowListing::AdcListScanner;
+using ShowListing::ListingStore;
+using ShowListing::Tth;
 
 namespace {
 class Sleep : public QThread
@@ -21,63 +32,64 @@ static const QString sDIRECTORY = "Directory";
 static const QString sFILE = "File";
 static const QString sName = "Name";
 static const QString sSize = "Size";
+static const QString sTTH = "TTH";
 static const QString sDate = "Date";
 
-namespace {
-
-inline Qt::GlobalColor getColorFromSize(const qulonglong& val)
-{
-    if(val >= (1ULL << 40)) {
-        return Qt::darkRed;
-    }
-    else if(val >= (500 * 1ULL << 30)) {
-        return Qt::darkMagenta;
-    }
-    else if(val >= (100 * 1ULL << 30)) {  // 2^30 = 1 GiB
-        return Qt::darkGreen;
-    }
-    else if(val >= (5 * 1ULL << 30)) {
-        return Qt::black;
-    }
-    return Qt::darkGray;
-}
-
-}
+// batches of finished subtrees are handed over at most this often
+static const int PUBLISH_INTERVAL_MS = 50;
 
+// smaller lists are parsed in one go, splitting them is not worth it
+static const qint64 PARALLEL_MIN_SIZE = 16 << 20;
+static const qint64 DEPTH_SCAN_CHUNK_SIZE = 4 << 20;
+static const qint64 UNIT_MIN_SIZE = 1 << 20;
+// aim for several units per thread so that uneven ones even out
+static const int UNITS_PER_THREAD = 4;
 
 //! [0]
-AdcListReader::AdcListReader(ShowListing::DirFileTree *treeWidget)
-    : treeWidget(treeWidget), cancelRequested(false)
+AdcListReader::AdcListReader()
+    : parserMode(ParallelParser), usedMode(ParallelParser), deviceTime(0), metadataRead(false), store(0), cancelRequested(0), progressCounter(0),
+      publishedCount(0), publishedSize(0)
 {
 }
 //! [0]
 
 //! [1]
-int AdcListReader::read(QIODevice *device, QTreeWidgetItem **retVal)
+int AdcListReader::read(QIODevice *device, ShowListing::ListingStore *store)
 {
+    this->store = store;
+    publishedCount = 0;
+    publishedSize = 0;
+    metadataRead = false;
+    deviceTime = 0;
+    publishTimer.start();
+
+    if (parserMode != StreamParser && !device->isSequential()) {
+        if (parserMode == ParallelParser ? readParallel(device) : readFast(device)) {
+            return xml.hasError();
+        }
+        // start over with the general purpose parser
+        startOver();
+        if (!device->reset()) {
+            xml.raiseError(QObject::tr("Cannot rewind the file list after an unsupported construct."));
+            return xml.hasError();
+        }
+    }
+
+    usedMode = StreamParser;
     xml.setDevice(device);
     if (xml.readNextStartElement()) {
         QXmlStreamAttributes attr(xml.attributes());
         if (xml.name() == "FileListing" && attr.value("Version") == "1") {
-            // Read extra metadata
-            treeWidget->setProperty("generator", attr.value("Generator").toString().trimmed());
-            treeWidget->setProperty("base", attr.value("Base").toString().trimmed());
-
-            QTreeWidgetItem *topLevelNode = createChildItem(0, ShowListing::DirFileTree::RootType);
-            topLevelNode->setBackgroundColor(0, QColor(240, 240, 255));
-            topLevelNode->setTextColor(0, Qt::darkMagenta);
-            topLevelNode->setText(0, attr.value("GeneratedDate").toString().trimmed() != "" ? QString("Date=%1").arg(attr.value("GeneratedDate").toString().trimmed()) : "");
-            topLevelNode->setIcon(0, treeWidget->catalogIcon);
-            topLevelNode->setData(1, Qt::UserRole, 0);
-
-            readAdcList(topLevelNode);
-
-            qulonglong totalSize = topLevelNode->data(1, Qt::UserRole).toLongLong();
-            topLevelNode->setText(1, QString("[ %1 ]").arg(humanizeBigNums(totalSize, 2)));
-            topLevelNode->setTextColor(1, getColorFromSize(totalSize));
-            if (retVal) {
-                *retVal = topLevelNode;
+            // Read extra metadata, unless a first attempt already published it
+            if (!metadataRead) {
+                store->generator = attr.value("Generator").toString().trimmed();
+                store->base = attr.value("Base").toString().trimmed();
+                store->generatedDate = attr.value("GeneratedDate").toString().trimmed();
             }
+
+            readAdcList();
+            store->finish();
+            publishFinished(true);
         }
         else {
             xml.raiseError(QObject::tr("The file is not an ADC FileListing version 1 XML file. Found root element: %1")
@@ -115,32 +127,428 @@ QString AdcListReader::errorString(QString customError) const
 
 void AdcListReader::cancelProcessing()
 {
-    cancelRequested = true;
+    cancelRequested.store(1);
+}
+
+/// Drops what was built so far, for another parser to start from scratch.
+void AdcListReader::startOver()
+{
+    store->restart();
+    publishedCount = 0;
+    publishedSize = 0;
+    emit restarted();
+}
+
+void AdcListReader::readMetadata(const ShowListing::AdcListScanner &scanner)
+{
+    // the GUI may already be showing it from a first attempt
+    if (metadataRead) {
+        return;
+    }
+    store->generator = QString::fromUtf8(scanner.attributeBytes(AdcListScanner::GeneratorAttribute));
+    store->base = QString::fromUtf8(scanner.attributeBytes(AdcListScanner::BaseAttribute));
+    store->generatedDate = QString::fromUtf8(scanner.attributeBytes(AdcListScanner::GeneratedDateAttribute));
+    metadataRead = true;
+}
+
+/// Reads the whole list with AdcListScanner.
+/** Returns false when the document needs the general purpose parser,
+ * which is also the one producing error messages for malformed input.
+ **/
+bool AdcListReader::readFast(QIODevice *device)
+{
+    ShowListing::AdcListScanner scanner(device);
+    if (scanner.next() != AdcListScanner::StartElement
+            || scanner.element() != AdcListScanner::FileListingElement
+            || scanner.attributeBytes(AdcListScanner::VersionAttribute) != "1") {
+        deviceTime += scanner.readNsecs();
+        return false;
+    }
+    readMetadata(scanner);
+
+    bool done = readFastList(scanner, store, true);
+    deviceTime += scanner.readNsecs();
+    if (!done) {
+        return false;
+    }
+    if (cancelRequested.load()) {
+        xml.raiseError(QObject::tr("Cancel requested by user."));
+    }
+    store->finish();
+    publishFinished(true);
+    usedMode = FastParser;
+    return true;
+}
+
+/// Builds the entries read by \a scanner into \a target.
+/** Only publishes batches and reports progress when \a publish is set,
+ * otherwise it may run on any thread.
+ **/
+bool AdcListReader::readFastList(ShowListing::AdcListScanner &scanner, ShowListing::ListingStore *target, bool publish)
+{
+    int skipDepth = 0;      // nesting inside elements outside the schema
+    bool inFile = false;
+    const char *value;
+    int len;
+
+    while (!cancelRequested.load()) {
+        switch (scanner.next()) {
+        case AdcListScanner::StartElement:
+            if (publish) {
+                reportProgress(scanner.position());
+            }
+            if (skipDepth > 0) {
+                ++skipDepth;
+            } else if (scanner.element() == AdcListScanner::DirectoryElement
+                       || scanner.element() == AdcListScanner::FileElement) {
+                value = scanner.attribute(AdcListScanner::NameAttribute, &len);
+                if (inFile || len == 0) {
+                    return false;
+                }
+                const char *name = value;
+                int nameLen = len;
+                quint64 number = 0;
+                if (scanner.element() == AdcListScanner::DirectoryElement) {
+                    value = scanner.attribute(AdcListScanner::DateAttribute, &len);
+                    if (!AdcListScanner::parseNumber(value, len, &number)) {
+                        number = 0;
+                    }
+                    value = scanner.attribute(AdcListScanner::IncompleteAttribute, &len);
+                    target->openDirectory(name, nameLen, quint32(number), len == 1 && value[0] == '1');
+                } else {
+                    value = scanner.attribute(AdcListScanner::SizeAttribute, &len);
+                    bool hasSize = AdcListScanner::parseNumber(value, len, &number);
+                    value = scanner.attribute(AdcListScanner::TTHAttribute, &len);
+                    Tth tth;
+                    bool hasTth = Tth::fromBase32(value, len, &tth);
+                    target->addFile(name, nameLen, number, hasSize, hasTth ? &tth : 0);
+                    inFile = true;
+                }
+            } else {
+                skipDepth = 1;
+            }
+            break;
+        case AdcListScanner::EndElement:
+            if (skipDepth > 0) {
+                --skipDepth;
+            } else if (inFile) {
+                inFile = false;
+                if (publish && target->depth() == 0) {
+                    publishFinished(false);
+                }
+            } else if (scanner.element() == AdcListScanner::DirectoryElement) {
+                target->closeDirectory();
+                if (publish && target->depth() == 0) {
+                    publishFinished(false);
+                }
+            } else if (scanner.element() == AdcListScanner::FileListingElement) {
+                return true;
+            }
+            break;
+        case AdcListScanner::EndDocument:
+            // only fragments end without closing FileListing
+            return scanner.isFragment();
+        case AdcListScanner::Unsupported:
+            return false;
+        }
+    }
+    return true;
+}
+
+namespace ShowListing {
+
+/// Hands out indexes [0, count) to the threads of a pool.
+/** Every thread keeps claiming the next index until none are left, so the
+ * ones that drew small pieces of work simply process more of them.
+ **/
+class IndexedTask : public QRunnable
+{
+public:
+    IndexedTask(QAtomicInt *next, int count) : next(next), count(count) {}
+
+    void run()
+    {
+        int i;
+        while ((i = next->fetchAndAddRelaxed(1)) < count) {
+            process(i);
+        }
+    }
+
+protected:
+    virtual void process(int i) = 0;
+
+private:
+    QAtomicInt *next;
+    int count;
+};
+
+class DepthScanTask : public IndexedTask
+{
+public:
+    DepthScanTask(QAtomicInt *next, QVector<AdcListScanner::DepthScan> *scans,
+                  const char *begin, const char *end)
+        : IndexedTask(next, scans->size()), scans(scans), begin(begin), end(end) {}
+
+protected:
+    void process(int i)
+    {
+        const char *from = begin + i * DEPTH_SCAN_CHUNK_SIZE;
+        const char *to = qMin(from + DEPTH_SCAN_CHUNK_SIZE, end);
+        AdcListScanner::scanDepth(from, to, end, &(*scans)[i]);
+    }
+
+private:
+    QVector<AdcListScanner::DepthScan> *scans;
+    const char *begin;
+    const char *end;
+};
+
+/// Pieces of a list parsed in parallel, handed back in document order.
+struct ParallelParse
+{
+    struct Unit
+    {
+        const char *begin;
+        const char *end;
+        ListingStore *part;     // set once parsed
+        bool parsed;
+    };
+
+    QVector<Unit> units;
+    QAtomicInt next;
+    QAtomicInt failed;
+    QMutex mutex;
+    QWaitCondition unitParsed;
+    qint64 parsedBytes;
+};
+
+class ParseUnitTask : public IndexedTask
+{
+public:
+    ParseUnitTask(ParallelParse *state, AdcListReader *reader, const ListingStore *target)
+        : IndexedTask(&state->next, state->units.size()), state(state), reader(reader), target(target) {}
+
+protected:
+    void process(int i)
+    {
+        if (state->failed.load() || reader->isCancelled()) {
+            return;
+        }
+        ParallelParse::Unit &unit = state->units[i];
+        // parts share names and subtrees like the listing they end up in
+        ListingStore *part = new ListingStore(target->names());
+        part->setSubtreeIndex(target->subtreeIndex());
+        AdcListScanner scanner(unit.begin, unit.end - unit.begin);
+        scanner.setFragment(true);
+        bool ok = reader->readFastList(scanner, part, false);
+        part->finish();
+
+        QMutexLocker locker(&state->mutex);
+        if (!ok) {
+            state->failed.store(1);
+        }
+        unit.part = part;
+        unit.parsed = true;
+        state->parsedBytes += unit.end - unit.begin;
+        state->unitParsed.wakeAll();
+    }
+
+private:
+    ParallelParse *state;
+    AdcListReader *reader;
+    const ListingStore *target;
+};
+
+}
+
+/// Parses lists held in memory or in a mappable file on all cores.
+/** Falls back to readFast() for small lists, other devices, and whatever
+ * the split parse could not handle.
+ **/
+bool AdcListReader::readParallel(QIODevice *device)
+{
+    qint64 size = device->size();
+    if (size < PARALLEL_MIN_SIZE || QThread::idealThreadCount() < 2) {
+        return readFast(device);
+    }
+
+    const char *data = 0;
+    uchar *mapped = 0;
+    QFile *file = qobject_cast<QFile *>(device);
+    QBuffer *buffer = qobject_cast<QBuffer *>(device);
+    if (file) {
+        QElapsedTimer timer;
+        timer.start();
+        mapped = file->map(0, size);
+        deviceTime += timer.nsecsElapsed();
+        data = reinterpret_cast<const char *>(mapped);
+    } else if (buffer) {
+        data = buffer->data().constData();
+    }
+    if (!data) {
+        return readFast(device);
+    }
+
+    bool done = readParallel(data, size);
+    if (mapped) {
+        file->unmap(mapped);
+    }
+    if (done) {
+        return true;
+    }
+    startOver();
+    return device->reset() && readFast(device);
+}
+
+/// Splits the list at top-level entries and parses the pieces concurrently.
+/** A quick nesting pass over the whole document, itself split in chunks,
+ * finds where the top-level entries start. Consecutive entries are grouped
+ * in units of similar size, each parsed into its own ListingStore by the
+ * thread that claims it. Finished units are appended to the store in
+ * document order as soon as all units before them are, and published like
+ * the sequential parser does.
+ **/
+bool AdcListReader::readParallel(const char *data, qint64 size)
+{
+    AdcListScanner head(data, size);
+    if (head.next() != AdcListScanner::StartElement
+            || head.element() != AdcListScanner::FileListingElement
+            || head.attributeBytes(AdcListScanner::VersionAttribute) != "1") {
+        return false;
+    }
+    readMetadata(head);
+
+    // the body runs up to the end tag of FileListing, normally the last one
+    static const char closeTag[] = "</FileListing";
+    const int closeLen = sizeof(closeTag) - 1;
+    const char *body = data + head.position();
+    const char *bodyEnd = data + size - closeLen;
+    while (bodyEnd >= body && memcmp(bodyEnd, closeTag, closeLen) != 0) {
+        --bodyEnd;
+    }
+    if (bodyEnd < body) {
+        return false;
+    }
+
+    int threads = QThread::idealThreadCount();
+    QThreadPool pool;
+    pool.setMaxThreadCount(threads);
+
+    // nesting pass, chained in order: the body starts inside FileListing
+    QVector<AdcListScanner::DepthScan> scans(int((bodyEnd - body + DEPTH_SCAN_CHUNK_SIZE - 1) / DEPTH_SCAN_CHUNK_SIZE));
+    QAtomicInt nextScan(0);
+    for (int i = 0; i < threads; ++i) {
+        pool.start(new DepthScanTask(&nextScan, &scans, body, bodyEnd));
+    }
+    pool.waitForDone();
+
+    ParallelParse state;
+    state.parsedBytes = 0;
+    qint64 unitSize = qMax(UNIT_MIN_SIZE, qint64(bodyEnd - body) / (threads * UNITS_PER_THREAD));
+    ParallelParse::Unit unit = { body, 0, 0, false };
+    int depth = 1;
+    for (int i = 0; i < scans.size(); ++i) {
+        const AdcListScanner::DepthScan &scan = scans.at(i);
+        for (int j = 0; j < scan.starts.size(); ++j) {
+            const char *start = scan.starts.at(j).second;
+            if (depth + scan.starts.at(j).first == 1 && start - unit.begin >= unitSize) {
+                unit.end = start;
+                state.units.append(unit);
+                unit.begin = start;
+            }
+        }
+        depth += scan.delta;
+    }
+    unit.end = bodyEnd;
+    state.units.append(unit);
+    if (depth != 1 || state.units.size() < 2) {
+        return false;
+    }
+
+    for (int i = 0; i < threads; ++i) {
+        pool.start(new ParseUnitTask(&state, this, store));
+    }
+
+    int appended = 0;
+    {
+        QMutexLocker locker(&state.mutex);
+        while (appended < state.units.size() && !state.failed.load() && !cancelRequested.load()) {
+            ParallelParse::Unit &next = state.units[appended];
+            if (!next.parsed) {
+                state.unitParsed.wait(&state.mutex, PUBLISH_INTERVAL_MS);
+                reportProgress((body - data) + state.parsedBytes);
+                continue;
+            }
+            ListingStore *part = next.part;
+            next.part = 0;
+            ++appended;
+            locker.unlock();
+            store->appendSubtrees(*part);
+            delete part;
+            publishFinished(false);
+            locker.relock();
+        }
+    }
+    if (appended < state.units.size()) {
+        // stop the tasks still going
+        state.failed.store(1);
+    }
+    pool.waitForDone();
+    for (int i = appended; i < state.units.size(); ++i) {
+        delete state.units.at(i).part;
+    }
+
+    if (cancelRequested.load()) {
+        xml.raiseError(QObject::tr("Cancel requested by user."));
+    } else if (appended < state.units.size()) {
+        return false;
+    }
+    reportProgress(size);
+    store->finish();
+    publishFinished(true);
+    usedMode = ParallelParser;
+    return true;
+}
+
+void AdcListReader::publishFinished(bool force)
+{
+    if (!force && publishTimer.elapsed() < PUBLISH_INTERVAL_MS) {
+        return;
+    }
+    QVector<quint32> ids = store->finishedTopLevel(publishedCount);
+    for (int i = 0; i < ids.size(); ++i) {
+        publishedSize += store->node(ids.at(i)).size;
+    }
+    if (!ids.isEmpty() || force) {
+        publishedCount += ids.size();
+        emit subtreesReady(ids, publishedSize);
+    }
+    publishTimer.restart();
 }
 
 
 
 //! [3]
-void AdcListReader::readAdcList(QTreeWidgetItem *rootItem)
+void AdcListReader::readAdcList()
 {
-    while (!cancelRequested && !xml.hasError() && xml.readNextStartElement())
+    while (!cancelRequested.load() && !xml.hasError() && xml.readNextStartElement())
     {
         if (xml.name() == sDIRECTORY)
-            readDirectory(rootItem);
+            readDirectory();
         else if (xml.name() == sFILE)
-            readFile(rootItem);
+            readFile();
         else
             xml.skipCurrentElement();
+        publishFinished(false);
     }
-    if (cancelRequested) {
+    if (cancelRequested.load()) {
         xml.raiseError(QObject::tr("Cancel requested by user."));
     }
 }
 //! [3]
 
-void AdcListReader::readDirectory(QTreeWidgetItem *item)
+void AdcListReader::readDirectory()
 {
-    QString pathParent = item ? item->data(0, Qt::UserRole).toString() : QDir::separator();
     QString filename = xml.attributes().value(sName).toString().trimmed();
     bool isConvOk = false;
     if (filename == "") {
@@ -150,48 +558,31 @@ void AdcListReader::readDirectory(QTreeWidgetItem *item)
     }
 
     QString filedate = xml.attributes().value(sDate).toString().trimmed();
-
-    QTreeWidgetItem *folder = createChildItem(item, ShowListing::DirFileTree::DirType);
-    folder->setIcon(0, treeWidget->folderIcon);
-    folder->setData(0, Qt::UserRole, pathParent + QDir::separator() + filename);
-    folder->setText(0, filename);
-    folder->setData(1, Qt::UserRole, 0);
-
-    if (xml.attributes().value("Incomplete").toString().trimmed() == "1") {
-        folder->setTextColor(0, QColor(Qt::blue));
-    }
-
     qulonglong filedateparsed = filedate.toLongLong(&isConvOk);
-    if (isConvOk) {
-        folder->setData(2, Qt::UserRole, filedateparsed);
+    if (!isConvOk) {
+        filedateparsed = 0;
     }
+    bool incomplete = xml.attributes().value("Incomplete").toString().trimmed() == "1";
 
+    QByteArray utf8Name = filename.toUtf8();
+    store->openDirectory(utf8Name.constData(), utf8Name.size(), quint32(filedateparsed), incomplete);
 
-    while (!cancelRequested && !xml.hasError() && xml.readNextStartElement()) {
+    while (!cancelRequested.load() && !xml.hasError() && xml.readNextStartElement()) {
         // When a directory has been processed, notify listeners
-        emit broadcastProgress(xml.device()->pos());
+        reportProgress(xml.device()->pos());
         if (xml.name() == sDIRECTORY)
-            readDirectory(folder);
+            readDirectory();
         else if (xml.name() == sFILE)
-            readFile(folder);
+            readFile();
         else
             xml.skipCurrentElement();
     }
-    if (cancelRequested) {
-        return;
-    }
-
 
-    qulonglong folderSize = folder->data(1, Qt::UserRole).toLongLong();
-    folder->setText(1, QString(">> %1").arg(humanizeBigNums(folderSize, 2)));
-    folder->setTextColor(1, getColorFromSize(folderSize));
-    qulonglong parentsize = folderSize + item->data(1, Qt::UserRole).toLongLong();
-    item->setData(1, Qt::UserRole, parentsize);
+    store->closeDirectory();
 }
 
-void AdcListReader::readFile(QTreeWidgetItem *item)
+void AdcListReader::readFile()
 {
-    QString pathParent = item ? item->data(0, Qt::UserRole).toString() : QDir::separator();
     QString filename = xml.attributes().value(sName).toString().trimmed();
     bool isConvOk = false;
 
@@ -204,24 +595,17 @@ void AdcListReader::readFile(QTreeWidgetItem *item)
     QString filesize = xml.attributes().value(sSize).toString().simplified();
     qulonglong filesizeparsed = filesize.toLongLong(&isConvOk);
 
-    QTreeWidgetItem *file = createChildItem(item, ShowListing::DirFileTree::FileType);
-    file->setIcon(0, treeWidget->fileIcon);
-    file->setData(0, Qt::UserRole, pathParent + QDir::separator() + filename);
-    file->setText(0, filename);
-    if (filesize == "" || !isConvOk) {
-//Do not mandate a file size, particular items (such as symlinks) may have this value omitted
-//        xml.raiseError(errorString(QObject::tr("Invalid Entry: <%1> has a missing or empty %2= attribute, or is not a valid number.")
-//                       .arg(sFILE).arg(sSize)));
-//        return;
-    } else {
-        file->setData(1, Qt::UserRole, filesizeparsed);
-        file->setText(1, humanizeBigNums(filesizeparsed, 2));
-    }
+    // a missing or malformed TTH is not an error, the file is simply kept without one
+    QByteArray tthText = xml.attributes().value(sTTH).toLatin1();
+    Tth tth;
+    bool hasTth = Tth::fromBase32(tthText.constData(), tthText.size(), &tth);
 
-    qulonglong parentsize = filesizeparsed + item->data(1, Qt::UserRole).toLongLong();
-    item->setData(1, Qt::UserRole, parentsize);
+    //Do not mandate a file size, particular items (such as symlinks) may have this value omitted
+    QByteArray utf8Name = filename.toUtf8();
+    store->addFile(utf8Name.constData(), utf8Name.size(), filesizeparsed, filesize != "" && isConvOk,
+                   hasTth ? &tth : 0);
 
-    while (!cancelRequested && xml.readNextStartElement()) {
+    while (!cancelRequested.load() && xml.readNextStartElement()) {
         if (xml.name() == sDIRECTORY || xml.name() == sFILE) {
             xml.raiseError(errorString(QObject::tr("Invalid Entry <%1 Name=\"%2\">: has unexpected child element <%3>.")
                            .arg(sFILE)
@@ -233,8 +617,3 @@ void AdcListReader::readFile(QTreeWidgetItem *item)
             xml.skipCurrentElement();
     }
 }
-
-QTreeWidgetItem *AdcListReader::createChildItem(QTreeWidgetItem *item, int Type)
-{
-    return new QTreeWidgetItem(item, Type);
-}
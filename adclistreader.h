@@ -1,47 +1,91 @@
 #ifndef ADCLISTREADER_H
 #define ADCLISTREADER_H
 
-#include <QIcon>
+#include <QAtomicInt>
+#include <QAtomicInteger>
+#include <QElapsedTimer>
+#include <QObject>
+#include <QVector>
 #include <QXmlStreamReader>
 
-QT_BEGIN_NAMESPACE
-class QTreeWidgetItem;
-QT_END_NAMESPACE
-
-#include "dirfiletree.h"
-
 namespace ShowListing{
+class AdcListScanner;
+class ListingStore;
+
 //! [0]
 class AdcListReader : public QObject
 {
     Q_OBJECT
 
 public:
+    enum ParserMode { StreamParser, FastParser, ParallelParser };
+
 //! [1]
-    AdcListReader(ShowListing::DirFileTree *treeWidget);
+    AdcListReader();
 //! [1]
 
-    int read(QIODevice *device, QTreeWidgetItem **);
+    /// FastParser tries AdcListScanner first on seekable devices.
+    /** ParallelParser (the default) additionally splits big lists held in
+     * memory or in a mappable file at top-level entries and parses the
+     * pieces on all cores, falling back to FastParser otherwise.
+     **/
+    void setParserMode(ParserMode mode) { parserMode = mode; }
+    /// Counter kept at the number of document bytes read, 0 for none.
+    /** Updated with relaxed stores only, for a progress display to poll.
+     **/
+    void setProgressCounter(QAtomicInteger<qint64> *counter) { progressCounter = counter; }
+    int read(QIODevice *device, ShowListing::ListingStore *store);
 
     bool hasError() const;
     QString errorString() const;
     QString errorString(QString) const;
     void cancelProcessing();
+    bool isCancelled() const { return cancelRequested.load() != 0; }
+    /// Parser that read the list last, after any fallback.
+    ParserMode parserUsed() const { return usedMode; }
+    /// Time the last read() spent waiting for the device, in nanoseconds.
+    /** Counts reads by AdcListScanner and mapping files for the parallel
+     * parser. Reads by QXmlStreamReader are not told apart from parsing.
+     **/
+    qint64 deviceNsecs() const { return deviceTime; }
 
 signals:
-    void broadcastProgress(qint64 curPos);
+    /// Top-level entries of the listing that are completely parsed.
+    /** Emitted in batches while reading, then once more after the store is
+     * sealed with whatever was left. \a totalSize is the cumulated size of
+     * everything published so far.
+     **/
+    void subtreesReady(const QVector<quint32> &ids, quint64 totalSize);
+    /// Everything published so far is void, parsing starts over.
+    void restarted();
 
 private:
 //! [2]
-    void readAdcList(QTreeWidgetItem *item);
-    void readDirectory(QTreeWidgetItem *item);
-    void readFile(QTreeWidgetItem *item);
+    void readAdcList();
+    void readDirectory();
+    void readFile();
+    void publishFinished(bool force);
+    void reportProgress(qint64 pos) { if (progressCounter) progressCounter->store(pos); }
+    void startOver();
+    void readMetadata(const ShowListing::AdcListScanner &scanner);
+    bool readFast(QIODevice *device);
+    bool readParallel(QIODevice *device);
+    bool readParallel(const char *data, qint64 size);
+    bool readFastList(ShowListing::AdcListScanner &scanner, ShowListing::ListingStore *target, bool publish);
 
-    QTreeWidgetItem *createChildItem(QTreeWidgetItem *item, int Type = 0);
+    friend class ParseUnitTask;
 
     QXmlStreamReader xml;
-    ShowListing::DirFileTree *treeWidget;
-    bool cancelRequested;
+    ParserMode parserMode;
+    ParserMode usedMode;
+    qint64 deviceTime;
+    bool metadataRead;
+    ShowListing::ListingStore *store;
+    QAtomicInt cancelRequested;
+    QAtomicInteger<qint64> *progressCounter;
+    int publishedCount;
+    quint64 publishedSize;
+    QElapsedTimer publishTimer;
 //! [2]
 
 };
@@ -0,0 +1,581 @@
+#include <QElapsedTimer>
+#include <QIODevice>
+
+#include <string.h>
+
+#include "adclistscanner.h"
+
+#if defined(__AVX2__)
+#  include <immintrin.h>
+#  define SHOWLISTING_AVX2
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  include <emmintrin.h>
+#  define SHOWLISTING_SSE2
+#endif
+#if defined(_MSC_VER)
+#  include <intrin.h>
+#endif
+
+using ShowListing::AdcListScanner;
+
+namespace {
+
+const int CHUNK_SIZE = 1 << 20;
+
+inline bool isSpace(char c)
+{
+    return c == ' ' || c == '\n' || c == '\t' || c == '\r';
+}
+
+inline int countTrailingZeros(quint32 v)
+{
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, v);
+    return int(index);
+#else
+    return __builtin_ctz(v);
+#endif
+}
+
+/// First occurrence of \a a or \a b in [p, end), or end.
+inline const char *findEither(const char *p, const char *end, char a, char b)
+{
+#if defined(SHOWLISTING_AVX2)
+    const __m256i va32 = _mm256_set1_epi8(a);
+    const __m256i vb32 = _mm256_set1_epi8(b);
+    while (end - p >= 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+        quint32 mask = quint32(_mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(v, va32),
+                                                                      _mm256_cmpeq_epi8(v, vb32))));
+        if (mask) {
+            return p + countTrailingZeros(mask);
+        }
+        p += 32;
+    }
+#endif
+#if defined(SHOWLISTING_SSE2)
+    const __m128i va = _mm_set1_epi8(a);
+    const __m128i vb = _mm_set1_epi8(b);
+    while (end - p >= 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        quint32 mask = quint32(_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, va),
+                                                               _mm_cmpeq_epi8(v, vb))));
+        if (mask) {
+            return p + countTrailingZeros(mask);
+        }
+        p += 16;
+    }
+#endif
+    while (p < end && *p != a && *p != b) {
+        ++p;
+    }
+    return p;
+}
+
+inline const char *findByte(const char *p, const char *end, char c)
+{
+    return findEither(p, end, c, c);
+}
+
+void trim(const char **begin, const char **end)
+{
+    while (*begin < *end && isSpace(**begin)) {
+        ++*begin;
+    }
+    while (*end > *begin && isSpace((*end)[-1])) {
+        --*end;
+    }
+}
+
+bool equals(const char *p, int len, const char *literal)
+{
+    return int(strlen(literal)) == len && memcmp(p, literal, len) == 0;
+}
+
+AdcListScanner::Element classifyElement(const char *p, int len)
+{
+    if (equals(p, len, "File")) {
+        return AdcListScanner::FileElement;
+    } else if (equals(p, len, "Directory")) {
+        return AdcListScanner::DirectoryElement;
+    } else if (equals(p, len, "FileListing")) {
+        return AdcListScanner::FileListingElement;
+    }
+    return AdcListScanner::OtherElement;
+}
+
+AdcListScanner::Attribute classifyAttribute(const char *p, int len)
+{
+    switch (len) {
+    case 3:
+        if (equals(p, len, "TTH")) return AdcListScanner::TTHAttribute;
+        break;
+    case 4:
+        if (equals(p, len, "Name")) return AdcListScanner::NameAttribute;
+        if (equals(p, len, "Size")) return AdcListScanner::SizeAttribute;
+        if (equals(p, len, "Date")) return AdcListScanner::DateAttribute;
+        if (equals(p, len, "Base")) return AdcListScanner::BaseAttribute;
+        break;
+    case 7:
+        if (equals(p, len, "Version")) return AdcListScanner::VersionAttribute;
+        break;
+    case 9:
+        if (equals(p, len, "Generator")) return AdcListScanner::GeneratorAttribute;
+        break;
+    case 10:
+        if (equals(p, len, "Incomplete")) return AdcListScanner::IncompleteAttribute;
+        break;
+    case 13:
+        if (equals(p, len, "GeneratedDate")) return AdcListScanner::GeneratedDateAttribute;
+        break;
+    }
+    return AdcListScanner::AttributeCount;
+}
+
+void appendUtf8(QByteArray *out, quint32 cp)
+{
+    if (cp < 0x80) {
+        out->append(char(cp));
+    } else if (cp < 0x800) {
+        out->append(char(0xC0 | (cp >> 6)));
+        out->append(char(0x80 | (cp & 0x3F)));
+    } else if (cp < 0x10000) {
+        out->append(char(0xE0 | (cp >> 12)));
+        out->append(char(0x80 | ((cp >> 6) & 0x3F)));
+        out->append(char(0x80 | (cp & 0x3F)));
+    } else {
+        out->append(char(0xF0 | (cp >> 18)));
+        out->append(char(0x80 | ((cp >> 12) & 0x3F)));
+        out->append(char(0x80 | ((cp >> 6) & 0x3F)));
+        out->append(char(0x80 | (cp & 0x3F)));
+    }
+}
+
+}
+
+AdcListScanner::AdcListScanner(QIODevice *device)
+    : _device(device), _consumed(0), _readNsecs(0), _atEnd(false), _started(false), _pendingEnd(false),
+      _fragment(false), _element(OtherElement), _reason("")
+{
+    _buf.resize(CHUNK_SIZE);
+    _base = _pos = _end = _buf.constData();
+    for (int i = 0; i < AttributeCount; ++i) {
+        _attrs[i].data = 0;
+        _attrs[i].len = 0;
+    }
+}
+
+AdcListScanner::AdcListScanner(const char *data, qint64 size)
+    : _device(0), _base(data), _pos(data), _end(data + size), _consumed(0), _readNsecs(0), _atEnd(true),
+      _started(false), _pendingEnd(false), _fragment(false), _element(OtherElement), _reason("")
+{
+    for (int i = 0; i < AttributeCount; ++i) {
+        _attrs[i].data = 0;
+        _attrs[i].len = 0;
+    }
+}
+
+AdcListScanner::Token AdcListScanner::unsupported(const char *reason)
+{
+    _reason = reason;
+    return Unsupported;
+}
+
+bool AdcListScanner::refill(const char *keepFrom)
+{
+    if (_atEnd) {
+        return false;
+    }
+    char *base = _buf.data();
+    int keep = int(_end - keepFrom);
+    if (keepFrom != base) {
+        memmove(base, keepFrom, keep);
+        _consumed += keepFrom - base;
+    }
+    if (keep == _buf.size()) {
+        // a single piece of markup larger than the buffer
+        _buf.resize(_buf.size() * 2);
+        base = _buf.data();
+    }
+    QElapsedTimer timer;
+    timer.start();
+    qint64 n = _device->read(base + keep, _buf.size() - keep);
+    _readNsecs += timer.nsecsElapsed();
+    if (n <= 0) {
+        _atEnd = true;
+        n = 0;
+    }
+    _base = _pos = base;
+    _end = base + keep + n;
+    return n > 0;
+}
+
+AdcListScanner::Token AdcListScanner::next()
+{
+    if (_pendingEnd) {
+        _pendingEnd = false;
+        _element = _open.last();
+        _open.removeLast();
+        if (_element == OtherElement) {
+            _otherNames.removeLast();
+        }
+        return EndElement;
+    }
+    for (int i = 0; i < AttributeCount; ++i) {
+        _attrs[i].data = 0;
+        _attrs[i].len = 0;
+    }
+
+    if (!_started) {
+        while (_end - _pos < 4 && refill(_pos)) {
+        }
+        const uchar *b = reinterpret_cast<const uchar *>(_pos);
+        if (_end - _pos >= 3 && b[0] == 0xEF && b[1] == 0xBB && b[2] == 0xBF) {
+            _pos += 3;
+        } else if (_end - _pos >= 2 && ((b[0] == 0xFE && b[1] == 0xFF) || (b[0] == 0xFF && b[1] == 0xFE))) {
+            return unsupported("UTF-16 document");
+        }
+        _started = true;
+    }
+
+    for (;;) {
+        const char *lt = findByte(_pos, _end, '<');
+        if (lt == _end) {
+            _pos = _end;
+            if (!refill(_end)) {
+                if (_open.isEmpty() && (_fragment || _element == FileListingElement)) {
+                    return EndDocument;
+                }
+                return unsupported("unexpected end of document");
+            }
+            continue;
+        }
+        _pos = lt;
+
+        Scan r;
+        Token token = Unsupported;
+        if (_end - _pos < 4) {
+            r = NeedMore;
+        } else if (_pos[1] == '?') {
+            r = skipUntil(_pos + 2, "?>", 2);
+        } else if (_pos[1] == '!') {
+            if (_pos[2] == '-' && _pos[3] == '-') {
+                r = skipUntil(_pos + 4, "-->", 3);
+            } else {
+                return unsupported("DOCTYPE or CDATA section");
+            }
+        } else if (_pos[1] == '/') {
+            r = scanEndTag(_pos + 2);
+            token = EndElement;
+        } else {
+            r = scanStartTag(_pos + 1);
+            token = StartElement;
+        }
+
+        if (r == NeedMore) {
+            if (!refill(_pos)) {
+                return unsupported("truncated markup");
+            }
+            continue;
+        } else if (r == Fail) {
+            return Unsupported;
+        } else if (token != Unsupported) {
+            return token;
+        }
+    }
+}
+
+AdcListScanner::Scan AdcListScanner::skipUntil(const char *p, const char *pattern, int patternLen)
+{
+    const char *start = _pos;
+    for (;;) {
+        p = findByte(p, _end, pattern[0]);
+        if (_end - p < patternLen) {
+            return NeedMore;
+        }
+        if (memcmp(p, pattern, patternLen) == 0) {
+            break;
+        }
+        ++p;
+    }
+    // only the XML declaration matters: reject anything but UTF-8
+    if (start[1] == '?' && p - start > 5 && memcmp(start + 2, "xml", 3) == 0 && isSpace(start[5])) {
+        QByteArray decl = QByteArray(start, int(p - start)).toLower();
+        int enc = decl.indexOf("encoding");
+        if (enc >= 0) {
+            int q = decl.indexOf('=', enc);
+            QByteArray value = decl.mid(q + 1).trimmed();
+            if (value.size() < 2) {
+                _reason = "malformed XML declaration";
+                return Fail;
+            }
+            value = value.mid(1, value.size() - 2);
+            if (!value.startsWith("utf-8") && !value.startsWith("utf8")) {
+                _reason = "document encoding is not UTF-8";
+                return Fail;
+            }
+        }
+    }
+    _pos = p + patternLen;
+    return Done;
+}
+
+AdcListScanner::Scan AdcListScanner::scanStartTag(const char *p)
+{
+    const char *name = p;
+    while (p < _end && !isSpace(*p) && *p != '>' && *p != '/') {
+        ++p;
+    }
+    if (p >= _end) {
+        return NeedMore;
+    }
+    int nameLen = int(p - name);
+    if (nameLen == 0) {
+        _reason = "empty element name";
+        return Fail;
+    }
+    Element element = classifyElement(name, nameLen);
+    for (int i = 0; i < AttributeCount; ++i) {
+        _attrs[i].data = 0;
+        _attrs[i].len = 0;
+    }
+
+    bool selfClosing = false;
+    for (;;) {
+        while (p < _end && isSpace(*p)) {
+            ++p;
+        }
+        if (p >= _end) {
+            return NeedMore;
+        }
+        if (*p == '>') {
+            ++p;
+            break;
+        }
+        if (*p == '/') {
+            if (p + 1 >= _end) {
+                return NeedMore;
+            }
+            if (p[1] != '>') {
+                _reason = "stray '/' in start tag";
+                return Fail;
+            }
+            p += 2;
+            selfClosing = true;
+            break;
+        }
+
+        const char *attrName = p;
+        while (p < _end && !isSpace(*p) && *p != '=' && *p != '>' && *p != '/') {
+            ++p;
+        }
+        const char *attrNameEnd = p;
+        while (p < _end && isSpace(*p)) {
+            ++p;
+        }
+        if (p >= _end) {
+            return NeedMore;
+        }
+        if (*p != '=' || attrNameEnd == attrName) {
+            _reason = "malformed attribute";
+            return Fail;
+        }
+        ++p;
+        while (p < _end && isSpace(*p)) {
+            ++p;
+        }
+        if (p >= _end) {
+            return NeedMore;
+        }
+        char quote = *p;
+        if (quote != '"' && quote != '\'') {
+            _reason = "unquoted attribute value";
+            return Fail;
+        }
+        const char *value = ++p;
+        const char *valueEnd = findEither(p, _end, quote, '&');
+        bool hasReference = valueEnd < _end && *valueEnd == '&';
+        if (hasReference) {
+            valueEnd = findByte(valueEnd, _end, quote);
+        }
+        if (valueEnd >= _end) {
+            return NeedMore;
+        }
+        p = valueEnd + 1;
+
+        Attribute attr = classifyAttribute(attrName, int(attrNameEnd - attrName));
+        if (attr == AttributeCount) {
+            continue;
+        }
+        if (hasReference) {
+            if (!decodeValue(attr, value, valueEnd)) {
+                _reason = "unsupported character reference";
+                return Fail;
+            }
+        } else {
+            trim(&value, &valueEnd);
+            _attrs[attr].data = value;
+            _attrs[attr].len = int(valueEnd - value);
+        }
+    }
+
+    if (_open.isEmpty() && _element != OtherElement && !_fragment) {
+        _reason = "content after the document element";
+        return Fail;
+    }
+    _element = element;
+    _open.append(element);
+    if (element == OtherElement) {
+        _otherNames.append(QByteArray(name, nameLen));
+    }
+    _pendingEnd = selfClosing;
+    _pos = p;
+    return Done;
+}
+
+AdcListScanner::Scan AdcListScanner::scanEndTag(const char *p)
+{
+    const char *name = p;
+    while (p < _end && !isSpace(*p) && *p != '>') {
+        ++p;
+    }
+    const char *nameEnd = p;
+    while (p < _end && isSpace(*p)) {
+        ++p;
+    }
+    if (p >= _end) {
+        return NeedMore;
+    }
+    if (*p != '>' || _open.isEmpty()) {
+        _reason = "malformed end tag";
+        return Fail;
+    }
+    Element element = classifyElement(name, int(nameEnd - name));
+    if (element != _open.last()
+            || (element == OtherElement && _otherNames.last() != QByteArray::fromRawData(name, int(nameEnd - name)))) {
+        _reason = "mismatched end tag";
+        return Fail;
+    }
+    _open.removeLast();
+    if (element == OtherElement) {
+        _otherNames.removeLast();
+    }
+    _element = element;
+    _pos = p + 1;
+    return Done;
+}
+
+bool AdcListScanner::decodeValue(Attribute a, const char *begin, const char *end)
+{
+    QByteArray &out = _decoded[a];
+    out.resize(0);
+    const char *p = begin;
+    while (p < end) {
+        const char *amp = findByte(p, end, '&');
+        out.append(p, int(amp - p));
+        if (amp == end) {
+            break;
+        }
+        const char *semi = findByte(amp + 1, end, ';');
+        if (semi == end) {
+            return false;
+        }
+        const char *ref = amp + 1;
+        int refLen = int(semi - ref);
+        if (equals(ref, refLen, "amp")) {
+            out.append('&');
+        } else if (equals(ref, refLen, "lt")) {
+            out.append('<');
+        } else if (equals(ref, refLen, "gt")) {
+            out.append('>');
+        } else if (equals(ref, refLen, "quot")) {
+            out.append('"');
+        } else if (equals(ref, refLen, "apos")) {
+            out.append('\'');
+        } else if (refLen >= 2 && ref[0] == '#') {
+            bool ok = false;
+            quint32 cp = ref[1] == 'x'
+                    ? QByteArray(ref + 2, refLen - 2).toUInt(&ok, 16)
+                    : QByteArray(ref + 1, refLen - 1).toUInt(&ok, 10);
+            if (!ok || cp == 0 || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF)) {
+                return false;
+            }
+            appendUtf8(&out, cp);
+        } else {
+            return false;
+        }
+        p = semi + 1;
+    }
+    const char *b = out.constData();
+    const char *e = b + out.size();
+    trim(&b, &e);
+    _attrs[a].data = b;
+    _attrs[a].len = int(e - b);
+    return true;
+}
+
+void AdcListScanner::scanDepth(const char *begin, const char *end, const char *limit, DepthScan *result)
+{
+    int depth = 0;
+    int minDepth = 0;
+    result->starts.resize(0);
+
+    const char *p = findByte(begin, end, '<');
+    while (p < end) {
+        const char *next;
+        if (p + 1 >= limit) {
+            break;
+        } else if (p[1] == '/') {
+            if (--depth < minDepth) {
+                minDepth = depth;
+                // deeper start tags cannot be children of the enclosing element
+                int kept = 0;
+                for (int i = 0; i < result->starts.size(); ++i) {
+                    if (result->starts.at(i).first <= minDepth + 1) {
+                        result->starts[kept++] = result->starts.at(i);
+                    }
+                }
+                result->starts.resize(kept);
+            }
+            next = findByte(p + 2, limit, '<');
+        } else if (p[1] == '!' || p[1] == '?') {
+            next = findByte(p + 2, limit, '<');
+        } else {
+            next = findByte(p + 1, limit, '<');
+            // the tag ends at the last '>' before the next markup
+            const char *gt = next - 1;
+            while (gt > p && *gt != '>') {
+                --gt;
+            }
+            if (depth <= minDepth + 1) {
+                result->starts.append(qMakePair(depth, p));
+            }
+            if (gt == p || gt[-1] != '/') {
+                ++depth;
+            }
+        }
+        p = next;
+    }
+    result->delta = depth;
+    result->minDepth = minDepth;
+}
+
+bool AdcListScanner::parseNumber(const char *p, int len, quint64 *value)
+{
+    if (len == 0 || len > 20) {
+        return false;
+    }
+    quint64 v = 0;
+    for (int i = 0; i < len; ++i) {
+        uint digit = uint(p[i]) - '0';
+        // out of range, as QXmlStreamReader's toULongLong() would find it
+        if (digit > 9 || v > (Q_UINT64_C(0xffffffffffffffff) - digit) / 10) {
+            return false;
+        }
+        v = v * 10 + digit;
+    }
+    *value = v;
+    return true;
+}
@@ -0,0 +1,131 @@
+#ifndef ADCLISTSCANNER_H
+#define ADCLISTSCANNER_H
+
+#include <QByteArray>
+#include <QPair>
+#include <QVector>
+
+QT_BEGIN_NAMESPACE
+class QIODevice;
+QT_END_NAMESPACE
+
+namespace ShowListing{
+
+/// Pull tokenizer specialized for ADC FileListing documents.
+/** Only understands what FileListing files actually contain: UTF-8 text,
+ * an optional XML declaration, comments, elements and quoted attributes
+ * with the five predefined and numeric character references. Anything
+ * else (DOCTYPE, CDATA, other encodings, malformed markup...) makes next()
+ * return Unsupported, and the caller is expected to start over with
+ * QXmlStreamReader, which also produces proper diagnostics.
+ *
+ * Attribute values stay valid until the following call to next().
+ *
+ * A scanner can also work directly on a document already in memory, and
+ * in fragment mode accept a sequence of sibling elements instead of a
+ * single document element, which is how parallel parsing reads the pieces
+ * found by scanDepth().
+ **/
+class AdcListScanner
+{
+public:
+    enum Token { StartElement, EndElement, EndDocument, Unsupported };
+    enum Element { OtherElement, FileListingElement, DirectoryElement, FileElement };
+    enum Attribute {
+        NameAttribute, SizeAttribute, TTHAttribute, DateAttribute, IncompleteAttribute,
+        VersionAttribute, BaseAttribute, GeneratorAttribute, GeneratedDateAttribute,
+        AttributeCount
+    };
+
+    /// Nesting summary of a piece of an in-memory document, see scanDepth().
+    struct DepthScan
+    {
+        int delta;          // depth at the end of the piece, relative to its start
+        int minDepth;       // lowest relative depth reached
+        /// Start tags with their relative depth, only those at most one
+        /// level below minDepth, which are the only ones that can be
+        /// children of the element enclosing the whole piece.
+        QVector<QPair<int, const char *> > starts;
+    };
+
+    explicit AdcListScanner(QIODevice *device);
+    /// Scans \a size bytes at \a data, which must stay valid and unchanged.
+    AdcListScanner(const char *data, qint64 size);
+
+    /// Accepts several top-level elements, and no FileListing around them.
+    void setFragment(bool fragment) { _fragment = fragment; }
+    bool isFragment() const { return _fragment; }
+
+    Token next();
+
+    /// Element of the last StartElement or EndElement token.
+    Element element() const { return _element; }
+    bool hasAttribute(Attribute a) const { return _attrs[a].data != 0; }
+    /// Value with references resolved and surrounding whitespace removed.
+    const char *attribute(Attribute a, int *len) const { *len = _attrs[a].len; return _attrs[a].data; }
+    QByteArray attributeBytes(Attribute a) const { return QByteArray(_attrs[a].data, _attrs[a].len); }
+
+    /// Why Unsupported was returned, for debugging.
+    const char *unsupportedReason() const { return _reason; }
+    /// Number of bytes consumed from the device.
+    qint64 position() const { return _consumed + (_pos - _base); }
+    /// Time spent waiting for the device, in nanoseconds.
+    qint64 readNsecs() const { return _readNsecs; }
+
+    /// Quick nesting pass over the tags starting in [begin, end).
+    /** Only looks for '<' and the '>' closing each start tag, which is
+     * enough for well-formed lists but trusts rather than checks the
+     * markup: pieces cut from its results are meant to be scanned for real
+     * afterwards. A tag starting before \a end may extend up to \a limit.
+     * Since '<' cannot occur inside attribute values, pieces can be scanned
+     * independently and their results chained.
+     **/
+    static void scanDepth(const char *begin, const char *end, const char *limit, DepthScan *result);
+
+    /// Reads an attribute value made of decimal digits only.
+    /** Returns \c false for anything else, including an empty value or one
+     * beyond 64 bits, which leaves \a value untouched.
+     **/
+    static bool parseNumber(const char *p, int len, quint64 *value);
+
+private:
+    enum Scan { Done, NeedMore, Fail };
+
+    struct AttributeValue
+    {
+        const char *data;
+        int len;
+    };
+
+    bool refill(const char *keepFrom);
+    Scan scanMarkup();
+    Scan scanStartTag(const char *p);
+    Scan scanEndTag(const char *p);
+    Scan skipUntil(const char *p, const char *pattern, int patternLen);
+    bool decodeValue(Attribute a, const char *begin, const char *end);
+    Token unsupported(const char *reason);
+
+    QIODevice *_device;
+    QByteArray _buf;
+    const char *_base;      // start of the bytes in memory, _consumed bytes into the document
+    const char *_pos;
+    const char *_end;
+    qint64 _consumed;
+    qint64 _readNsecs;
+    bool _atEnd;
+    bool _started;
+    bool _pendingEnd;       // a self-closing tag still owes its EndElement
+    bool _fragment;
+
+    Element _element;
+    AttributeValue _attrs[AttributeCount];
+    QByteArray _decoded[AttributeCount];
+    // names of open elements, only kept for elements outside the schema
+    QVector<Element> _open;
+    QVector<QByteArray> _otherNames;
+    const char *_reason;
+};
+
+}
+
+#endif // ADCLISTSCANNER_H
@@ -0,0 +1,166 @@
+#ifndef CHUNKEDARRAY_H
+#define CHUNKEDARRAY_H
+
+#include <QtGlobal>
+#include <QAtomicPointer>
+#include <QVector>
+
+namespace ShowListing{
+
+/// Table of fixed-size blocks that readers may index while a single writer grows it.
+/** When the table runs out of slots it is copied into one twice as large and
+ * published atomically; superseded tables are kept until destruction so that
+ * a reader holding an old one never sees freed memory. Readers only look at
+ * entries the writer handed over to them through some synchronizing event
+ * (a queued signal, a finished future...).
+ **/
+template <typename T>
+class BlockTable
+{
+public:
+    BlockTable() : _table(0), _count(0), _capacity(0), _external(false) {}
+    ~BlockTable() { clear(); }
+
+    T *block(quint32 i) const { return _table.loadAcquire()[i]; }
+    int count() const { return _count; }
+    /// Whether the blocks belong to someone else, see appendExternal().
+    bool isExternal() const { return _external; }
+
+    void append(T *block)
+    {
+        if (_count == _capacity) {
+            int capacity = _capacity ? _capacity * 2 : 16;
+            T **grown = new T *[capacity];
+            for (int i = 0; i < _count; ++i) {
+                grown[i] = _table.load()[i];
+            }
+            if (_table.load()) {
+                _retired.append(_table.load());
+            }
+            _table.storeRelease(grown);
+            _capacity = capacity;
+        }
+        _table.load()[_count++] = block;
+    }
+
+    /// Appends memory owned elsewhere, such as a mapped file.
+    /** A table holds either its own blocks or only external ones.
+     **/
+    void appendExternal(T *block)
+    {
+        Q_ASSERT_X(_count == 0 || _external, "BlockTable::appendExternal()", "table owns its blocks");
+        _external = true;
+        append(block);
+    }
+
+    /// Deletes the blocks themselves, unless they are external.
+    void clear()
+    {
+        for (int i = 0; i < _count && !_external; ++i) {
+            delete [] _table.load()[i];
+        }
+        delete [] _table.load();
+        for (int i = 0; i < _retired.size(); ++i) {
+            delete [] _retired.at(i);
+        }
+        _retired.clear();
+        _table.store(0);
+        _count = 0;
+        _capacity = 0;
+        _external = false;
+    }
+
+private:
+    BlockTable(const BlockTable &);
+    BlockTable &operator=(const BlockTable &);
+
+    QAtomicPointer<T *> _table;
+    int _count;
+    int _capacity;
+    bool _external;
+    QVector<T **> _retired;
+};
+
+/// Append-only array stored in fixed-size blocks.
+/** Elements never move once appended, so pointers and indices handed out
+ * stay valid for the lifetime of the array. Blocks hold 2^Shift elements.
+ * One thread appends; others may read elements published to them.
+ **/
+template <typename T, int Shift = 16>
+class ChunkedArray
+{
+public:
+    enum { BlockSize = 1 << Shift, BlockMask = BlockSize - 1 };
+
+    ChunkedArray() : _size(0) {}
+    ~ChunkedArray() { clear(); }
+
+    quint32 size() const { return _size; }
+    bool isEmpty() const { return _size == 0; }
+
+    T &operator[](quint32 i) { return _blocks.block(i >> Shift)[i & BlockMask]; }
+    const T &operator[](quint32 i) const { return _blocks.block(i >> Shift)[i & BlockMask]; }
+    const T &at(quint32 i) const { return _blocks.block(i >> Shift)[i & BlockMask]; }
+
+    /// Appends a default-constructed element and returns its index.
+    quint32 append()
+    {
+        Q_ASSERT_X(!_blocks.isExternal(), "ChunkedArray::append()", "array uses external memory");
+        if ((_size & BlockMask) == 0 && (_size >> Shift) == quint32(_blocks.count())) {
+            _blocks.append(new T[BlockSize]);
+        }
+        (*this)[_size] = T();
+        return _size++;
+    }
+
+    quint32 append(const T &value)
+    {
+        quint32 i = append();
+        (*this)[i] = value;
+        return i;
+    }
+
+    void clear()
+    {
+        _blocks.clear();
+        _size = 0;
+    }
+
+    /// Drops the elements from \a size on, keeping their blocks for the next appends.
+    /** Only elements never handed to another thread may be dropped.
+     **/
+    void truncate(quint32 size)
+    {
+        Q_ASSERT_X(!_blocks.isExternal(), "ChunkedArray::truncate()", "array uses external memory");
+        if (size < _size) {
+            _size = size;
+        }
+    }
+
+    /// Uses \a count elements at \a data in place, without copying them.
+    /** The array must be empty and becomes read-only; \a data must outlive
+     * it.
+     **/
+    void adopt(T *data, quint32 count)
+    {
+        Q_ASSERT_X(_size == 0, "ChunkedArray::adopt()", "array is not empty");
+        for (quint32 i = 0; i < count; i += BlockSize) {
+            _blocks.appendExternal(data + i);
+        }
+        _size = count;
+    }
+
+    /// Bytes allocated by the blocks, not counting the block table.
+    qint64 capacityBytes() const { return _blocks.isExternal() ? 0 : qint64(_blocks.count()) * BlockSize * sizeof(T); }
+
+private:
+    ChunkedArray(const ChunkedArray &);
+    ChunkedArray &operator=(const ChunkedArray &);
+
+    BlockTable<T> _blocks;
+    quint32 _size;
+};
+
+}
+
+#endif // CHUNKEDARRAY_H
@@ -0,0 +1,25 @@
+#include <QElapsedTimer>
+
+#include "diffworker.h"
+
+#include "listingdiff.h"
+
+DiffWorker::DiffWorker(const ShowListing::ListingStore *oldStore, const ShowListing::ListingStore *newStore)
+    : oldStore(oldStore), newStore(newStore), result(0), elapsed(0)
+{
+    setAutoDelete(false);
+}
+
+DiffWorker::~DiffWorker()
+{
+    delete result;
+}
+
+void DiffWorker::run()
+{
+    QElapsedTimer timer;
+    timer.start();
+    result = new ShowListing::ListingDiff(*oldStore, *newStore);
+    elapsed = timer.nsecsElapsed();
+    emit signalDiffFinished();
+}
@@ -0,0 +1,44 @@
+#ifndef DIFFWORKER_H
+#define DIFFWORKER_H
+
+#include <QObject>
+#include <QRunnable>
+
+namespace ShowListing{class ListingDiff; class ListingStore;}
+
+/// Compares two finished listings on a QThreadPool thread, see ListingDiff.
+/** The comparison cannot be interrupted, an owner that no longer wants it
+ * drops the result.
+ *
+ * Like LoadPathWorker it lives in the GUI thread and is deleted by its
+ * owner once signalDiffFinished() has been received. Both listings must
+ * stay alive until then.
+ **/
+class DiffWorker : public QObject, public QRunnable
+{
+    Q_OBJECT
+
+public:
+    DiffWorker(const ShowListing::ListingStore *oldStore, const ShowListing::ListingStore *newStore);
+    ~DiffWorker();
+
+    void run();
+
+    const ShowListing::ListingStore *oldListing() const { return oldStore; }
+    const ShowListing::ListingStore *newListing() const { return newStore; }
+    /// Null until signalDiffFinished() was emitted.
+    const ShowListing::ListingDiff *diff() const { return result; }
+    /// Time the comparison took.
+    qint64 nsecs() const { return elapsed; }
+
+private:
+    const ShowListing::ListingStore *oldStore;
+    const ShowListing::ListingStore *newStore;
+    ShowListing::ListingDiff *result;
+    qint64 elapsed;
+
+signals:
+    void signalDiffFinished();
+};
+
+#endif // DIFFWORKER_H
@@ -1,15 +1,14 @@
 #include <QtGui>
 #include <QHeaderView>
+#include <QScrollBar>
 
 #include "dirfiletree.h"
+#include "listingmodel.h"
 
 namespace ShowListing{
 DirFileTree::DirFileTree(QWidget *parent)
-    : QTreeWidget(parent)
+    : QTreeView(parent)
 {
-    QStringList labels;
-    labels << tr("Folder") << tr("Size");
-
     QFont curFont(font());
     curFont.setPointSizeF(8.5);
     setFont(curFont);
@@ -21,7 +20,8 @@ DirFileTree::DirFileTree(QWidget *parent)
 #else
     header()->setSectionResizeMode(QHeaderView::Interactive);
 #endif
-    setHeaderLabels(labels);
+    // every row is one line of text; lets the view skip per-row size hints
+    setUniformRowHeights(true);
 
     catalogPixmap = QPixmap("://ozturk_developerkit_paste.png");
     catalogIcon.addPixmap(catalogPixmap);
@@ -30,6 +30,64 @@ DirFileTree::DirFileTree(QWidget *parent)
     folderIcon.addPixmap(style()->standardPixmap(QStyle::SP_DirOpenIcon),
                          QIcon::Normal, QIcon::On);
     fileIcon.addPixmap(style()->standardPixmap(QStyle::SP_FileIcon));
+
+    _model = new ListingModel(this);
+    _model->setIcons(catalogIcon, folderIcon, fileIcon);
+    QFont matchFont(curFont);
+    matchFont.setBold(true);
+    _model->setMatchFont(matchFont);
+    setModel(_model);
+
+    // QTreeView only fetches more rows for the root, big directories further
+    // down get their next chunk once their last fetched row comes into view
+    connect(verticalScrollBar(), SIGNAL(valueChanged(int)), this, SLOT(fetchVisibleChunks()));
+    connect(this, SIGNAL(expanded(QModelIndex)), this, SLOT(fetchVisibleChunks()));
+}
+
+void DirFileTree::fetchVisibleChunks()
+{
+    QModelIndex index = indexAt(QPoint(0, viewport()->height() - 1));
+    if (!index.isValid()) {
+        // the tree ends above the bottom of the viewport, start from its last row
+        QModelIndex top = indexAt(QPoint(0, 0));
+        index = top.sibling(top.row(), 0);
+        for (QModelIndex below = indexBelow(index); below.isValid(); below = indexBelow(below)) {
+            index = below;
+        }
+    }
+    for (QModelIndex parent = index.parent(); index.isValid(); index = parent, parent = parent.parent()) {
+        if (index.row() == _model->rowCount(parent) - 1 && _model->canFetchMore(parent)) {
+            _model->fetchMore(parent);
+        }
+    }
+}
+
+void DirFileTree::fitColumnsToVisibleRows()
+{
+    int columns = _model->columnCount();
+    QVector<int> widths(columns, 0);
+    int bottom = viewport()->height();
+    QModelIndex top = indexAt(QPoint(0, 0));
+    for (QModelIndex index = top.sibling(top.row(), 0); index.isValid(); index = indexBelow(index)) {
+        QRect rect = visualRect(index);
+        if (rect.top() >= bottom) {
+            break;
+        }
+        for (int column = 0; column < columns; ++column) {
+            QModelIndex cell = index.sibling(index.row(), column);
+            int width = sizeHintForIndex(cell).width();
+            if (column == 0) {
+                // the branch lines and indentation in front of the name
+                width += rect.left() - columnViewportPosition(0);
+            }
+            widths[column] = qMax(widths[column], width);
+        }
+    }
+    for (int column = 0; column < columns; ++column) {
+        if (widths[column] > 0) {
+            setColumnWidth(column, qMax(widths[column], header()->sectionSizeHint(column)));
+        }
+    }
 }
 
 
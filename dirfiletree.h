@@ -1,25 +1,27 @@
 #ifndef DIRFILETREE_H
 #define DIRFILETREE_H
 
-#include <QDomDocument>
-#include <QHash>
 #include <QIcon>
-#include <QTreeWidget>
+#include <QTreeView>
 #include <QHeaderView>
 
 namespace ShowListing{
-class DirFileTree : public QTreeWidget
+class ListingModel;
+
+class DirFileTree : public QTreeView
 {
     Q_OBJECT
 
-public:
-    static const int RootType = QTreeWidgetItem::UserType;
-    static const int DirType = QTreeWidgetItem::UserType + 1;
-    static const int FileType = QTreeWidgetItem::UserType + 2;
-
 public:
     DirFileTree(QWidget *parent = 0);
 
+    ShowListing::ListingModel *listingModel() const { return _model; }
+    /// Sizes the columns to the rows currently on screen.
+    /** Unlike QHeaderView::ResizeToContents, costs the same for a list of a
+     * hundred entries and one of ten million.
+     **/
+    void fitColumnsToVisibleRows();
+
     QIcon catalogIcon;
     QIcon folderIcon;
     QIcon fileIcon;
@@ -29,7 +31,12 @@ public:
     Q_PROPERTY(QString generator READ generator WRITE setGenerator)
     Q_PROPERTY(QString base READ base WRITE setBase)
 
+private slots:
+    void fetchVisibleChunks();
+
 private:
+    ShowListing::ListingModel *_model;
+
     QString _generator;
     QString generator() const { return _generator; }
     void setGenerator(QString rhsgenerator) { _generator = rhsgenerator; }
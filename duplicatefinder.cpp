@@ -0,0 +1,290 @@
+#include <algorithm>
+#include <string.h>
+
+#include "duplicatefinder.h"
+#include "listingstore.h"
+#include "parallelwork.h"
+
+using ShowListing::DuplicateFinder;
+using ShowListing::ListingNode;
+using ShowListing::ListingStore;
+using ShowListing::NamePool;
+using ShowListing::NodeRange;
+using ShowListing::ParallelWork;
+using ShowListing::Tth;
+
+namespace {
+
+const int SHARD_BITS = 6;
+const int SHARD_COUNT = 1 << SHARD_BITS;
+
+/// One file as the finder sees it; the top bits of the hash pick its shard.
+/** The lowest bit of the hash is set for TTH keys, so that they never
+ * compare equal to name keys.
+ **/
+struct Key
+{
+    quint64 hash;
+    quint32 node;       // in stores[source]
+    quint16 listing;    // holding the file, through a link when it is not source
+    quint16 source;
+};
+
+inline bool byTth(const Key &key)
+{
+    return (key.hash & 1) != 0;
+}
+
+struct Range
+{
+    int listing;
+    NodeRange nodes;
+    QVector<Key> shards[SHARD_COUNT];
+};
+
+struct ShardResult
+{
+    QVector<DuplicateFinder::Group> groups;
+    QVector<DuplicateFinder::Copy> copies;
+    quint64 files;
+};
+
+struct State
+{
+    QVector<const ListingStore *> stores;   // listings searched, then those they link to
+    QVector<Range> ranges;
+    QVector<ShardResult> shards;
+};
+
+inline uchar fold(uchar c)
+{
+    return c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c;
+}
+
+/// FNV-1a of the folded name, mixed with the size and finalized so that the top bits spread well.
+inline quint64 nameKey(const char *name, int len, quint64 size)
+{
+    const uchar *p = reinterpret_cast<const uchar *>(name);
+    quint64 h = Q_UINT64_C(0xcbf29ce484222325);
+    for (int i = 0; i < len; ++i) {
+        h = (h ^ fold(p[i])) * Q_UINT64_C(0x100000001b3);
+    }
+    h ^= size * Q_UINT64_C(0x9e3779b97f4a7c15);
+    h ^= h >> 33;
+    h *= Q_UINT64_C(0xff51afd7ed558ccd);
+    h ^= h >> 33;
+    h *= Q_UINT64_C(0xc4ceb9fe1a85ec53);
+    h ^= h >> 33;
+    return h;
+}
+
+int compareFolded(const NamePool *names, quint32 a, quint32 b)
+{
+    const uchar *pa = reinterpret_cast<const uchar *>(names->data(a));
+    const uchar *pb = reinterpret_cast<const uchar *>(names->data(b));
+    int la = names->length(a);
+    int lb = names->length(b);
+    for (int i = 0; i < la && i < lb; ++i) {
+        if (fold(pa[i]) != fold(pb[i])) {
+            return fold(pa[i]) < fold(pb[i]) ? -1 : 1;
+        }
+    }
+    return la - lb;
+}
+
+/// Sorts keys by file identity, then by listing and document order.
+class KeyOrder
+{
+public:
+    explicit KeyOrder(const QVector<const ListingStore *> &stores) : stores(stores) {}
+
+    /// Negative, zero or positive as the file of \a a sorts before, like or after that of \a b.
+    int compareFiles(const Key &a, const Key &b) const
+    {
+        if (a.hash != b.hash) {
+            return a.hash < b.hash ? -1 : 1;
+        }
+        const ListingStore *sa = stores.at(a.source);
+        const ListingStore *sb = stores.at(b.source);
+        if (byTth(a)) {
+            return memcmp(sa->tth(a.node)->bytes, sb->tth(b.node)->bytes, Tth::Size);
+        }
+        const ListingNode &na = sa->node(a.node);
+        const ListingNode &nb = sb->node(b.node);
+        if (na.size != nb.size) {
+            return na.size < nb.size ? -1 : 1;
+        }
+        quint32 nameA = sa->nameId(a.node);
+        quint32 nameB = sb->nameId(b.node);
+        return nameA == nameB ? 0 : compareFolded(sa->names(), nameA, nameB);
+    }
+
+    bool operator()(const Key &a, const Key &b) const
+    {
+        int c = compareFiles(a, b);
+        if (c != 0) {
+            return c < 0;
+        }
+        if (a.listing != b.listing) {
+            return a.listing < b.listing;
+        }
+        return a.source != b.source ? a.source < b.source : a.node < b.node;
+    }
+
+private:
+    const QVector<const ListingStore *> &stores;
+};
+
+/// Keys the files of nodes [begin, end) of stores[source] for \a range, following links.
+void scanNodes(State *state, Range *range, int source, quint32 begin, quint32 end)
+{
+    const ListingStore &store = *state->stores.at(source);
+    const NamePool *names = store.names();
+    for (quint32 id = begin; id < end; ++id) {
+        const ListingNode &n = store.node(id);
+        if (n.flags & ListingNode::Linked) {
+            quint32 target;
+            const ListingStore *shared = store.resolve(id, &target);
+            scanNodes(state, range, state->stores.indexOf(shared), target + 1, shared->node(target).subtreeEnd);
+            continue;
+        }
+        if (n.type != ListingNode::File || (n.flags & ListingNode::NoSize) || n.size == 0) {
+            continue;
+        }
+        Key key;
+        key.node = id;
+        key.listing = quint16(range->listing);
+        key.source = quint16(source);
+        if (const Tth *tth = store.tth(id)) {
+            memcpy(&key.hash, tth->bytes, sizeof(key.hash));
+            key.hash |= 1;
+        } else {
+            quint32 name = store.nameId(id);
+            key.hash = nameKey(names->data(name), names->length(name), n.size) & ~Q_UINT64_C(1);
+        }
+        range->shards[key.hash >> (64 - SHARD_BITS)].append(key);
+    }
+}
+
+void scanRange(State *state, int i)
+{
+    Range &range = state->ranges[i];
+    scanNodes(state, &range, range.listing, range.nodes.begin, range.nodes.end);
+}
+
+void groupShard(State *state, int s)
+{
+    // gather the shard from every range, releasing the pieces on the way
+    int total = 0;
+    for (int i = 0; i < state->ranges.size(); ++i) {
+        total += state->ranges.at(i).shards[s].size();
+    }
+    QVector<Key> keys;
+    keys.reserve(total);
+    for (int i = 0; i < state->ranges.size(); ++i) {
+        QVector<Key> &piece = state->ranges[i].shards[s];
+        keys += piece;
+        piece = QVector<Key>();
+    }
+
+    KeyOrder order(state->stores);
+    std::sort(keys.begin(), keys.end(), order);
+
+    ShardResult &result = state->shards[s];
+    result.files = keys.size();
+    for (int begin = 0; begin < keys.size(); ) {
+        int end = begin + 1;
+        while (end < keys.size() && order.compareFiles(keys.at(begin), keys.at(end)) == 0) {
+            ++end;
+        }
+        if (end - begin > 1) {
+            DuplicateFinder::Group group;
+            group.size = state->stores.at(keys.at(begin).source)->node(keys.at(begin).node).size;
+            group.reclaimable = group.size * (end - begin - 1);
+            group.firstCopy = result.copies.size();
+            group.copyCount = end - begin;
+            group.listings = 0;
+            group.byTth = byTth(keys.at(begin));
+            for (int k = begin; k < end; ++k) {
+                if (k == begin || keys.at(k).listing != keys.at(k - 1).listing) {
+                    ++group.listings;
+                }
+                DuplicateFinder::Copy copy = { state->stores.at(keys.at(k).source), keys.at(k).node,
+                                               state->stores.at(keys.at(k).listing) };
+                result.copies.append(copy);
+            }
+            result.groups.append(group);
+        }
+        begin = end;
+    }
+}
+
+/// One step of the search, an item per range or per shard.
+class Step : public ParallelWork
+{
+public:
+    typedef void (*Work)(State *state, int i);
+
+    Step(Work work, State *state) : work(work), state(state) {}
+
+    void process(int i) { work(state, i); }
+
+private:
+    Work work;
+    State *state;
+};
+
+bool moreReclaimable(const DuplicateFinder::Group &a, const DuplicateFinder::Group &b)
+{
+    return a.reclaimable != b.reclaimable ? a.reclaimable > b.reclaimable : a.size > b.size;
+}
+
+}
+
+DuplicateFinder::DuplicateFinder(const QVector<const ListingStore *> &stores, int threads)
+    : _files(0), _reclaimable(0)
+{
+    State state;
+    state.stores = stores;
+    state.shards.resize(SHARD_COUNT);
+    // the listings linked to are read for the ones linking, without ranges of their own
+    for (int i = 0; i < state.stores.size(); ++i) {
+        const ListingStore *store = state.stores.at(i);
+        for (quint32 link = 0; link < store->linkCount(); ++link) {
+            if (!state.stores.contains(store->linkedStore(link))) {
+                state.stores.append(store->linkedStore(link));
+            }
+        }
+    }
+    Q_ASSERT_X(state.stores.size() <= 0xffff, "DuplicateFinder()", "too many listings");
+
+    quint64 nodes = 0;
+    for (int listing = 0; listing < stores.size(); ++listing) {
+        QVector<NodeRange> ranges;
+        nodes += ParallelWork::addTopLevelRanges(*stores.at(listing), &ranges);
+        for (int i = 0; i < ranges.size(); ++i) {
+            Range range;
+            range.listing = listing;
+            range.nodes = ranges.at(i);
+            state.ranges.append(range);
+        }
+    }
+
+    threads = ParallelWork::threadCount(threads, nodes);
+    Step(scanRange, &state).run(state.ranges.size(), threads);
+    Step(groupShard, &state).run(SHARD_COUNT, threads);
+
+    for (int s = 0; s < SHARD_COUNT; ++s) {
+        const ShardResult &result = state.shards.at(s);
+        int offset = _copies.size();
+        _files += result.files;
+        _copies += result.copies;
+        for (int g = 0; g < result.groups.size(); ++g) {
+            Group group = result.groups.at(g);
+            group.firstCopy += offset;
+            _reclaimable += group.reclaimable;
+            _groups.append(group);
+        }
+    }
+    std::stable_sort(_groups.begin(), _groups.end(), moreReclaimable);
+}
@@ -0,0 +1,67 @@
+#ifndef DUPLICATEFINDER_H
+#define DUPLICATEFINDER_H
+
+#include <QVector>
+
+namespace ShowListing{
+
+class ListingStore;
+
+/// Files present more than once across a set of finished listings.
+/** Files are keyed by their TTH root, or by name and size when the listing
+ * gave no TTH; names are compared with ASCII letters folded to lowercase.
+ * Files without a size, and empty ones, are left out. The files below a
+ * linked directory are read in the listing sharing them and count as
+ * copies held by the listing linking to it.
+ *
+ * The node tables are cut into ranges scanned on a thread pool; each range
+ * hashes its files into one bucket per shard. Every shard is then gathered
+ * and sorted by key on its own, so duplicates end up side by side and no
+ * table is shared between threads. The gathered keys take 16 bytes per
+ * file while the finder runs, what is kept is only the duplicates.
+ **/
+class DuplicateFinder
+{
+public:
+    struct Copy
+    {
+        const ListingStore *store;      // holding the node
+        quint32 node;
+        const ListingStore *listing;    // holding the copy, store unless it is shared through a link
+    };
+
+    struct Group
+    {
+        quint64 size;           // of one copy
+        quint64 reclaimable;    // bytes freed by keeping a single copy
+        int firstCopy;          // index in copies()
+        int copyCount;
+        int listings;           // distinct listings holding a copy
+        bool byTth;
+    };
+
+    /// Looks for duplicates among the files of \a stores, on \a threads threads.
+    /** With 0 threads, the ideal thread count is used for big listings and
+     * a single thread otherwise.
+     **/
+    explicit DuplicateFinder(const QVector<const ListingStore *> &stores, int threads = 0);
+
+    /// Most reclaimable bytes first.
+    const QVector<Group> &groups() const { return _groups; }
+    /// Copies of each group, in listing then document order.
+    const QVector<Copy> &copies() const { return _copies; }
+
+    /// Files considered, with a size and not empty.
+    quint64 files() const { return _files; }
+    quint64 reclaimable() const { return _reclaimable; }
+
+private:
+    QVector<Group> _groups;
+    QVector<Copy> _copies;
+    quint64 _files;
+    quint64 _reclaimable;
+};
+
+}
+
+#endif // DUPLICATEFINDER_H
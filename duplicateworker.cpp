@@ -0,0 +1,25 @@
+#include <QElapsedTimer>
+
+#include "duplicateworker.h"
+
+#include "duplicatefinder.h"
+
+DuplicateWorker::DuplicateWorker(const QVector<const ShowListing::ListingStore *> &stores)
+    : stores(stores), result(0), elapsed(0)
+{
+    setAutoDelete(false);
+}
+
+DuplicateWorker::~DuplicateWorker()
+{
+    delete result;
+}
+
+void DuplicateWorker::run()
+{
+    QElapsedTimer timer;
+    timer.start();
+    result = new ShowListing::DuplicateFinder(stores);
+    elapsed = timer.nsecsElapsed();
+    emit signalDuplicatesFinished();
+}
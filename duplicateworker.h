@@ -0,0 +1,39 @@
+#ifndef DUPLICATEWORKER_H
+#define DUPLICATEWORKER_H
+
+#include <QObject>
+#include <QRunnable>
+#include <QVector>
+
+namespace ShowListing{class DuplicateFinder; class ListingStore;}
+
+/// Looks for duplicates among finished listings on a QThreadPool thread, see DuplicateFinder.
+/** Like LoadPathWorker it lives in the GUI thread and is deleted by its
+ * owner once signalDuplicatesFinished() has been received. The listings,
+ * and those they link to, must stay alive until then.
+ **/
+class DuplicateWorker : public QObject, public QRunnable
+{
+    Q_OBJECT
+
+public:
+    explicit DuplicateWorker(const QVector<const ShowListing::ListingStore *> &stores);
+    ~DuplicateWorker();
+
+    void run();
+
+    /// Null until signalDuplicatesFinished() was emitted.
+    const ShowListing::DuplicateFinder *duplicates() const { return result; }
+    /// Time the search took.
+    qint64 nsecs() const { return elapsed; }
+
+private:
+    QVector<const ShowListing::ListingStore *> stores;
+    ShowListing::DuplicateFinder *result;
+    qint64 elapsed;
+
+signals:
+    void signalDuplicatesFinished();
+};
+
+#endif // DUPLICATEWORKER_H
@@ -0,0 +1,348 @@
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+
+#include <string.h>
+
+#include "exportworker.h"
+
+#include "listingstore.h"
+#include "lz4framewriter.h"
+
+using ShowListing::ListingNode;
+using ShowListing::ListingStore;
+using ShowListing::NamePool;
+using ShowListing::Tth;
+
+namespace {
+
+// written in one go, and the most a cancel request waits for
+const int BUFFER_SIZE = 4 << 20;
+
+const char HEX[] = "0123456789abcdef";
+
+}
+
+ExportWorker::ExportWorker(const QString &fileName, Format format, const ShowListing::ListingStore *store,
+                           quint32 node, const QString &parentPath)
+    : fileName(fileName), format(format), store(store), node(node), path(parentPath.toUtf8()),
+      separator(QDir::separator().toLatin1()), cancelRequested(0), rowCount(0),
+      device(0), out(0), fill(0), failed(false), stopped(false), needComma(false)
+{
+    setAutoDelete(false);
+}
+
+ExportWorker::Format ExportWorker::formatFor(const QString &fileName)
+{
+    QString name = fileName.toLower();
+    if (name.endsWith(".lz4")) {
+        name.chop(4);
+    }
+    QString suffix = QFileInfo(name).suffix();
+    if (suffix == "csv") {
+        return Csv;
+    }
+    if (suffix == "json") {
+        return Json;
+    }
+    return Text;
+}
+
+void ExportWorker::run()
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Unbuffered)) {
+        emit signalExportFinished(Failed, tr("Cannot write file %1:\n%2.").arg(fileName).arg(file.errorString()));
+        return;
+    }
+    device = &file;
+    Lz4FrameWriter compressor(&file);
+    bool compressed = fileName.endsWith(".lz4", Qt::CaseInsensitive);
+    if (compressed) {
+        if (!compressor.open(QIODevice::WriteOnly)) {
+            emit signalExportFinished(Failed, tr("Cannot write file %1:\n%2.").arg(fileName).arg(file.errorString()));
+            return;
+        }
+        device = &compressor;
+    }
+    buffer.resize(BUFFER_SIZE);
+    out = buffer.data();
+
+    writeHeader();
+    if (node == 0) {
+        // only top-level subtrees are reachable after a restart of the reader
+        const ListingNode &root = store->node(0);
+        for (quint32 row = 0; row < root.childCount && !stopped; ++row) {
+            quint32 top = store->child(0, row);
+            writeRange(store, top, store->node(top).subtreeEnd);
+        }
+    } else {
+        writeRange(store, node, store->node(node).subtreeEnd);
+    }
+    writeFooter();
+    flush();
+
+    bool cancelled = cancelRequested.loadAcquire() != 0;
+    QString message = file.errorString();
+    if (compressed) {
+        if (!compressor.finish() && !failed) {
+            failed = true;
+            message = compressor.errorString();
+        }
+        compressor.close();
+    }
+    file.close();
+    buffer.clear();
+    if (failed || cancelled) {
+        file.remove();
+        emit signalExportFinished(cancelled ? Cancelled : Failed,
+                                  cancelled ? QString() : tr("Cannot write file %1:\n%2.").arg(fileName).arg(message));
+        return;
+    }
+    emit signalExportFinished(Finished, QString());
+}
+
+void ExportWorker::writeHeader()
+{
+    switch (format) {
+    case Text:
+        break;
+    case Csv:
+        put("path,type,size,date,tth\n", 24);
+        break;
+    case Json: {
+        QByteArray source = store->sourcePath.toUtf8();
+        QByteArray generator = store->generator.toUtf8();
+        QByteArray generated = store->generatedDate.toUtf8();
+        put("{\"source\":", 10);
+        putJson(source.constData(), source.size());
+        put(",\"generator\":", 13);
+        putJson(generator.constData(), generator.size());
+        put(",\"generatedDate\":", 17);
+        putJson(generated.constData(), generated.size());
+        put(",\"path\":", 8);
+        putJson(path.constData(), path.size());
+        put(",\"entries\":[", 12);
+        break;
+    }
+    }
+}
+
+void ExportWorker::writeFooter()
+{
+    if (format == Json) {
+        put("\n]}\n", 4);
+    }
+}
+
+/// Writes nodes [begin, end) of \a listing, which start at the current depth.
+void ExportWorker::writeRange(const ListingStore *listing, quint32 begin, quint32 end)
+{
+    // nodes come in document order, a directory is left where its subtree ends
+    int base = dirs.size();
+    for (quint32 id = begin; id < end && !stopped; ++id) {
+        while (dirs.size() > base && id >= dirs.last().end) {
+            leaveDirectory();
+        }
+        writeEntry(listing, id);
+    }
+    while (dirs.size() > base) {
+        leaveDirectory();
+    }
+}
+
+void ExportWorker::writeEntry(const ListingStore *listing, quint32 id)
+{
+    const ListingNode &n = listing->node(id);
+    const NamePool *names = listing->names();
+    const char *name = names->data(listing->nameId(id));
+    int nameLength = names->length(listing->nameId(id));
+    bool directory = n.type == ListingNode::Directory;
+    bool hasSize = !(n.flags & ListingNode::NoSize);
+    const Tth *tth = listing->tth(id);
+    char tthText[Tth::Base32Length];
+    int parentLength = path.size();
+    path += separator;
+    path.append(name, nameLength);
+    ++rowCount;
+
+    switch (format) {
+    case Text:
+        for (int i = 0; i < dirs.size(); ++i) {
+            put("  ", 2);
+        }
+        put(name, nameLength);
+        if (directory) {
+            put(separator);
+        }
+        if (hasSize) {
+            put('\t');
+            putNumber(n.size);
+        }
+        put('\n');
+        break;
+    case Csv:
+        putCsv(path.constData(), path.size());
+        if (directory) {
+            put(",directory,", 11);
+        } else {
+            put(",file,", 6);
+        }
+        if (hasSize) {
+            putNumber(n.size);
+        }
+        put(',');
+        if (n.date) {
+            putNumber(n.date);
+        }
+        put(',');
+        if (tth) {
+            tth->toBase32(tthText);
+            put(tthText, Tth::Base32Length);
+        }
+        put('\n');
+        break;
+    case Json:
+        if (needComma) {
+            put(',');
+        }
+        put("\n{\"name\":", 9);
+        putJson(name, nameLength);
+        if (hasSize) {
+            put(",\"size\":", 8);
+            putNumber(n.size);
+        }
+        if (n.date) {
+            put(",\"date\":", 8);
+            putNumber(n.date);
+        }
+        if (n.flags & ListingNode::Incomplete) {
+            put(",\"incomplete\":true", 18);
+        }
+        if (tth) {
+            put(",\"tth\":\"", 8);
+            tth->toBase32(tthText);
+            put(tthText, Tth::Base32Length);
+            put('"');
+        }
+        if (directory) {
+            put(",\"entries\":[", 12);
+        } else {
+            put('}');
+        }
+        needComma = !directory;
+        break;
+    }
+
+    if (!directory) {
+        path.resize(parentLength);
+        return;
+    }
+    OpenDir dir = { n.subtreeEnd, parentLength };
+    dirs.append(dir);
+    // the entries of a linked directory follow it as if they were its own
+    quint32 target;
+    const ListingStore *shared = listing->resolve(id, &target);
+    if (shared != listing) {
+        writeRange(shared, target + 1, shared->node(target).subtreeEnd);
+    }
+}
+
+void ExportWorker::leaveDirectory()
+{
+    path.resize(dirs.last().pathLength);
+    dirs.removeLast();
+    if (format == Json) {
+        put("]}", 2);
+        needComma = true;
+    }
+}
+
+inline void ExportWorker::put(char c)
+{
+    if (fill == BUFFER_SIZE) {
+        flush();
+    }
+    out[fill++] = c;
+}
+
+inline void ExportWorker::put(const char *data, int len)
+{
+    if (fill + len > BUFFER_SIZE) {
+        flush();
+        if (len > BUFFER_SIZE) {
+            failed = failed || device->write(data, len) != len;
+            return;
+        }
+    }
+    memcpy(out + fill, data, len);
+    fill += len;
+}
+
+void ExportWorker::putNumber(quint64 value)
+{
+    char digits[20];
+    int i = sizeof(digits);
+    do {
+        digits[--i] = char('0' + value % 10);
+        value /= 10;
+    } while (value);
+    put(digits + i, sizeof(digits) - i);
+}
+
+/// Quotes the field only when it has to, doubling the quotes inside.
+void ExportWorker::putCsv(const char *data, int len)
+{
+    bool quoted = false;
+    for (int i = 0; i < len && !quoted; ++i) {
+        quoted = data[i] == '"' || data[i] == ',' || data[i] == '\n' || data[i] == '\r';
+    }
+    if (!quoted) {
+        put(data, len);
+        return;
+    }
+    put('"');
+    int from = 0;
+    for (int i = 0; i < len; ++i) {
+        if (data[i] == '"') {
+            // the quote goes out at the end of this run and again at the start of the next
+            put(data + from, i + 1 - from);
+            from = i;
+        }
+    }
+    put(data + from, len - from);
+    put('"');
+}
+
+/// Writes UTF-8 \a data as a JSON string, escaping what has to be.
+void ExportWorker::putJson(const char *data, int len)
+{
+    put('"');
+    int from = 0;
+    for (int i = 0; i < len; ++i) {
+        uchar c = uchar(data[i]);
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            continue;
+        }
+        put(data + from, i - from);
+        if (c == '"' || c == '\\') {
+            put('\\');
+            put(char(c));
+        } else {
+            char escape[6] = { '\\', 'u', '0', '0', HEX[c >> 4], HEX[c & 0xf] };
+            put(escape, sizeof(escape));
+        }
+        from = i + 1;
+    }
+    put(data + from, len - from);
+    put('"');
+}
+
+void ExportWorker::flush()
+{
+    if (fill > 0 && !failed) {
+        failed = device->write(out, fill) != fill;
+    }
+    fill = 0;
+    stopped = failed || cancelRequested.loadAcquire();
+}
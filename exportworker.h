@@ -0,0 +1,95 @@
+#ifndef EXPORTWORKER_H
+#define EXPORTWORKER_H
+
+#include <QAtomicInt>
+#include <QByteArray>
+#include <QObject>
+#include <QRunnable>
+#include <QVector>
+
+namespace ShowListing{class ListingStore;}
+QT_BEGIN_NAMESPACE
+class QIODevice;
+QT_END_NAMESPACE
+
+/// Writes a listing, or one of its subtrees, to a file on a QThreadPool thread.
+/** Text is an indented tree of names and sizes. CSV is flat, one row per
+ * entry with its full path, type, size (cumulated for directories), date
+ * and TTH. JSON nests the entries of every directory in it. A file name
+ * ending in .lz4 gets the same output compressed into an LZ4 frame.
+ *
+ * Nodes are walked in document order and formatted straight into a large
+ * buffer: nothing is allocated per entry, the path of the current entry is
+ * kept in one byte array cut back as directories are left. Linked
+ * directories are written with the entries they share.
+ *
+ * Like LoadPathWorker it lives in the GUI thread and is deleted by its
+ * owner once signalExportFinished() has been received. The listings must
+ * stay alive until then.
+ **/
+class ExportWorker : public QObject, public QRunnable
+{
+    Q_OBJECT
+
+public:
+    enum Format { Text, Csv, Json };
+    enum Status { Finished = 0, Failed = 1, Cancelled = 2 };
+
+    /// Exports \a node of \a store, every top-level entry for the root.
+    /** \a parentPath is the path the entry's own is appended to, empty for
+     * top-level entries.
+     **/
+    ExportWorker(const QString &fileName, Format format, const ShowListing::ListingStore *store,
+                 quint32 node, const QString &parentPath);
+
+    void run();
+    void postCancelRequest() { cancelRequested.storeRelease(1); }
+    /// Entries written, final once signalExportFinished() was emitted.
+    quint64 rows() const { return rowCount; }
+
+    /// Format matching the extension of \a fileName, Text when there is none.
+    static Format formatFor(const QString &fileName);
+
+private:
+    struct OpenDir
+    {
+        quint32 end;        // subtreeEnd of the directory
+        int pathLength;     // of its parent
+    };
+
+    void writeHeader();
+    void writeRange(const ShowListing::ListingStore *listing, quint32 begin, quint32 end);
+    void writeEntry(const ShowListing::ListingStore *listing, quint32 id);
+    void leaveDirectory();
+    void writeFooter();
+
+    void put(char c);
+    void put(const char *data, int len);
+    void putNumber(quint64 value);
+    void putCsv(const char *data, int len);
+    void putJson(const char *data, int len);
+    void flush();
+
+    QString fileName;
+    Format format;
+    const ShowListing::ListingStore *store;
+    quint32 node;
+    QByteArray path;
+    char separator;
+    QAtomicInt cancelRequested;
+    quint64 rowCount;
+
+    QIODevice *device;
+    QByteArray buffer;
+    char *out;              // data of buffer
+    int fill;
+    bool failed;
+    bool stopped;           // failed or cancelled, checked at every flush
+    QVector<OpenDir> dirs;
+    bool needComma;         // JSON, an entry was written at this level
+
+signals:
+    void signalExportFinished(int status, const QString& message);
+};
+
+#endif // EXPORTWORKER_H
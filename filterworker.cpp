@@ -0,0 +1,73 @@
+#include "filterworker.h"
+
+#include "listingstore.h"
+#include "searchindex.h"
+
+namespace {
+
+// small enough for the first matches to show up at once
+const int BATCH_SIZE = 2048;
+
+}
+
+FilterWorker::FilterWorker(const ShowListing::SearchIndex *index, int generation, const QString &text)
+    : index(index), gen(generation), text(text), cancelRequested(0)
+{
+    setAutoDelete(false);
+}
+
+void FilterWorker::addListing(const ShowListing::ListingStore *store, const QVector<quint32> *previous)
+{
+    stores.append(store);
+    if (previous) {
+        previousMatches.insert(store, *previous);
+    }
+}
+
+void FilterWorker::run()
+{
+    QByteArray folded = ShowListing::SearchIndex::fold(text);
+    int total = 0;
+    for (int i = 0; i < stores.size() && !cancelRequested.loadAcquire(); ++i) {
+        const ShowListing::ListingStore *store = stores.at(i);
+        QVector<quint32> batch;
+        QHash<const ShowListing::ListingStore *, QVector<quint32> >::const_iterator previous
+                = previousMatches.constFind(store);
+        // a linked directory matches through the entries it shares, not by its name
+        if (previous == previousMatches.constEnd() || store->linkCount() > 0) {
+            QVector<quint32> nodes = index->entries(store, folded);
+            total += nodes.size();
+            for (int from = 0; from < nodes.size() && !cancelRequested.loadAcquire(); from += BATCH_SIZE) {
+                batch = nodes.mid(from, BATCH_SIZE);
+                publish(store, &batch);
+            }
+            continue;
+        }
+
+        // the new text extends the old one, its matches are among the old ones
+        const QVector<quint32> &candidates = previous.value();
+        for (int c = 0; c < candidates.size(); ++c) {
+            if (index->nameContains(store->nameId(candidates.at(c)), folded)) {
+                batch.append(candidates.at(c));
+                if (batch.size() == BATCH_SIZE) {
+                    total += batch.size();
+                    publish(store, &batch);
+                    if (cancelRequested.loadAcquire()) {
+                        break;
+                    }
+                }
+            }
+        }
+        total += batch.size();
+        publish(store, &batch);
+    }
+    emit signalFilterFinished(gen, total, cancelRequested.loadAcquire() != 0);
+}
+
+void FilterWorker::publish(const ShowListing::ListingStore *store, QVector<quint32> *batch)
+{
+    if (!batch->isEmpty()) {
+        emit signalMatchesReady(gen, store, *batch);
+        batch->resize(0);
+    }
+}
@@ -0,0 +1,54 @@
+#ifndef FILTERWORKER_H
+#define FILTERWORKER_H
+
+#include <QAtomicInt>
+#include <QHash>
+#include <QList>
+#include <QObject>
+#include <QRunnable>
+#include <QVector>
+
+namespace ShowListing{class ListingStore; class SearchIndex;}
+
+/// Finds the entries of some listings whose name contains a text, on a QThreadPool thread.
+/** Matches are handed over in document order, in batches, through queued
+ * signals tagged with the generation the worker was started for, so that
+ * batches of a superseded filter can be told apart. When the text extends
+ * the one of a complete earlier result, only the entries of that result
+ * are checked again.
+ *
+ * Like LoadPathWorker it lives in the GUI thread and is deleted by its
+ * owner once signalFilterFinished() has been received.
+ **/
+class FilterWorker : public QObject, public QRunnable
+{
+    Q_OBJECT
+
+public:
+    FilterWorker(const ShowListing::SearchIndex *index, int generation, const QString &text);
+
+    /// Listing to look in, with what an earlier text of this one matched in it.
+    /** Without \a previous every entry of the listing is a candidate.
+     **/
+    void addListing(const ShowListing::ListingStore *store, const QVector<quint32> *previous = 0);
+    void run();
+    void postCancelRequest() { cancelRequested.storeRelease(1); }
+
+    int generation() const { return gen; }
+
+private:
+    void publish(const ShowListing::ListingStore *store, QVector<quint32> *batch);
+
+    const ShowListing::SearchIndex *index;
+    int gen;
+    QString text;
+    QList<const ShowListing::ListingStore *> stores;
+    QHash<const ShowListing::ListingStore *, QVector<quint32> > previousMatches;
+    QAtomicInt cancelRequested;
+
+signals:
+    void signalMatchesReady(int generation, const ShowListing::ListingStore *store, const QVector<quint32> &nodes);
+    void signalFilterFinished(int generation, int total, bool cancelled);
+};
+
+#endif // FILTERWORKER_H
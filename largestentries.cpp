@@ -0,0 +1,105 @@
+#include <algorithm>
+
+#include "largestentries.h"
+#include "listingstore.h"
+#include "parallelwork.h"
+
+using ShowListing::LargestEntries;
+using ShowListing::ListingNode;
+using ShowListing::ListingStore;
+using ShowListing::NodeRange;
+using ShowListing::ParallelWork;
+
+namespace {
+
+typedef LargestEntries::Entry Entry;
+
+/// Bigger first, then earlier in the document.
+inline bool before(const Entry &a, const Entry &b)
+{
+    return a.size != b.size ? a.size > b.size : a.node < b.node;
+}
+
+/// Keeps the \a count best entries in a heap whose top is the worst of them.
+inline void offer(QVector<Entry> *heap, int count, const Entry &entry)
+{
+    if (heap->size() < count) {
+        heap->append(entry);
+        std::push_heap(heap->begin(), heap->end(), before);
+    } else if (before(entry, heap->first())) {
+        std::pop_heap(heap->begin(), heap->end(), before);
+        heap->last() = entry;
+        std::push_heap(heap->begin(), heap->end(), before);
+    }
+}
+
+struct Heaps
+{
+    QVector<Entry> files;
+    QVector<Entry> directories;
+};
+
+/// Offers nodes [begin, end) of \a store, and the entries of the linked directories among them.
+void scanNodes(const ListingStore *store, quint32 begin, quint32 end, int count, Heaps *heaps)
+{
+    for (quint32 id = begin; id < end; ++id) {
+        const ListingNode &n = store->node(id);
+        Entry entry = { n.size, store, id };
+        if (n.type == ListingNode::Directory) {
+            offer(&heaps->directories, count, entry);
+            quint32 target;
+            const ListingStore *shared = store->resolve(id, &target);
+            if (shared != store) {
+                scanNodes(shared, target + 1, shared->node(target).subtreeEnd, count, heaps);
+            }
+        } else if (!(n.flags & ListingNode::NoSize)) {
+            offer(&heaps->files, count, entry);
+        }
+    }
+}
+
+/// Fills one pair of heaps per range.
+class RangeScan : public ParallelWork
+{
+public:
+    RangeScan(const ListingStore &store, int count) : store(store), count(count) {}
+
+    void process(int i)
+    {
+        scanNodes(&store, ranges.at(i).begin, ranges.at(i).end, count, &heaps[i]);
+    }
+
+    const ListingStore &store;
+    int count;
+    QVector<NodeRange> ranges;
+    QVector<Heaps> heaps;
+};
+
+void merge(const QVector<Heaps> &heaps, const QVector<Entry> Heaps::*heap, int count, QVector<Entry> *result)
+{
+    result->resize(0);
+    for (int i = 0; i < heaps.size(); ++i) {
+        const QVector<Entry> &entries = heaps.at(i).*heap;
+        for (int j = 0; j < entries.size(); ++j) {
+            offer(result, count, entries.at(j));
+        }
+    }
+    std::sort_heap(result->begin(), result->end(), before);
+}
+
+}
+
+LargestEntries::LargestEntries(const ListingStore &store, int count, int threads)
+{
+    if (count <= 0) {
+        return;
+    }
+
+    RangeScan scan(store, count);
+    quint64 nodes = ParallelWork::addTopLevelRanges(store, &scan.ranges);
+    scan.heaps.resize(scan.ranges.size());
+    scan.run(scan.ranges.size(), ParallelWork::threadCount(threads, nodes));
+
+    merge(scan.heaps, &Heaps::files, count, &_files);
+    merge(scan.heaps, &Heaps::directories, count, &_directories);
+}
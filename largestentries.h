@@ -0,0 +1,45 @@
+#ifndef LARGESTENTRIES_H
+#define LARGESTENTRIES_H
+
+#include <QVector>
+
+namespace ShowListing{
+
+class ListingStore;
+
+/// The biggest files and directories of a finished listing.
+/** The node table is cut into ranges that are scanned on a thread pool,
+ * each keeping the biggest entries it saw in two bounded min-heaps; the
+ * heaps are merged at the end. Only the final entries get sorted, and the
+ * model is not involved: directory sizes are the ones the reader already
+ * cumulated. The entries below a linked directory are looked for in the
+ * listing sharing them and reported with it.
+ **/
+class LargestEntries
+{
+public:
+    struct Entry
+    {
+        quint64 size;
+        const ListingStore *store;  // the listing searched, or one it links to
+        quint32 node;
+    };
+
+    /// Looks for the \a count biggest entries of \a store, on \a threads threads.
+    /** With 0 threads, the ideal thread count is used for big listings and
+     * a single thread otherwise.
+     **/
+    LargestEntries(const ListingStore &store, int count, int threads = 0);
+
+    /// Biggest first, ties in document order.
+    const QVector<Entry> &files() const { return _files; }
+    const QVector<Entry> &directories() const { return _directories; }
+
+private:
+    QVector<Entry> _files;
+    QVector<Entry> _directories;
+};
+
+}
+
+#endif // LARGESTENTRIES_H
@@ -0,0 +1,59 @@
+#include <QElapsedTimer>
+
+#include <algorithm>
+
+#include "largestworker.h"
+
+#include "largestentries.h"
+
+using ShowListing::LargestEntries;
+using ShowListing::ListingStore;
+
+namespace {
+
+typedef LargestWorker::Entry Entry;
+
+bool bigger(const Entry &a, const Entry &b)
+{
+    return a.size > b.size;
+}
+
+void append(QVector<Entry> *all, const ListingStore *listing, const QVector<LargestEntries::Entry> &entries)
+{
+    for (int i = 0; i < entries.size(); ++i) {
+        Entry entry = { entries.at(i).size, entries.at(i).store, entries.at(i).node, listing };
+        all->append(entry);
+    }
+}
+
+/// Keeps the \a count biggest of \a entries, each listing's own order being kept for ties.
+void keepBiggest(QVector<Entry> *entries, int count)
+{
+    std::stable_sort(entries->begin(), entries->end(), bigger);
+    if (entries->size() > count) {
+        entries->resize(count);
+    }
+}
+
+}
+
+LargestWorker::LargestWorker(const QVector<const ListingStore *> &stores, int count)
+    : stores(stores), count(count), elapsed(0)
+{
+    setAutoDelete(false);
+}
+
+void LargestWorker::run()
+{
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 0; i < stores.size(); ++i) {
+        LargestEntries largest(*stores.at(i), count);
+        append(&largestFiles, stores.at(i), largest.files());
+        append(&largestDirectories, stores.at(i), largest.directories());
+    }
+    keepBiggest(&largestFiles, count);
+    keepBiggest(&largestDirectories, count);
+    elapsed = timer.nsecsElapsed();
+    emit signalLargestFinished();
+}
@@ -0,0 +1,49 @@
+#ifndef LARGESTWORKER_H
+#define LARGESTWORKER_H
+
+#include <QObject>
+#include <QRunnable>
+#include <QVector>
+
+namespace ShowListing{class ListingStore;}
+
+/// Looks for the biggest entries of finished listings on a QThreadPool thread, see LargestEntries.
+/** Like LoadPathWorker it lives in the GUI thread and is deleted by its
+ * owner once signalLargestFinished() has been received. The listings, and
+ * those they link to, must stay alive until then.
+ **/
+class LargestWorker : public QObject, public QRunnable
+{
+    Q_OBJECT
+
+public:
+    struct Entry
+    {
+        quint64 size;
+        const ShowListing::ListingStore *store;     // holding the node
+        quint32 node;
+        const ShowListing::ListingStore *listing;   // searched, store unless found through a link
+    };
+
+    LargestWorker(const QVector<const ShowListing::ListingStore *> &stores, int count);
+
+    void run();
+
+    /// The \a count biggest across all listings, biggest first, ties in listing order.
+    const QVector<Entry> &files() const { return largestFiles; }
+    const QVector<Entry> &directories() const { return largestDirectories; }
+    /// Time the search took.
+    qint64 nsecs() const { return elapsed; }
+
+private:
+    QVector<const ShowListing::ListingStore *> stores;
+    int count;
+    QVector<Entry> largestFiles;
+    QVector<Entry> largestDirectories;
+    qint64 elapsed;
+
+signals:
+    void signalLargestFinished();
+};
+
+#endif // LARGESTWORKER_H
@@ -0,0 +1,171 @@
+#include <QHash>
+
+#include <algorithm>
+
+#include "listingdiff.h"
+#include "listingstore.h"
+#include "parallelwork.h"
+
+using ShowListing::ListingDiff;
+using ShowListing::ListingNode;
+using ShowListing::ListingStore;
+using ShowListing::ParallelWork;
+
+namespace {
+
+// directory pairs handed to every thread, so that uneven ones even out
+const int PAIRS_PER_THREAD = 4;
+
+/// Directories matched in both listings whose contents differ.
+struct Pair
+{
+    quint32 oldDir;
+    quint32 newDir;
+};
+
+struct Result
+{
+    QVector<quint32> added;
+    QVector<quint32> removed;
+    QVector<ListingDiff::Change> changed;
+    quint64 identical;
+};
+
+inline quint64 joinKey(const ListingStore &store, quint32 id)
+{
+    return (quint64(store.nameId(id)) << 2) | store.node(id).type;
+}
+
+bool fileChanged(const ListingStore &a, quint32 o, const ListingStore &b, quint32 n)
+{
+    const ListingNode &x = a.node(o);
+    const ListingNode &y = b.node(n);
+    if ((x.flags & ListingNode::NoSize) != (y.flags & ListingNode::NoSize) || x.size != y.size) {
+        return true;
+    }
+    // a TTH showing up or going away alone says nothing about the content
+    return a.tth(o) && b.tth(n) && *a.tth(o) != *b.tth(n);
+}
+
+/// Joins the children of \a pair, queueing the directory pairs that need a closer look.
+void compareChildren(const ListingStore &a, const ListingStore &b, const Pair &pair,
+                     Result *result, QVector<Pair> *pending)
+{
+    const ListingNode &oldDir = a.node(pair.oldDir);
+    const ListingNode &newDir = b.node(pair.newDir);
+    QHash<quint64, quint32> rows;
+    rows.reserve(oldDir.childCount);
+    for (quint32 row = 0; row < oldDir.childCount; ++row) {
+        rows.insert(joinKey(a, a.child(pair.oldDir, row)), row);
+    }
+    QVector<bool> matched(oldDir.childCount, false);
+
+    for (quint32 row = 0; row < newDir.childCount; ++row) {
+        quint32 nc = b.child(pair.newDir, row);
+        const ListingNode &n = b.node(nc);
+        QHash<quint64, quint32>::const_iterator it = rows.constFind(joinKey(b, nc));
+        if (it == rows.constEnd() || matched.at(it.value())) {
+            result->added.append(nc);
+            continue;
+        }
+        matched[it.value()] = true;
+        quint32 oc = a.child(pair.oldDir, it.value());
+        if (n.type == ListingNode::File) {
+            if (fileChanged(a, oc, b, nc)) {
+                ListingDiff::Change change = { oc, nc };
+                result->changed.append(change);
+            }
+            continue;
+        }
+        if (a.contentHash(oc) == b.contentHash(nc)) {
+            result->identical += n.subtreeEnd - nc;
+            continue;
+        }
+        // the entries below a link belong to another listing, it is replaced as a whole
+        if ((a.node(oc).flags | n.flags) & ListingNode::Linked) {
+            result->removed.append(oc);
+            result->added.append(nc);
+            continue;
+        }
+        Pair sub = { oc, nc };
+        pending->append(sub);
+    }
+
+    for (quint32 row = 0; row < oldDir.childCount; ++row) {
+        if (!matched.at(row)) {
+            result->removed.append(a.child(pair.oldDir, row));
+        }
+    }
+}
+
+void diffFrom(const ListingStore &a, const ListingStore &b, const Pair &start, Result *result)
+{
+    QVector<Pair> stack;
+    stack.append(start);
+    while (!stack.isEmpty()) {
+        Pair pair = stack.last();
+        stack.removeLast();
+        compareChildren(a, b, pair, result, &stack);
+    }
+}
+
+/// Diffs the subtrees below each pair into its own result.
+class PairDiff : public ParallelWork
+{
+public:
+    PairDiff(const ListingStore &a, const ListingStore &b, const QVector<Pair> &pairs, QVector<Result> *results)
+        : a(a), b(b), pairs(pairs), results(results) {}
+
+    void process(int i) { diffFrom(a, b, pairs.at(i), &(*results)[i]); }
+
+private:
+    const ListingStore &a;
+    const ListingStore &b;
+    const QVector<Pair> &pairs;
+    QVector<Result> *results;
+};
+
+bool newOrder(const ListingDiff::Change &x, const ListingDiff::Change &y)
+{
+    return x.newNode < y.newNode;
+}
+
+}
+
+ListingDiff::ListingDiff(const ListingStore &oldStore, const ListingStore &newStore, int threads)
+    : _identical(0)
+{
+    Q_ASSERT_X(oldStore.names() == newStore.names(), "ListingDiff()", "listings use different name pools");
+    threads = ParallelWork::threadCount(threads, qMax(oldStore.nodeCount(), newStore.nodeCount()));
+
+    // go down level by level until there is enough work to share out
+    Result serial;
+    serial.identical = 0;
+    QVector<Pair> frontier;
+    Pair root = { 0, 0 };
+    frontier.append(root);
+    int wanted = threads > 1 ? threads * PAIRS_PER_THREAD : 0;
+    while (!frontier.isEmpty() && frontier.size() < wanted) {
+        QVector<Pair> next;
+        for (int i = 0; i < frontier.size(); ++i) {
+            compareChildren(oldStore, newStore, frontier.at(i), &serial, &next);
+        }
+        frontier = next;
+    }
+
+    Result empty;
+    empty.identical = 0;
+    QVector<Result> results(frontier.size(), empty);
+    PairDiff(oldStore, newStore, frontier, &results).run(frontier.size(), threads);
+
+    results.append(serial);
+    for (int i = 0; i < results.size(); ++i) {
+        _added += results.at(i).added;
+        _removed += results.at(i).removed;
+        _changed += results.at(i).changed;
+        _identical += results.at(i).identical;
+    }
+    std::sort(_added.begin(), _added.end());
+    std::sort(_removed.begin(), _removed.end());
+    std::sort(_changed.begin(), _changed.end(), newOrder);
+}
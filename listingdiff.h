@@ -0,0 +1,57 @@
+#ifndef LISTINGDIFF_H
+#define LISTINGDIFF_H
+
+#include <QVector>
+
+namespace ShowListing{
+
+class ListingStore;
+
+/// Entries added, removed and changed between two versions of a listing.
+/** Both listings are walked level by level from their roots. The children
+ * of every pair of matching directories are joined on a hash of their name
+ * and type: what only the new directory has was added, what only the old
+ * one has was removed, and files whose size or TTH differ changed. Added
+ * and removed directories are reported as a whole, without their contents.
+ *
+ * Matching directories with the same content hash are skipped without
+ * looking inside, so the cost follows what changed rather than the size of
+ * the listings. Once the first levels yield enough directory pairs, those
+ * are diffed on a thread pool. A linked directory whose content differs is
+ * reported removed and added as a whole, its entries belong to another
+ * listing.
+ **/
+class ListingDiff
+{
+public:
+    struct Change
+    {
+        quint32 oldNode;
+        quint32 newNode;
+    };
+
+    /// Compares the finished listings \a oldStore and \a newStore, which must share a NamePool.
+    /** With 0 threads, the ideal thread count is used for big listings and
+     * a single thread otherwise.
+     **/
+    ListingDiff(const ListingStore &oldStore, const ListingStore &newStore, int threads = 0);
+
+    /// Nodes of the new listing, in document order.
+    const QVector<quint32> &added() const { return _added; }
+    /// Nodes of the old listing, in document order.
+    const QVector<quint32> &removed() const { return _removed; }
+    /// Files found in both, in document order of the new listing.
+    const QVector<Change> &changed() const { return _changed; }
+    /// Nodes of the new listing skipped as part of an identical subtree.
+    quint64 identical() const { return _identical; }
+
+private:
+    QVector<quint32> _added;
+    QVector<quint32> _removed;
+    QVector<Change> _changed;
+    quint64 _identical;
+};
+
+}
+
+#endif // LISTINGDIFF_H
@@ -0,0 +1,694 @@
+#include <QBrush>
+#include <QColor>
+#include <QDir>
+
+#include <algorithm>
+
+#include "listingmodel.h"
+#include "listingstore.h"
+#include "namepool.h"
+#include "searchindex.h"
+#include "subtreeindex.h"
+#include "util.h"
+
+using ShowListing::ListingModel;
+using ShowListing::ListingStore;
+using ShowListing::ListingNode;
+using ShowListing::NamePool;
+using ShowListing::Tth;
+
+namespace {
+
+const int PATH_CACHE_SIZE = 256;
+
+inline Qt::GlobalColor getColorFromSize(const qulonglong& val)
+{
+    if(val >= (1ULL << 40)) {
+        return Qt::darkRed;
+    }
+    else if(val >= (500 * 1ULL << 30)) {
+        return Qt::darkMagenta;
+    }
+    else if(val >= (100 * 1ULL << 30)) {  // 2^30 = 1 GiB
+        return Qt::darkGreen;
+    }
+    else if(val >= (5 * 1ULL << 30)) {
+        return Qt::black;
+    }
+    return Qt::darkGray;
+}
+
+inline Qt::GlobalColor markColor(int mark)
+{
+    switch (mark) {
+    case ListingModel::AddedMark:
+        return Qt::darkGreen;
+    case ListingModel::RemovedMark:
+        return Qt::red;
+    case ListingModel::ChangedMark:
+        return Qt::darkYellow;
+    }
+    return Qt::black;
+}
+
+}
+
+ListingModel::ListingModel(QObject *parent)
+    : QAbstractItemModel(parent), _names(new NamePool), _search(new SearchIndex(_names)),
+      _subtrees(new SubtreeIndex), _filtering(false), _pathCache(PATH_CACHE_SIZE)
+{
+    _root.listing = 0;
+    _root.store = 0;
+    _root.node = 0;
+    _root.parent = 0;
+    _root.row = 0;
+    _root.fetched = 0;
+}
+
+ListingModel::~ListingModel()
+{
+    deleteChildren(&_root);
+    for (int i = 0; i < _listings.size(); ++i) {
+        delete _listings.at(i)->store;
+        delete _listings.at(i);
+    }
+    delete _subtrees;
+    delete _search;
+    delete _names;
+}
+
+void ListingModel::setIcons(const QIcon &catalog, const QIcon &folder, const QIcon &file)
+{
+    _catalogIcon = catalog;
+    _folderIcon = folder;
+    _fileIcon = file;
+}
+
+QModelIndex ListingModel::addListing(ListingStore *store)
+{
+    Listing *listing = new Listing;
+    listing->store = store;
+    listing->size = 0;
+
+    int row = _listings.size();
+    beginInsertRows(QModelIndex(), row, row);
+    _listings.append(listing);
+    endInsertRows();
+    return index(row, 0);
+}
+
+int ListingModel::listingRow(const ListingStore *store) const
+{
+    for (int i = 0; i < _listings.size(); ++i) {
+        if (_listings.at(i)->store == store) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void ListingModel::publishSubtrees(ListingStore *store, const QVector<quint32> &ids, quint64 totalSize)
+{
+    int row = listingRow(store);
+    if (row < 0) {
+        return;
+    }
+    Listing *listing = _listings.at(row);
+    // metadata is final once the first batch has been emitted
+    listing->generatedDate = store->generatedDate;
+    listing->size = totalSize;
+
+    QModelIndex parent = index(row, 0);
+    if (_filtering) {
+        // nothing of a list still loading is indexed, let alone matched
+        listing->topLevel += ids;
+    } else if (!ids.isEmpty()) {
+        int first = listing->topLevel.size();
+        beginInsertRows(parent, first, first + ids.size() - 1);
+        listing->topLevel += ids;
+        endInsertRows();
+    }
+    emit dataChanged(parent, index(row, 1));
+}
+
+void ListingModel::unpublishSubtrees(ListingStore *store)
+{
+    int row = listingRow(store);
+    if (row < 0 || _listings.at(row)->topLevel.isEmpty()) {
+        return;
+    }
+    Listing *listing = _listings.at(row);
+    if (_filtering) {
+        listing->topLevel.clear();
+        listing->size = 0;
+        return;
+    }
+    QModelIndex parent = index(row, 0);
+    beginRemoveRows(parent, 0, listing->topLevel.size() - 1);
+    deleteChildren(viewNode(parent));
+    _pathCache.clear();
+    listing->topLevel.clear();
+    listing->size = 0;
+    endRemoveRows();
+}
+
+void ListingModel::removeListing(ListingStore *store)
+{
+    int row = listingRow(store);
+    if (row < 0) {
+        return;
+    }
+    _search->removeListing(store);
+    _subtrees->removeListing(store);
+    beginRemoveRows(QModelIndex(), row, row);
+    Listing *listing = _listings.takeAt(row);
+
+    // rows after the removed one shift up, renumber their records
+    QHash<int, ViewNode *> shifted;
+    QHash<int, ViewNode *>::iterator it = _root.children.begin();
+    for (; it != _root.children.end(); ++it) {
+        ViewNode *view = it.value();
+        if (view->row == row) {
+            deleteChildren(view);
+            delete view;
+        } else {
+            if (view->row > row) {
+                --view->row;
+            }
+            shifted.insert(view->row, view);
+        }
+    }
+    _root.children = shifted;
+    _pathCache.clear();
+    endRemoveRows();
+
+    delete listing->store;
+    delete listing;
+}
+
+QModelIndex ListingModel::indexOf(const ListingStore *store, quint32 node)
+{
+    int listingIndex = listingRow(store);
+    if (listingIndex < 0) {
+        return QModelIndex();
+    }
+    QVector<quint32> ancestors;
+    for (quint32 id = node; id != 0; id = store->node(id).parent) {
+        ancestors.append(id);
+    }
+
+    // children are listed in document order, their ids grow with the row
+    QModelIndex index = this->index(listingIndex, 0);
+    for (int i = ancestors.size() - 1; i >= 0; --i) {
+        quint32 id = ancestors.at(i);
+        int row;
+        if (_filtering || i == ancestors.size() - 1) {
+            ViewNode *view = viewNode(index);
+            const QVector<quint32> &rows = _filtering ? view->filtered : view->listing->topLevel;
+            QVector<quint32>::const_iterator it = std::lower_bound(rows.begin(), rows.end(), id);
+            if (it == rows.end() || *it != id) {
+                return QModelIndex();
+            }
+            row = int(it - rows.begin());
+        } else {
+            quint32 parent = ancestors.at(i + 1);
+            quint32 lo = 0;
+            quint32 hi = store->node(parent).childCount;
+            while (lo < hi) {
+                quint32 mid = lo + (hi - lo) / 2;
+                if (store->child(parent, mid) < id) {
+                    lo = mid + 1;
+                } else {
+                    hi = mid;
+                }
+            }
+            row = int(lo);
+        }
+        while (row >= rowCount(index) && canFetchMore(index)) {
+            fetchMore(index);
+        }
+        index = this->index(row, 0, index);
+    }
+    return index;
+}
+
+void ListingModel::setFiltering(bool filtering)
+{
+    beginResetModel();
+    QHash<int, ViewNode *>::iterator it = _root.children.begin();
+    for (; it != _root.children.end(); ++it) {
+        deleteChildren(it.value());
+        delete it.value();
+    }
+    _root.children.clear();
+    for (int i = 0; i < _listings.size(); ++i) {
+        Listing *listing = _listings.at(i);
+        listing->matches.clear();
+        listing->visible.clear();
+        listing->views.clear();
+        listing->marks.clear();
+    }
+    _filtering = filtering;
+    endResetModel();
+}
+
+QVector<quint32> ListingModel::filterMatches(const ListingStore *store) const
+{
+    int row = listingRow(store);
+    return row < 0 ? QVector<quint32>() : _listings.at(row)->matches;
+}
+
+void ListingModel::addMarks(const ListingStore *store, const QVector<quint32> &nodes, Mark mark)
+{
+    int row = listingRow(store);
+    if (!_filtering || row < 0 || nodes.isEmpty()) {
+        return;
+    }
+    Listing *listing = _listings.at(row);
+    for (int i = 0; i < nodes.size(); ++i) {
+        listing->marks.insert(nodes.at(i), quint8(mark));
+    }
+}
+
+void ListingModel::addFilterMatches(const ListingStore *store, const QVector<quint32> &nodes)
+{
+    int row = listingRow(store);
+    if (!_filtering || row < 0 || nodes.isEmpty()) {
+        return;
+    }
+    Listing *listing = _listings.at(row);
+    listing->matches += nodes;
+
+    // anything newly visible comes after what already is in document order,
+    // so it only ever adds rows at the end of its directory
+    QList<ViewNode *> grown;
+    QHash<ViewNode *, QVector<quint32> > added;
+    QVector<quint32> chain;
+    for (int i = 0; i < nodes.size(); ++i) {
+        chain.resize(0);
+        for (quint32 id = nodes.at(i); id != 0; id = store->node(id).parent) {
+            if (!listing->visible.isEmpty() && id <= listing->visible.last()) {
+                break;
+            }
+            chain.append(id);
+        }
+        for (int c = chain.size() - 1; c >= 0; --c) {
+            quint32 id = chain.at(c);
+            listing->visible.append(id);
+            ViewNode *view = listing->views.value(store->node(id).parent);
+            if (view) {
+                if (!added.contains(view)) {
+                    grown.append(view);
+                }
+                added[view].append(id);
+            }
+        }
+    }
+
+    for (int i = 0; i < grown.size(); ++i) {
+        ViewNode *view = grown.at(i);
+        const QVector<quint32> &children = added[view];
+        int shown = view->node == 0 ? view->filtered.size() : view->fetched;
+        int count = view->filtered.size() + children.size();
+        if (view->node != 0) {
+            count = qMin(count, qMax(view->fetched, int(FETCH_CHUNK)));
+        }
+        if (count > shown) {
+            beginInsertRows(viewIndex(view), shown, count - 1);
+            view->filtered += children;
+            if (view->node != 0) {
+                view->fetched = count;
+            }
+            endInsertRows();
+        } else {
+            view->filtered += children;
+        }
+    }
+}
+
+QVector<quint32> ListingModel::visibleChildren(const Listing *listing, quint32 node) const
+{
+    QVector<quint32> children;
+    const QVector<quint32> &visible = listing->visible;
+    quint32 end = node == 0 ? 0xffffffffU : listing->store->node(node).subtreeEnd;
+    QVector<quint32>::const_iterator it = std::lower_bound(visible.begin(), visible.end(), node + 1);
+    while (it != visible.end() && *it < end) {
+        children.append(*it);
+        // skip what is visible inside that child
+        it = std::lower_bound(it + 1, visible.end(), listing->store->node(*it).subtreeEnd);
+    }
+    return children;
+}
+
+QModelIndex ListingModel::viewIndex(const ViewNode *view) const
+{
+    return createIndex(view->row, 0, view->parent);
+}
+
+void ListingModel::deleteChildren(ViewNode *view)
+{
+    QHash<int, ViewNode *>::iterator it = view->children.begin();
+    for (; it != view->children.end(); ++it) {
+        deleteChildren(it.value());
+        if (it.value()->store == it.value()->listing->store) {
+            it.value()->listing->views.remove(it.value()->node);
+        }
+        delete it.value();
+    }
+    view->children.clear();
+}
+
+quint32 ListingModel::childNode(const ViewNode *parentView, int row) const
+{
+    if (_filtering) {
+        return parentView->filtered.at(row);
+    }
+    if (parentView->node == 0) {
+        return parentView->listing->topLevel.at(row);
+    }
+    return parentView->store->child(parentView->node, row);
+}
+
+bool ListingModel::entry(const QModelIndex &index, Listing **listing, const ListingStore **store,
+                         quint32 *node) const
+{
+    if (!index.isValid()) {
+        return false;
+    }
+    ViewNode *parentView = static_cast<ViewNode *>(index.internalPointer());
+    if (parentView == &_root) {
+        *listing = _listings.at(index.row());
+        *store = (*listing)->store;
+        *node = 0;
+    } else {
+        *listing = parentView->listing;
+        *store = parentView->store;
+        *node = childNode(parentView, index.row());
+    }
+    return true;
+}
+
+bool ListingModel::entryAt(const QModelIndex &index, const ListingStore **store, quint32 *node) const
+{
+    Listing *listing;
+    return entry(index, &listing, store, node);
+}
+
+ListingModel::ViewNode *ListingModel::viewNode(const QModelIndex &index) const
+{
+    if (!index.isValid()) {
+        return &_root;
+    }
+    ViewNode *parentView = static_cast<ViewNode *>(index.internalPointer());
+    ViewNode *&view = parentView->children[index.row()];
+    if (!view) {
+        view = new ViewNode;
+        entry(index, &view->listing, &view->store, &view->node);
+        if (!_filtering) {
+            view->store = view->store->resolve(view->node, &view->node);
+        }
+        view->parent = parentView;
+        view->row = index.row();
+        if (_filtering) {
+            view->filtered = visibleChildren(view->listing, view->node);
+        }
+        view->fetched = view->node != 0 ? qMin(available(view), int(FETCH_CHUNK)) : 0;
+        if (view->store == view->listing->store) {
+            view->listing->views.insert(view->node, view);
+        }
+    }
+    return view;
+}
+
+QModelIndex ListingModel::index(int row, int column, const QModelIndex &parent) const
+{
+    if (!hasIndex(row, column, parent)) {
+        return QModelIndex();
+    }
+    if (parent.isValid() && parent.column() != 0) {
+        return QModelIndex();
+    }
+    return createIndex(row, column, viewNode(parent));
+}
+
+QModelIndex ListingModel::parent(const QModelIndex &child) const
+{
+    if (!child.isValid()) {
+        return QModelIndex();
+    }
+    ViewNode *parentView = static_cast<ViewNode *>(child.internalPointer());
+    if (parentView == &_root) {
+        return QModelIndex();
+    }
+    return createIndex(parentView->row, 0, parentView->parent);
+}
+
+int ListingModel::rowCount(const QModelIndex &parent) const
+{
+    if (!parent.isValid()) {
+        return _listings.size();
+    }
+    if (parent.column() != 0) {
+        return 0;
+    }
+    ViewNode *view = viewNode(parent);
+    if (view->node == 0) {
+        return available(view);
+    }
+    return view->fetched;
+}
+
+int ListingModel::columnCount(const QModelIndex &) const
+{
+    return 2;
+}
+
+bool ListingModel::hasChildren(const QModelIndex &parent) const
+{
+    if (!parent.isValid()) {
+        return !_listings.isEmpty();
+    }
+    if (parent.column() != 0) {
+        return false;
+    }
+    // answers without creating a record, the view asks for every visible row
+    Listing *listing;
+    const ListingStore *store;
+    quint32 node;
+    entry(parent, &listing, &store, &node);
+    if (_filtering) {
+        const QVector<quint32> &visible = listing->visible;
+        QVector<quint32>::const_iterator it = std::lower_bound(visible.begin(), visible.end(), node + 1);
+        return it != visible.end() && (node == 0 || *it < listing->store->node(node).subtreeEnd);
+    }
+    if (node == 0) {
+        return !listing->topLevel.isEmpty();
+    }
+    const ListingNode &n = store->node(node);
+    return n.childCount > 0 || (n.flags & ListingNode::Linked);
+}
+
+/// Number of rows \a view has to show, fetched or not.
+int ListingModel::available(const ViewNode *view) const
+{
+    if (_filtering) {
+        return view->filtered.size();
+    }
+    if (view->node == 0) {
+        return view->listing->topLevel.size();
+    }
+    return int(view->store->node(view->node).childCount);
+}
+
+bool ListingModel::canFetchMore(const QModelIndex &parent) const
+{
+    if (!parent.isValid() || parent.column() != 0) {
+        return false;
+    }
+    ViewNode *view = viewNode(parent);
+    return view->node != 0 && available(view) > view->fetched;
+}
+
+void ListingModel::fetchMore(const QModelIndex &parent)
+{
+    if (!parent.isValid() || parent.column() != 0) {
+        return;
+    }
+    ViewNode *view = viewNode(parent);
+    int count = view->node != 0 ? qMin(available(view) - view->fetched, int(FETCH_CHUNK)) : 0;
+    if (count <= 0) {
+        return;
+    }
+    beginInsertRows(parent, view->fetched, view->fetched + count - 1);
+    view->fetched += count;
+    endInsertRows();
+}
+
+QString ListingModel::path(const ListingStore *store, quint32 node) const
+{
+    QPair<const ListingStore *, quint32> key(store, node);
+    if (QString *cached = _pathCache.object(key)) {
+        return *cached;
+    }
+    const ListingNode &n = store->node(node);
+    QString result;
+    QString *parentPath = n.parent != 0 ? _pathCache.object(qMakePair(store, n.parent)) : 0;
+    if (parentPath) {
+        result = *parentPath + QDir::separator() + store->name(node);
+    } else {
+        result = store->path(node, QDir::separator());
+    }
+    _pathCache.insert(key, new QString(result));
+    return result;
+}
+
+/// Path of \a node, a child of \a parentView, whichever listing holds it.
+/** Below a link, the path goes through the linked directory rather than
+ * the one of the listing the entries are shared with.
+ **/
+QString ListingModel::path(const ViewNode *parentView, quint32 node) const
+{
+    const ListingStore *store = parentView->store;
+    if (store == parentView->listing->store) {
+        return path(store, node);
+    }
+    // listings only link to earlier ones, the view where the store changes is the link
+    const ViewNode *link = parentView;
+    while (link->parent->store == store) {
+        link = link->parent;
+    }
+    QString result = path(link->parent, childNode(link->parent, link->row));
+    QVector<quint32> chain;
+    for (quint32 id = node; id != link->node; id = store->node(id).parent) {
+        chain.append(id);
+    }
+    for (int i = chain.size() - 1; i >= 0; --i) {
+        result += QDir::separator();
+        result += store->name(chain.at(i));
+    }
+    return result;
+}
+
+QVariant ListingModel::rootData(const Listing *listing, int column, int role) const
+{
+    switch (role) {
+    case Qt::DisplayRole:
+        if (column == 0) {
+            return QString("[%1] %2").arg(listing->store->sourcePath)
+                    .arg(listing->generatedDate != "" ? QString("Date=%1").arg(listing->generatedDate) : "");
+        }
+        return QString("[ %1 ]").arg(humanizeBigNums(listing->size, 2));
+    case Qt::DecorationRole:
+        if (column == 0) {
+            return _catalogIcon;
+        }
+        break;
+    case Qt::ForegroundRole:
+        return QBrush(column == 0 ? Qt::darkMagenta : getColorFromSize(listing->size));
+    case Qt::BackgroundRole:
+        if (column == 0) {
+            return QBrush(QColor(240, 240, 255));
+        }
+        break;
+    case SizeRole:
+        return qulonglong(listing->size);
+    case PathRole:
+    case Qt::ToolTipRole:
+        return QDir::toNativeSeparators(listing->store->sourcePath);
+    }
+    return QVariant();
+}
+
+QVariant ListingModel::data(const QModelIndex &index, int role) const
+{
+    Listing *listing;
+    const ListingStore *store;
+    quint32 id;
+    if (!entry(index, &listing, &store, &id)) {
+        return QVariant();
+    }
+    if (id == 0) {
+        return rootData(listing, index.column(), role);
+    }
+    const ViewNode *parentView = static_cast<const ViewNode *>(index.internalPointer());
+    const ListingNode &n = store->node(id);
+
+    switch (role) {
+    case Qt::DisplayRole:
+        if (index.column() == 0) {
+            return store->name(id);
+        }
+        if (n.type == ListingNode::Directory) {
+            return QString(">> %1").arg(humanizeBigNums(n.size, 2));
+        } else if (!(n.flags & ListingNode::NoSize)) {
+            return humanizeBigNums(n.size, 2);
+        }
+        break;
+    case Qt::DecorationRole:
+        if (index.column() == 0) {
+            return n.type == ListingNode::Directory ? _folderIcon : _fileIcon;
+        }
+        break;
+    case Qt::FontRole:
+        if (_filtering && index.column() == 0
+                && std::binary_search(listing->matches.begin(), listing->matches.end(), id)) {
+            return _matchFont;
+        }
+        break;
+    case Qt::ForegroundRole:
+        if (index.column() == 0) {
+            QHash<quint32, quint8>::const_iterator mark = listing->marks.constFind(id);
+            if (mark != listing->marks.constEnd()) {
+                return QBrush(markColor(mark.value()));
+            }
+            if (n.flags & ListingNode::Incomplete) {
+                return QBrush(Qt::blue);
+            }
+        } else if (n.type == ListingNode::Directory) {
+            return QBrush(getColorFromSize(n.size));
+        }
+        break;
+    case SizeRole:
+        if (!(n.flags & ListingNode::NoSize)) {
+            return qulonglong(n.size);
+        }
+        break;
+    case DateRole:
+        if (n.date) {
+            return qulonglong(n.date);
+        }
+        break;
+    case PathRole:
+        return path(parentView, id);
+    case TthRole:
+        if (const Tth *tth = store->tth(id)) {
+            return QString::fromLatin1(tth->toBase32());
+        }
+        break;
+    case Qt::ToolTipRole:
+        if (index.column() == 0) {
+            if (const Tth *tth = store->tth(id)) {
+                return path(parentView, id) + "\nTTH: " + QString::fromLatin1(tth->toBase32());
+            }
+            return path(parentView, id);
+        }
+        break;
+    }
+    return QVariant();
+}
+
+QVariant ListingModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (orientation == Qt::Horizontal && role == Qt::DisplayRole) {
+        return section == 0 ? tr("Folder") : tr("Size");
+    }
+    return QVariant();
+}
+
+Qt::ItemFlags ListingModel::flags(const QModelIndex &index) const
+{
+    if (!index.isValid()) {
+        return 0;
+    }
+    return Qt::ItemIsEnabled | Qt::ItemIsSelectable;
+}
@@ -0,0 +1,166 @@
+#ifndef LISTINGMODEL_H
+#define LISTINGMODEL_H
+
+#include <QAbstractItemModel>
+#include <QCache>
+#include <QFont>
+#include <QHash>
+#include <QIcon>
+#include <QList>
+#include <QPair>
+#include <QVector>
+
+namespace ShowListing{
+
+class ListingStore;
+class NamePool;
+class SearchIndex;
+class SubtreeIndex;
+
+/// Item model presenting every loaded ListingStore as a top-level row.
+/** Model indexes point to the record of their parent directory and use
+ * their row to find the node, so only directories the view actually
+ * descended into get a record. Directories with more than FETCH_CHUNK
+ * entries expose them a chunk at a time through canFetchMore()/fetchMore().
+ *
+ * In filter mode only the matches handed to addFilterMatches() and the
+ * directories leading to them are shown, matches in bold. Entries may also
+ * be marked, as a list comparison does, to color them until filter mode is
+ * left.
+ *
+ * Linked directories show the entries of the listing they share them with.
+ * Filter mode only follows the listing's own nodes, a linked directory
+ * holding matches is shown as one, see SearchIndex::entries().
+ **/
+class ListingModel : public QAbstractItemModel
+{
+    Q_OBJECT
+
+public:
+    enum Roles { SizeRole = Qt::UserRole, DateRole, PathRole, TthRole };
+    enum Mark { NoMark, AddedMark, RemovedMark, ChangedMark };
+    enum { FETCH_CHUNK = 16384 };
+
+    explicit ListingModel(QObject *parent = 0);
+    ~ListingModel();
+
+    void setIcons(const QIcon &catalog, const QIcon &folder, const QIcon &file);
+    /// Font of the entries matching the filter.
+    void setMatchFont(const QFont &font) { _matchFont = font; }
+
+    /// Name pool shared by every listing shown in this model.
+    NamePool *namePool() const { return _names; }
+    /// Search index over the same names, listings are added once loaded.
+    SearchIndex *searchIndex() const { return _search; }
+    /// Directories listings loaded from now on may share, see LoadPathWorker::setSubtreeIndex().
+    SubtreeIndex *subtreeIndex() const { return _subtrees; }
+
+    /// Appends a listing as a new, still empty, top-level row.
+    /** The model takes ownership. Its entries appear as publishSubtrees()
+     * hands them over, possibly while another thread is still filling it.
+     **/
+    QModelIndex addListing(ListingStore *store);
+    /// Shows finished top-level subtrees of \a store under its row.
+    void publishSubtrees(ListingStore *store, const QVector<quint32> &ids, quint64 totalSize);
+    /// Hides everything published so far for \a store, its reader started over.
+    void unpublishSubtrees(ListingStore *store);
+    /// Removes and deletes a listing.
+    /** Listings sharing its subtrees must be removed first.
+     **/
+    void removeListing(ListingStore *store);
+    int listingCount() const { return _listings.size(); }
+    ListingStore *listing(int row) const { return _listings.at(row)->store; }
+    /// Index of \a node in \a store, fetching the chunks leading to it.
+    /** Invalid if the listing is gone or the node is not published yet.
+     **/
+    QModelIndex indexOf(const ListingStore *store, quint32 node);
+    /// Listing and node shown at \a index, false for an invalid index.
+    /** Inside a linked directory, that is the listing the entries are shared
+     * with.
+     **/
+    bool entryAt(const QModelIndex &index, const ListingStore **store, quint32 *node) const;
+
+    /// Enters or leaves filter mode, resetting the model either way.
+    /** Filter mode starts without any match.
+     **/
+    void setFiltering(bool filtering);
+    bool isFiltering() const { return _filtering; }
+    /// Shows \a nodes of \a store, which come after every earlier match in document order.
+    void addFilterMatches(const ListingStore *store, const QVector<quint32> &nodes);
+    /// Matches of \a store shown since filter mode was entered.
+    QVector<quint32> filterMatches(const ListingStore *store) const;
+    /// Colors \a nodes of \a store as \a mark, while in filter mode.
+    /** Rows already shown are not refreshed, mark entries before adding them
+     * as matches.
+     **/
+    void addMarks(const ListingStore *store, const QVector<quint32> &nodes, Mark mark);
+
+    QModelIndex index(int row, int column, const QModelIndex &parent = QModelIndex()) const;
+    QModelIndex parent(const QModelIndex &child) const;
+    int rowCount(const QModelIndex &parent = QModelIndex()) const;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const;
+    bool hasChildren(const QModelIndex &parent = QModelIndex()) const;
+    bool canFetchMore(const QModelIndex &parent) const;
+    void fetchMore(const QModelIndex &parent);
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const;
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const;
+    Qt::ItemFlags flags(const QModelIndex &index) const;
+
+private:
+    struct ViewNode;
+
+    struct Listing
+    {
+        ListingStore *store;
+        QVector<quint32> topLevel;  // published children of the root
+        quint64 size;
+        QString generatedDate;
+        // filter mode, both in document order
+        QVector<quint32> matches;
+        QVector<quint32> visible;   // matches and their ancestors
+        QHash<quint32, ViewNode *> views;
+        QHash<quint32, quint8> marks;
+    };
+
+    struct ViewNode
+    {
+        Listing *listing;
+        const ListingStore *store;  // holding the children, another listing's below a link
+        quint32 node;
+        ViewNode *parent;
+        int row;
+        int fetched;                // rows shown so far, for directories
+        QVector<quint32> filtered;  // visible children in filter mode
+        QHash<int, ViewNode *> children;
+    };
+
+    int listingRow(const ListingStore *store) const;
+    quint32 childNode(const ViewNode *parentView, int row) const;
+    int available(const ViewNode *view) const;
+    QVector<quint32> visibleChildren(const Listing *listing, quint32 node) const;
+    QModelIndex viewIndex(const ViewNode *view) const;
+    bool entry(const QModelIndex &index, Listing **listing, const ListingStore **store, quint32 *node) const;
+    ViewNode *viewNode(const QModelIndex &index) const;
+    QVariant rootData(const Listing *listing, int column, int role) const;
+    QString path(const ListingStore *store, quint32 node) const;
+    QString path(const ViewNode *parentView, quint32 node) const;
+    static void deleteChildren(ViewNode *view);
+
+    NamePool *_names;
+    SearchIndex *_search;
+    SubtreeIndex *_subtrees;
+    QList<Listing *> _listings;
+    mutable ViewNode _root;
+    bool _filtering;
+    // paths looked at recently (tooltips, selection), most lookups hit a sibling's parent
+    mutable QCache<QPair<const ListingStore *, quint32>, QString> _pathCache;
+
+    QIcon _catalogIcon;
+    QIcon _folderIcon;
+    QIcon _fileIcon;
+    QFont _matchFont;
+};
+
+}
+
+#endif // LISTINGMODEL_H
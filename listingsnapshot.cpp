@@ -0,0 +1,292 @@
+#include <QByteArray>
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QVector>
+
+#include <string.h>
+
+#include "listingsnapshot.h"
+#include "listingstore.h"
+
+using ShowListing::ListingSnapshot;
+using ShowListing::ListingStore;
+using ShowListing::ListingNode;
+using ShowListing::NamePool;
+using ShowListing::Tth;
+
+namespace {
+
+const char MAGIC[8] = { 'S', 'L', 'S', 'N', 'A', 'P', '\r', '\n' };
+const quint32 BYTE_ORDER_MARK = 0x01020304;
+const int WRITE_BATCH = 1 << 16;
+
+/// Start of a snapshot file, followed by the sections it points to.
+/** Nodes come first and are 8-byte aligned, then the content hashes and
+ * the child table, the TTH column with one root per node, the names as
+ * 16-bit length and UTF-8 bytes, and the metadata serialized with
+ * QDataStream (source path, generator, base, generated date).
+ **/
+struct SnapshotHeader
+{
+    char magic[8];
+    quint32 version;
+    quint32 byteOrder;
+    quint32 nodeSize;
+    quint32 nodeCount;
+    quint32 childCount;
+    quint32 nameCount;
+    qint64 sourceSize;
+    qint64 sourceModified;      // ms since epoch
+    quint64 nodesOffset;
+    quint64 hashesOffset;
+    quint64 childrenOffset;
+    quint64 tthsOffset;
+    quint64 namesOffset;
+    quint64 namesSize;
+    quint64 metadataOffset;
+    quint64 metadataSize;
+};
+
+quint64 align8(quint64 offset)
+{
+    return (offset + 7) & ~quint64(7);
+}
+
+bool validHeader(const SnapshotHeader &h, qint64 fileSize, const QFileInfo &source)
+{
+    if (memcmp(h.magic, MAGIC, sizeof(MAGIC)) != 0 || h.version != ListingSnapshot::Version
+            || h.byteOrder != BYTE_ORDER_MARK || h.nodeSize != sizeof(ListingNode)) {
+        return false;
+    }
+    if (h.sourceSize != source.size() || h.sourceModified != source.lastModified().toMSecsSinceEpoch()) {
+        return false;
+    }
+    return h.nodeCount > 0 && h.nodesOffset >= sizeof(SnapshotHeader) && h.nodesOffset % 8 == 0
+            && h.hashesOffset == h.nodesOffset + quint64(h.nodeCount) * sizeof(ListingNode)
+            && h.hashesOffset % 8 == 0
+            && h.childrenOffset == h.hashesOffset + quint64(h.nodeCount) * sizeof(quint64)
+            && h.tthsOffset == h.childrenOffset + quint64(h.childCount) * sizeof(quint32)
+            && h.namesOffset == h.tthsOffset + quint64(h.nodeCount) * sizeof(Tth)
+            && h.metadataOffset == h.namesOffset + h.namesSize
+            && h.metadataOffset + h.metadataSize == quint64(fileSize);
+}
+
+}
+
+QString ListingSnapshot::cacheFile(const QString &sourcePath)
+{
+    QByteArray key = QCryptographicHash::hash(QFileInfo(sourcePath).absoluteFilePath().toUtf8(),
+                                              QCryptographicHash::Sha1).toHex();
+    return QStandardPaths::writableLocation(QStandardPaths::CacheLocation)
+            + "/snapshots/" + QString::fromLatin1(key) + ".snapshot";
+}
+
+bool ListingSnapshot::load(const QString &sourcePath, ListingStore *store)
+{
+    QFileInfo source(sourcePath);
+    QFile *file = new QFile(cacheFile(sourcePath));
+    if (!source.exists() || !file->open(QIODevice::ReadOnly) || file->size() < qint64(sizeof(SnapshotHeader))) {
+        delete file;
+        return false;
+    }
+    // read-only: nodes keep the snapshot's name ids, the store translates them
+    qint64 size = file->size();
+    char *base = reinterpret_cast<char *>(file->map(0, size));
+    const SnapshotHeader *h = reinterpret_cast<const SnapshotHeader *>(base);
+    if (!base || !validHeader(*h, size, source)) {
+        delete file;
+        return false;
+    }
+
+    QString path, generator, sourceBase, generatedDate;
+    QDataStream metadata(QByteArray::fromRawData(base + h->metadataOffset, int(h->metadataSize)));
+    metadata >> path >> generator >> sourceBase >> generatedDate;
+    if (metadata.status() != QDataStream::Ok || path != source.absoluteFilePath()) {
+        delete file;
+        return false;
+    }
+
+    QVector<quint32> poolIds(h->nameCount);
+    const char *p = base + h->namesOffset;
+    const char *namesEnd = p + h->namesSize;
+    for (quint32 i = 0; i < h->nameCount; ++i) {
+        quint16 len = 0;
+        if (namesEnd - p >= 2) {
+            memcpy(&len, p, 2);
+        }
+        if (namesEnd - p < 2 + len) {
+            delete file;
+            return false;
+        }
+        poolIds[i] = store->_names.intern(p + 2, len);
+        p += 2 + len;
+    }
+
+    ListingNode *nodes = reinterpret_cast<ListingNode *>(base + h->nodesOffset);
+    quint64 *hashes = reinterpret_cast<quint64 *>(base + h->hashesOffset);
+    quint32 *children = reinterpret_cast<quint32 *>(base + h->childrenOffset);
+    Tth *tths = reinterpret_cast<Tth *>(base + h->tthsOffset);
+    for (quint32 i = 0; i < h->childCount; ++i) {
+        if (children[i] >= h->nodeCount) {
+            delete file;
+            return false;
+        }
+    }
+    // parents come first and subtrees end after their node, so that walks
+    // over a corrupt file still end; listings with links are never saved,
+    // a Linked node means a foreign or corrupt file as well
+    for (quint32 i = 0; i < h->nodeCount; ++i) {
+        const ListingNode &n = nodes[i];
+        bool valid = n.name < h->nameCount && n.subtreeEnd > i && n.subtreeEnd <= h->nodeCount
+                && quint64(n.firstChild) + n.childCount <= h->childCount
+                && !(n.flags & ListingNode::Linked)
+                && (i == 0 ? n.type == ListingNode::Root && n.parent == 0 : n.parent < i);
+        for (quint32 row = 0; valid && row < n.childCount; ++row) {
+            quint32 child = children[n.firstChild + row];
+            valid = child > i && nodes[child].parent == i;
+        }
+        if (!valid) {
+            delete file;
+            return false;
+        }
+    }
+
+    store->_nodes.clear();
+    store->_nodes.adopt(nodes, h->nodeCount);
+    store->_children.adopt(children, h->childCount);
+    store->_tths.clear();
+    store->_tths.adopt(tths, h->nodeCount);
+    store->_hashes.clear();
+    store->_hashes.adopt(hashes, h->nodeCount);
+    store->_poolNames = poolIds;
+    store->_openDirs.clear();
+    store->_pendingChildren.clear();
+    store->_snapshot = file;
+    store->generator = generator;
+    store->base = sourceBase;
+    store->generatedDate = generatedDate;
+    return true;
+}
+
+bool ListingSnapshot::save(const QString &sourcePath, const ListingStore &store,
+                           qint64 sourceSize, qint64 sourceModified)
+{
+    // nodes below linked directories belong to other listings
+    if (store.linkCount() > 0) {
+        return false;
+    }
+    const NamePool *pool = store.names();
+
+    // names used by the listing, numbered in order of first use
+    QHash<quint32, quint32> localIds;
+    QVector<quint32> poolIds;
+    QVector<quint32> nodeNames(store.nodeCount());
+    quint64 namesSize = 0;
+    for (quint32 id = 0; id < store.nodeCount(); ++id) {
+        quint32 name = store.nameId(id);
+        QHash<quint32, quint32>::const_iterator it = localIds.constFind(name);
+        if (it == localIds.constEnd()) {
+            it = localIds.insert(name, poolIds.size());
+            poolIds.append(name);
+            namesSize += 2 + pool->length(name);
+        }
+        nodeNames[id] = it.value();
+    }
+
+    QByteArray metadata;
+    QDataStream stream(&metadata, QIODevice::WriteOnly);
+    stream << QFileInfo(sourcePath).absoluteFilePath() << store.generator << store.base << store.generatedDate;
+
+    SnapshotHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, MAGIC, sizeof(MAGIC));
+    h.version = Version;
+    h.byteOrder = BYTE_ORDER_MARK;
+    h.nodeSize = sizeof(ListingNode);
+    h.nodeCount = store.nodeCount();
+    h.childCount = store._children.size();
+    h.nameCount = poolIds.size();
+    h.sourceSize = sourceSize;
+    h.sourceModified = sourceModified;
+    h.nodesOffset = align8(sizeof(SnapshotHeader));
+    h.hashesOffset = h.nodesOffset + quint64(h.nodeCount) * sizeof(ListingNode);
+    h.childrenOffset = h.hashesOffset + quint64(h.nodeCount) * sizeof(quint64);
+    h.tthsOffset = h.childrenOffset + quint64(h.childCount) * sizeof(quint32);
+    h.namesOffset = h.tthsOffset + quint64(h.nodeCount) * sizeof(Tth);
+    h.namesSize = namesSize;
+    h.metadataOffset = h.namesOffset + h.namesSize;
+    h.metadataSize = metadata.size();
+
+    QString target = cacheFile(sourcePath);
+    if (!QDir().mkpath(QFileInfo(target).absolutePath())) {
+        return false;
+    }
+    QSaveFile file(target);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+    file.write(reinterpret_cast<const char *>(&h), sizeof(h));
+    file.write(QByteArray(int(h.nodesOffset - sizeof(h)), '\0'));
+
+    QVector<ListingNode> nodes;
+    nodes.reserve(WRITE_BATCH);
+    for (quint32 id = 0; id < h.nodeCount; ++id) {
+        nodes.append(store.node(id));
+        nodes.last().name = nodeNames.at(id);
+        if (nodes.size() == WRITE_BATCH || id + 1 == h.nodeCount) {
+            file.write(reinterpret_cast<const char *>(nodes.constData()), nodes.size() * sizeof(ListingNode));
+            nodes.resize(0);
+        }
+    }
+
+    QVector<quint64> hashes;
+    hashes.reserve(WRITE_BATCH);
+    for (quint32 id = 0; id < h.nodeCount; ++id) {
+        hashes.append(store.contentHash(id));
+        if (hashes.size() == WRITE_BATCH || id + 1 == h.nodeCount) {
+            file.write(reinterpret_cast<const char *>(hashes.constData()), hashes.size() * sizeof(quint64));
+            hashes.resize(0);
+        }
+    }
+
+    QVector<quint32> children;
+    children.reserve(WRITE_BATCH);
+    for (quint32 i = 0; i < h.childCount; ++i) {
+        children.append(store._children.at(i));
+        if (children.size() == WRITE_BATCH || i + 1 == h.childCount) {
+            file.write(reinterpret_cast<const char *>(children.constData()), children.size() * sizeof(quint32));
+            children.resize(0);
+        }
+    }
+
+    QVector<Tth> tths;
+    tths.reserve(WRITE_BATCH);
+    for (quint32 id = 0; id < h.nodeCount; ++id) {
+        tths.append(store._tths.at(id));
+        if (tths.size() == WRITE_BATCH || id + 1 == h.nodeCount) {
+            file.write(reinterpret_cast<const char *>(tths.constData()), tths.size() * sizeof(Tth));
+            tths.resize(0);
+        }
+    }
+
+    QByteArray names;
+    for (int i = 0; i < poolIds.size(); ++i) {
+        quint16 len = quint16(pool->length(poolIds.at(i)));
+        names.append(reinterpret_cast<const char *>(&len), 2);
+        names.append(pool->data(poolIds.at(i)), len);
+        if (names.size() >= WRITE_BATCH * 16 || i + 1 == poolIds.size()) {
+            file.write(names);
+            names.resize(0);
+        }
+    }
+
+    file.write(metadata);
+    return file.commit();
+}
@@ -0,0 +1,52 @@
+#ifndef LISTINGSNAPSHOT_H
+#define LISTINGSNAPSHOT_H
+
+#include <QString>
+
+namespace ShowListing{
+
+class ListingStore;
+
+/// Binary image of a parsed listing, reopened without parsing it again.
+/** A snapshot holds the node table with its directory sizes and content
+ * hashes, the child table, the TTH roots, the names used by the listing and
+ * its metadata. It is stored in the cache directory under a name derived
+ * from the source path, and is only used while the source keeps the size
+ * and modification time it had when the snapshot was written.
+ *
+ * Node, hash, child and TTH tables are laid out exactly as ListingStore
+ * keeps them in memory, so loading maps the file read-only and uses them
+ * in place. Only the names are interned into the store's NamePool; nodes
+ * keep the snapshot's name numbering, which the store translates through
+ * a table of one pool id per name. Snapshots are specific to the byte
+ * order and node layout of the build that wrote them, any mismatch makes
+ * them stale.
+ **/
+class ListingSnapshot
+{
+public:
+    enum { Version = 3 };
+
+    /// Where the snapshot of \a sourcePath is stored.
+    static QString cacheFile(const QString &sourcePath);
+
+    /// Fills \a store, which must be freshly constructed, from the snapshot of \a sourcePath.
+    /** Returns \c false when there is no usable snapshot, \a store is then
+     * left untouched.
+     **/
+    static bool load(const QString &sourcePath, ListingStore *store);
+    /// Writes a snapshot of the finished \a store read from \a sourcePath.
+    /** \a sourceSize and \a sourceModified (ms since epoch) must be taken
+     * before the source was opened, a list rewritten while it was parsed
+     * then leaves a stale snapshot instead of one passing for the new file.
+     * Listings linking to subtrees of other listings are not written: their
+     * nodes below a link live in another store. Conversely a loaded
+     * snapshot is never linked, so lists sharing subtrees are parsed.
+     **/
+    static bool save(const QString &sourcePath, const ListingStore &store,
+                     qint64 sourceSize, qint64 sourceModified);
+};
+
+}
+
+#endif // LISTINGSNAPSHOT_H
@@ -0,0 +1,213 @@
+#include <QHash>
+
+#include <algorithm>
+
+#include "listingstatistics.h"
+#include "listingstore.h"
+#include "parallelwork.h"
+
+using ShowListing::ListingNode;
+using ShowListing::ListingStatistics;
+using ShowListing::ListingStore;
+using ShowListing::NamePool;
+using ShowListing::NodeRange;
+using ShowListing::ParallelWork;
+
+namespace {
+
+const int MAX_EXTENSION_LENGTH = 8;
+
+struct Counts
+{
+    quint64 files;
+    quint64 bytes;
+};
+
+/// What one range of the node table adds up to.
+struct Partial
+{
+    quint64 files;
+    quint64 directories;
+    quint64 bytes;
+    QVector<quint64> bucketFiles;
+    QVector<quint64> bucketBytes;
+    QHash<quint64, Counts> extensions;
+    QVector<quint64> depthEntries;
+};
+
+inline int bucket(quint64 size)
+{
+    int b = 0;
+    for (int shift = 32; shift > 0; shift >>= 1) {
+        if (size >> shift) {
+            size >>= shift;
+            b += shift;
+        }
+    }
+    return size ? b + 1 : 0;
+}
+
+/// Extension of a name packed in a word, lowercase, 0 for none.
+inline quint64 extensionKey(const char *name, int len)
+{
+    const char *dot = 0;
+    for (int i = len - 1; i > 0 && i >= len - 1 - MAX_EXTENSION_LENGTH; --i) {
+        if (name[i] == '.') {
+            dot = name + i;
+            break;
+        }
+    }
+    if (!dot) {
+        return 0;
+    }
+    quint64 key = 0;
+    const uchar *p = reinterpret_cast<const uchar *>(dot + 1);
+    int n = int(name + len - (dot + 1));
+    for (int i = 0; i < n; ++i) {
+        uchar c = p[i] >= 'A' && p[i] <= 'Z' ? p[i] + ('a' - 'A') : p[i];
+        key |= quint64(c) << (8 * i);
+    }
+    return key;
+}
+
+QString extensionName(quint64 key)
+{
+    char bytes[MAX_EXTENSION_LENGTH];
+    int n = 0;
+    for (; n < MAX_EXTENSION_LENGTH && (key >> (8 * n)) & 0xff; ++n) {
+        bytes[n] = char((key >> (8 * n)) & 0xff);
+    }
+    return QString::fromUtf8(bytes, n);
+}
+
+bool moreBytes(const ListingStatistics::Extension &a, const ListingStatistics::Extension &b)
+{
+    return a.bytes != b.bytes ? a.bytes > b.bytes : a.files > b.files;
+}
+
+/// Counts nodes [begin, end) of \a store, those of linked directories too.
+/** \a open holds the ends of the directories the range starts in,
+ * outermost first, below \a depth levels outside \a store.
+ **/
+void scanNodes(const ListingStore &store, quint32 begin, quint32 end, QVector<quint32> open, int depth,
+               Partial *partial)
+{
+    const NamePool *names = store.names();
+    for (quint32 id = begin; id < end; ++id) {
+        while (!open.isEmpty() && id >= open.last()) {
+            open.removeLast();
+        }
+        int level = depth + open.size() + 1;
+        if (level >= partial->depthEntries.size()) {
+            partial->depthEntries.resize(level + 1);
+        }
+        ++partial->depthEntries[level];
+
+        const ListingNode &n = store.node(id);
+        if (n.type == ListingNode::Directory) {
+            ++partial->directories;
+            open.append(n.subtreeEnd);
+            quint32 target;
+            const ListingStore *shared = store.resolve(id, &target);
+            if (shared != &store) {
+                scanNodes(*shared, target + 1, shared->node(target).subtreeEnd, QVector<quint32>(), level, partial);
+            }
+            continue;
+        }
+        ++partial->files;
+        quint32 name = store.nameId(id);
+        quint64 key = extensionKey(names->data(name), names->length(name));
+        Counts &counts = partial->extensions[key];
+        ++counts.files;
+        if (!(n.flags & ListingNode::NoSize)) {
+            int b = bucket(n.size);
+            ++partial->bucketFiles[b];
+            partial->bucketBytes[b] += n.size;
+            partial->bytes += n.size;
+            counts.bytes += n.size;
+        }
+    }
+}
+
+void scanRange(const ListingStore &store, quint32 root, const NodeRange &range, Partial *partial)
+{
+    partial->files = partial->directories = partial->bytes = 0;
+    partial->bucketFiles.fill(0, ListingStatistics::BucketCount);
+    partial->bucketBytes.fill(0, ListingStatistics::BucketCount);
+
+    QVector<quint32> open;
+    for (quint32 id = store.node(range.begin).parent; id != root; id = store.node(id).parent) {
+        open.prepend(store.node(id).subtreeEnd);
+    }
+    scanNodes(store, range.begin, range.end, open, 0, partial);
+}
+
+/// Adds up one partial per range.
+class RangeScan : public ParallelWork
+{
+public:
+    RangeScan(const ListingStore &store, quint32 root) : store(store), root(root) {}
+
+    void process(int i)
+    {
+        scanRange(store, root, ranges.at(i), &partials[i]);
+    }
+
+    const ListingStore &store;
+    quint32 root;
+    QVector<NodeRange> ranges;
+    QVector<Partial> partials;
+};
+
+}
+
+ListingStatistics::ListingStatistics(const ListingStore &store, quint32 node, int threads)
+    : _files(0), _directories(0), _bytes(0)
+{
+    _bucketFiles.fill(0, BucketCount);
+    _bucketBytes.fill(0, BucketCount);
+
+    // below the root, only top-level subtrees are reachable after a restart
+    RangeScan scan(store, node);
+    quint64 nodes;
+    if (node == 0) {
+        nodes = ParallelWork::addTopLevelRanges(store, &scan.ranges);
+    } else {
+        nodes = store.node(node).subtreeEnd - (node + 1);
+        ParallelWork::addRanges(node + 1, store.node(node).subtreeEnd, &scan.ranges);
+    }
+    scan.partials.resize(scan.ranges.size());
+    scan.run(scan.ranges.size(), ParallelWork::threadCount(threads, nodes));
+
+    const QVector<Partial> &partials = scan.partials;
+    QHash<quint64, Counts> extensions;
+    for (int i = 0; i < partials.size(); ++i) {
+        const Partial &partial = partials.at(i);
+        _files += partial.files;
+        _directories += partial.directories;
+        _bytes += partial.bytes;
+        for (int b = 0; b < BucketCount; ++b) {
+            _bucketFiles[b] += partial.bucketFiles.at(b);
+            _bucketBytes[b] += partial.bucketBytes.at(b);
+        }
+        if (partial.depthEntries.size() > _depthEntries.size()) {
+            _depthEntries.resize(partial.depthEntries.size());
+        }
+        for (int d = 0; d < partial.depthEntries.size(); ++d) {
+            _depthEntries[d] += partial.depthEntries.at(d);
+        }
+        QHash<quint64, Counts>::const_iterator it = partial.extensions.constBegin();
+        for (; it != partial.extensions.constEnd(); ++it) {
+            Counts &counts = extensions[it.key()];
+            counts.files += it->files;
+            counts.bytes += it->bytes;
+        }
+    }
+
+    QHash<quint64, Counts>::const_iterator it = extensions.constBegin();
+    for (; it != extensions.constEnd(); ++it) {
+        Extension extension = { extensionName(it.key()), it->files, it->bytes };
+        _extensions.append(extension);
+    }
+    std::sort(_extensions.begin(), _extensions.end(), moreBytes);
+}
@@ -0,0 +1,66 @@
+#ifndef LISTINGSTATISTICS_H
+#define LISTINGSTATISTICS_H
+
+#include <QString>
+#include <QVector>
+
+namespace ShowListing{
+
+class ListingStore;
+
+/// Size histogram, extension breakdown and depth profile of a subtree.
+/** Computed in one pass over the node table, cut into ranges scanned in
+ * parallel for big subtrees, the same way as LargestEntries. The entries
+ * below a linked directory are counted from the listing sharing them.
+ **/
+class ListingStatistics
+{
+public:
+    enum { BucketCount = 65 };
+
+    struct Extension
+    {
+        QString name;       // lowercase, empty for names without one
+        quint64 files;
+        quint64 bytes;
+    };
+
+    /// Statistics of the entries below \a node, the whole listing for the root.
+    /** \a store must be finished. With 0 threads, the ideal thread count is
+     * used for big subtrees and a single thread otherwise.
+     **/
+    ListingStatistics(const ListingStore &store, quint32 node = 0, int threads = 0);
+
+    quint64 files() const { return _files; }
+    quint64 directories() const { return _directories; }
+    quint64 bytes() const { return _bytes; }
+
+    /// Files and their bytes by size: bucket 0 holds empty files, bucket k sizes in [2^(k-1), 2^k).
+    /** Files without a size are not counted.
+     **/
+    const QVector<quint64> &bucketFiles() const { return _bucketFiles; }
+    const QVector<quint64> &bucketBytes() const { return _bucketBytes; }
+    /// Lower bound of the sizes in \a bucket.
+    static quint64 bucketStart(int bucket) { return bucket == 0 ? 0 : Q_UINT64_C(1) << (bucket - 1); }
+
+    /// Per file extension, most bytes first.
+    /** Only the part after the last dot counts, up to 8 bytes long; longer
+     * ones are seldom real extensions and are counted as none.
+     **/
+    const QVector<Extension> &extensions() const { return _extensions; }
+    /// Entries at each depth: index 1 holds the children of the node.
+    const QVector<quint64> &depthEntries() const { return _depthEntries; }
+
+private:
+    quint64 _files;
+    quint64 _directories;
+    quint64 _bytes;
+    QVector<quint64> _bucketFiles;
+    QVector<quint64> _bucketBytes;
+    QVector<Extension> _extensions;
+    QVector<quint64> _depthEntries;
+};
+
+}
+
+#endif // LISTINGSTATISTICS_H
@@ -0,0 +1,271 @@
+#include <QFile>
+
+#include <string.h>
+
+#include "listingstore.h"
+#include "subtreeindex.h"
+
+using ShowListing::ListingStore;
+using ShowListing::ListingNode;
+using ShowListing::Tth;
+
+namespace {
+
+inline quint64 mix(quint64 h)
+{
+    h ^= h >> 33;
+    h *= Q_UINT64_C(0xff51afd7ed558ccd);
+    h ^= h >> 33;
+    h *= Q_UINT64_C(0xc4ceb9fe1a85ec53);
+    h ^= h >> 33;
+    return h;
+}
+
+quint64 fileHash(quint64 size, bool hasSize, const Tth *tth)
+{
+    quint64 h = mix(hasSize ? size : ~Q_UINT64_C(0));
+    if (tth) {
+        quint64 words[Tth::Size / 8];
+        memcpy(words, tth->bytes, sizeof(words));
+        for (int i = 0; i < Tth::Size / 8; ++i) {
+            h = mix(h ^ words[i]);
+        }
+    }
+    return h;
+}
+
+/// What a child adds to the hash of its directory: its content under its name.
+inline quint64 entryHash(quint64 content, quint32 nameHash, quint8 type)
+{
+    return mix(content ^ ((quint64(nameHash) << 8 | type) * Q_UINT64_C(0x9e3779b97f4a7c15)));
+}
+
+}
+
+ListingStore::ListingStore(NamePool *names)
+    : _names(names), _snapshot(0), _subtrees(0)
+{
+    appendNode(ListingNode::Root, "", 0);
+    _openDirs.append(0);
+    _openMarks.resize(1);
+    _pendingChildren.resize(1);
+}
+
+ListingStore::~ListingStore()
+{
+    _nodes.clear();
+    _children.clear();
+    _tths.clear();
+    _hashes.clear();
+    _links.clear();
+    delete _snapshot;
+}
+
+quint32 ListingStore::appendNode(ListingNode::Type type, const char *utf8Name, int len)
+{
+    quint32 id = _nodes.append();
+    _tths.append();
+    _hashes.append();
+    ListingNode &n = _nodes[id];
+    n.size = 0;
+    n.name = _names.intern(utf8Name, len);
+    n.parent = _openDirs.isEmpty() ? 0 : _openDirs.last();
+    n.firstChild = 0;
+    n.childCount = 0;
+    n.subtreeEnd = id + 1;
+    n.date = 0;
+    n.type = quint8(type);
+    n.flags = 0;
+    if (!_openDirs.isEmpty()) {
+        _pendingChildren[_openDirs.size() - 1].append(id);
+    }
+    return id;
+}
+
+QString ListingStore::path(quint32 id, QChar separator) const
+{
+    QVector<quint32> chain;
+    int length = 0;
+    for (quint32 n = id; n != 0; n = _nodes.at(n).parent) {
+        chain.append(n);
+        length += 1 + names()->length(nameId(n));
+    }
+
+    QString result;
+    result.reserve(length);
+    for (int i = chain.size() - 1; i >= 0; --i) {
+        result += separator;
+        result += name(chain.at(i));
+    }
+    return result;
+}
+
+quint32 ListingStore::openDirectory(const char *utf8Name, int len, quint32 date, bool incomplete)
+{
+    quint32 id = appendNode(ListingNode::Directory, utf8Name, len);
+    ListingNode &n = _nodes[id];
+    n.date = date;
+    if (incomplete) {
+        n.flags |= ListingNode::Incomplete;
+    }
+    _openDirs.append(id);
+    OpenMark mark = { _children.size(), _links.size() };
+    _openMarks.append(mark);
+    if (_pendingChildren.size() < _openDirs.size()) {
+        _pendingChildren.resize(_openDirs.size());
+    }
+    _pendingChildren[_openDirs.size() - 1].resize(0);
+    return id;
+}
+
+quint32 ListingStore::addFile(const char *utf8Name, int len, quint64 size, bool hasSize, const Tth *tth)
+{
+    quint32 id = appendNode(ListingNode::File, utf8Name, len);
+    ListingNode &n = _nodes[id];
+    if (hasSize) {
+        n.size = size;
+        _nodes[n.parent].size += size;
+    } else {
+        n.flags |= ListingNode::NoSize;
+    }
+    if (tth) {
+        _tths[id] = *tth;
+        n.flags |= ListingNode::HasTth;
+    }
+    _hashes[id] = fileHash(size, hasSize, tth);
+    return id;
+}
+
+void ListingStore::closeDirectory()
+{
+    Q_ASSERT_X(!_openDirs.isEmpty(), "closeDirectory()", "no open directory");
+    quint32 id = _openDirs.last();
+    const QVector<quint32> &pending = _pendingChildren[_openDirs.size() - 1];
+
+    ListingNode &n = _nodes[id];
+    n.firstChild = _children.size();
+    n.childCount = pending.size();
+    n.subtreeEnd = _nodes.size();
+    // a sum, so that reordered entries keep the hash
+    quint64 hash = quint64(pending.size()) * Q_UINT64_C(0x2545f4914f6cdd1d) + (n.flags & ListingNode::Incomplete);
+    for (int i = 0; i < pending.size(); ++i) {
+        _children.append(pending.at(i));
+        const ListingNode &child = _nodes.at(pending.at(i));
+        hash += entryHash(_hashes.at(pending.at(i)), names()->nameHash(nameId(pending.at(i))), child.type);
+    }
+    _hashes[id] = mix(hash);
+    if (id != 0 && _subtrees) {
+        linkDirectory(id, _openMarks.last());
+    }
+    _openDirs.removeLast();
+    _openMarks.removeLast();
+    if (id != 0) {
+        _nodes[n.parent].size += n.size;
+    }
+}
+
+/// Replaces what was read below the closed directory \a id by a link to the same content elsewhere.
+/** \a mark is where the child table and links stood when \a id was opened.
+ **/
+void ListingStore::linkDirectory(quint32 id, const OpenMark &mark)
+{
+    ListingNode &n = _nodes[id];
+    if (n.subtreeEnd - id < quint32(SubtreeIndex::MinNodes)) {
+        return;
+    }
+    quint32 target;
+    const ListingStore *store = _subtrees->find(_hashes.at(id), n.size, n.childCount, &target);
+    if (!store) {
+        return;
+    }
+    // nothing below a directory still open has been handed out, the nodes
+    // read there are simply written over by what comes next
+    _nodes.truncate(id + 1);
+    _tths.truncate(id + 1);
+    _hashes.truncate(id + 1);
+    _children.truncate(mark.children);
+    _links.truncate(mark.links);
+    Link link = { store, target };
+    n.firstChild = _links.append(link);
+    n.childCount = 0;
+    n.subtreeEnd = id + 1;
+    n.flags |= ListingNode::Linked;
+}
+
+void ListingStore::appendSubtrees(const ListingStore &part)
+{
+    Q_ASSERT_X(part._openDirs.isEmpty(), "appendSubtrees()", "part is not finished");
+    Q_ASSERT_X(part.names() == names(), "appendSubtrees()", "part uses another name pool");
+    quint32 parent = _openDirs.last();
+    quint32 nodeOffset = _nodes.size() - 1;    // node 1 of part lands at _nodes.size()
+    quint32 childOffset = _children.size();
+    quint32 linkOffset = _links.size();
+
+    for (quint32 id = 1; id < part._nodes.size(); ++id) {
+        ListingNode n = part._nodes.at(id);
+        n.parent = n.parent == 0 ? parent : n.parent + nodeOffset;
+        n.firstChild += n.flags & ListingNode::Linked ? linkOffset : childOffset;
+        n.subtreeEnd += nodeOffset;
+        _nodes.append(n);
+        _tths.append(part._tths.at(id));
+        _hashes.append(part._hashes.at(id));
+    }
+    for (quint32 i = 0; i < part._links.size(); ++i) {
+        _links.append(part._links.at(i));
+    }
+    // the root of part is closed last, its own entries end the child table
+    const ListingNode &partRoot = part._nodes.at(0);
+    quint32 ownChildren = part._children.size() - partRoot.childCount;
+    for (quint32 i = 0; i < ownChildren; ++i) {
+        _children.append(part._children.at(i) + nodeOffset);
+    }
+    QVector<quint32> &pending = _pendingChildren[_openDirs.size() - 1];
+    for (quint32 row = 0; row < partRoot.childCount; ++row) {
+        pending.append(part.child(0, row) + nodeOffset);
+    }
+    _nodes[parent].size += partRoot.size;
+}
+
+void ListingStore::finish()
+{
+    while (!_openDirs.isEmpty()) {
+        closeDirectory();
+    }
+    _pendingChildren.clear();
+}
+
+void ListingStore::restart()
+{
+    ListingNode &root = _nodes[0];
+    root.size = 0;
+    root.firstChild = 0;
+    root.childCount = 0;
+    _openDirs.resize(0);
+    _openDirs.append(0);
+    _openMarks.resize(1);
+    _pendingChildren.resize(1);
+    _pendingChildren[0].resize(0);
+}
+
+QVector<quint32> ListingStore::finishedTopLevel(int from) const
+{
+    QVector<quint32> ids;
+    if (_openDirs.isEmpty()) {
+        for (quint32 i = from; i < _nodes.at(0).childCount; ++i) {
+            ids.append(child(0, i));
+        }
+    } else {
+        // the last pending entry is still being filled while a directory is open
+        int end = _pendingChildren.at(0).size() - (_openDirs.size() > 1 ? 1 : 0);
+        for (int i = from; i < end; ++i) {
+            ids.append(_pendingChildren.at(0).at(i));
+        }
+    }
+    return ids;
+}
+
+qint64 ListingStore::memoryUsage() const
+{
+    return _nodes.capacityBytes() + _children.capacityBytes() + _tths.capacityBytes()
+            + _hashes.capacityBytes() + _links.capacityBytes();
+}
@@ -0,0 +1,182 @@
+#ifndef LISTINGSTORE_H
+#define LISTINGSTORE_H
+
+#include <QString>
+#include <QVector>
+
+#include "chunkedarray.h"
+#include "namepool.h"
+#include "tth.h"
+
+QT_BEGIN_NAMESPACE
+class QFile;
+QT_END_NAMESPACE
+
+namespace ShowListing{
+
+class SubtreeIndex;
+
+/// One Directory or File element of a FileListing.
+/** Nodes are numbered in document order, so the descendants of node n are
+ * exactly the nodes [n + 1, subtreeEnd). Children of a directory are listed
+ * contiguously in the store's child table starting at firstChild.
+ *
+ * A Linked directory has no nodes of its own below it: its entries are
+ * those of a directory with the same content in another listing, and
+ * firstChild is the index of that link.
+ **/
+struct ListingNode
+{
+    enum Type { Root = 0, Directory = 1, File = 2 };
+    enum Flag { Incomplete = 0x01, NoSize = 0x02, HasTth = 0x04, Linked = 0x08 };
+
+    quint64 size;           // file size, or cumulated size for directories
+    quint32 name;           // see ListingStore::nameId()
+    quint32 parent;
+    quint32 firstChild;
+    quint32 childCount;
+    quint32 subtreeEnd;
+    quint32 date;
+    quint8 type;
+    quint8 flags;
+};
+
+/// Compact in-memory representation of a parsed FileListing.
+/** Node 0 is the listing root. The tree is built in document order through
+ * openDirectory()/addFile()/closeDirectory() and sealed by finish().
+ * Names are interned in a NamePool which must outlive the store. TTH roots
+ * and content hashes live in columns of their own indexed like the nodes,
+ * so that walks over the node table do not drag them through the cache.
+ **/
+class ListingStore
+{
+public:
+    explicit ListingStore(NamePool *names);
+    ~ListingStore();
+
+    const ListingNode &node(quint32 id) const { return _nodes.at(id); }
+    quint32 nodeCount() const { return _nodes.size(); }
+    quint32 child(quint32 id, quint32 row) const { return _children.at(_nodes.at(id).firstChild + row); }
+    /// TTH root of a file, null when the listing gave none.
+    const Tth *tth(quint32 id) const { return _nodes.at(id).flags & ListingNode::HasTth ? &_tths.at(id) : 0; }
+    /// Merkle hash of the size and TTH of a file, or of everything below a directory.
+    /** The name and date of the node itself are left out, so identical
+     * subtrees hash the same in any listing whatever they are called; the
+     * names of the entries below do count, the order they come in does not.
+     * A directory gets its hash when it is closed.
+     **/
+    quint64 contentHash(quint32 id) const { return _hashes.at(id); }
+    /// Listing and node holding the entries of directory \a id, this store and \a id unless it is Linked.
+    const ListingStore *resolve(quint32 id, quint32 *node) const
+    {
+        if (!(_nodes.at(id).flags & ListingNode::Linked)) {
+            *node = id;
+            return this;
+        }
+        const Link &link = _links.at(_nodes.at(id).firstChild);
+        *node = link.node;
+        return link.store;
+    }
+    /// Links made to directories of other listings, 0 when every entry is the listing's own.
+    quint32 linkCount() const { return _links.size(); }
+    /// Listing link \a i points into, \a i below linkCount().
+    const ListingStore *linkedStore(quint32 i) const { return _links.at(i).store; }
+
+    NamePool *names() const { return _names.pool(); }
+    /// Id in the shared NamePool of the name of node \a id.
+    /** Nodes mapped from a ListingSnapshot keep the snapshot's own name
+     * numbering, translated here rather than rewritten on load.
+     **/
+    quint32 nameId(quint32 id) const
+    {
+        quint32 name = _nodes.at(id).name;
+        return _poolNames.isEmpty() ? name : _poolNames.at(name);
+    }
+    QString name(quint32 id) const { return names()->string(nameId(id)); }
+    /// Path of a node inside the share, rebuilt by walking parent links.
+    /** Top-level entries start with \a separator, the root has an empty path.
+     **/
+    QString path(quint32 id, QChar separator) const;
+
+    /// Directories matching one of \a index are linked to it when closed, none by default.
+    /** The nodes read below such a directory are dropped again. Set it
+     * before reading, the listings of \a index must outlive this one.
+     **/
+    void setSubtreeIndex(const SubtreeIndex *index) { _subtrees = index; }
+    const SubtreeIndex *subtreeIndex() const { return _subtrees; }
+
+    quint32 openDirectory(const char *utf8Name, int len, quint32 date, bool incomplete);
+    quint32 addFile(const char *utf8Name, int len, quint64 size, bool hasSize, const Tth *tth = 0);
+    void closeDirectory();
+    /// Moves copies of the top-level entries of \a part under the open directory.
+    /** \a part must be finished and share this store's NamePool. Ids are
+     * shifted, document order is preserved as if its entries had been read
+     * here.
+     **/
+    void appendSubtrees(const ListingStore &part);
+    void finish();
+    /// Forgets the tree built so far and starts over from an empty root.
+    /** Nodes already created are left in place, unreachable, so that other
+     * threads still holding ids of published subtrees keep reading valid
+     * memory.
+     **/
+    void restart();
+
+    /// Number of directories opened but not yet closed, not counting the root.
+    int depth() const { return _openDirs.size() - 1; }
+    /// Completed top-level entries, from the \a from-th one on.
+    /** Only meaningful on the thread building the store. Every returned
+     * subtree is final and may be handed to other threads.
+     **/
+    QVector<quint32> finishedTopLevel(int from) const;
+
+    /// Whether nodes and child table are mapped from a ListingSnapshot.
+    bool isSnapshot() const { return _snapshot != 0; }
+    /// Approximate heap usage of nodes, child table and columns, the shared names excluded.
+    qint64 memoryUsage() const;
+
+    QString sourcePath;
+    QString generator;
+    QString base;
+    QString generatedDate;
+
+private:
+    ListingStore(const ListingStore &);
+    ListingStore &operator=(const ListingStore &);
+    friend class ListingSnapshot;
+
+    struct Link
+    {
+        const ListingStore *store;
+        quint32 node;
+    };
+
+    /// Sizes of the child table and links when a directory was opened.
+    struct OpenMark
+    {
+        quint32 children;
+        quint32 links;
+    };
+
+    quint32 appendNode(ListingNode::Type type, const char *utf8Name, int len);
+    void linkDirectory(quint32 id, const OpenMark &mark);
+
+    ChunkedArray<ListingNode> _nodes;
+    ChunkedArray<quint32> _children;
+    ChunkedArray<Tth> _tths;
+    ChunkedArray<quint64> _hashes;
+    ChunkedArray<Link, 10> _links;
+    NameCache _names;
+    QFile *_snapshot;   // mapping nodes, children and columns live in, if any
+    QVector<quint32> _poolNames;    // snapshot name -> pool id, empty when nodes hold pool ids
+    const SubtreeIndex *_subtrees;
+
+    // children collected so far for every open directory, root first
+    QVector<quint32> _openDirs;
+    QVector<OpenMark> _openMarks;
+    QVector<QVector<quint32> > _pendingChildren;
+};
+
+}
+
+#endif // LISTINGSTORE_H
@@ -1,48 +1,151 @@
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+
 #include "loadpathworker.h"
 
-#include "adclistreader.h"
+#include "listingsnapshot.h"
+#include "listingstore.h"
+#include "qualz4file.h"
+#include "searchindex.h"
+#include "subtreeindex.h"
 
-LoadPathWorker::LoadPathWorker(QIODevice *inputIo,
-                               ShowListing::DirFileTree *treewidget,
-                               qint64 *pWrittenTracker,
-                               QReadWriteLock *lock,
-                               QTreeWidgetItem **ppInsertedItem)
-    : runningReader(0)
+LoadPathWorker::LoadPathWorker(const QString &fileName,
+                               ShowListing::ListingStore *store)
+    : searchIndex(0), subtreeIndex(0), progressDone(0), progressTotal(0)
 {
-    io = inputIo;
-    tree = treewidget;
-    pWritten = pWrittenTracker;
-    this->lock = lock;
-    this->ppInsertedItem = ppInsertedItem;
+    this->fileName = fileName;
+    this->store = store;
+    setAutoDelete(false);
+
+    // batches are relayed from the parsing thread to ours
+    QObject::connect(&reader, SIGNAL(subtreesReady(QVector<quint32>,quint64)),
+                     this, SIGNAL(signalSubtreesReady(QVector<quint32>,quint64)), Qt::QueuedConnection);
+    QObject::connect(&reader, SIGNAL(restarted()),
+                     this, SIGNAL(signalRestarted()), Qt::QueuedConnection);
+}
+
+QIODevice *LoadPathWorker::openDevice(const QString &fileName, QString *message)
+{
+    QIODevice *source;
+    if (QFileInfo(fileName).suffix().toLower() == "xmlz4") {
+        source = new QuaLz4File(fileName);
+        if (!source->open(QFile::ReadOnly)) {
+            *message = tr("Cannot open or read file %1.\nThe compressed bytestream may be corrupt.")
+                    .arg(fileName);
+            delete source;
+            return 0;
+        }
+    } else {
+        source = new QFile(fileName);
+        if (!source->open(QFile::ReadOnly | QFile::Text)) {
+            *message = tr("Cannot open or read file %1:\n%2.")
+                    .arg(fileName)
+                    .arg(source->errorString());
+            delete source;
+            return 0;
+        }
+    }
+    return source;
 }
 
 void LoadPathWorker::run()
 {
-    ShowListing::AdcListReader reader(tree);
+    loadStats = ShowListing::LoadStats();
+    loadStats.path = fileName;
+    // stamped before reading, so that a snapshot never claims a newer file
+    QFileInfo source(fileName);
+    loadStats.fileBytes = source.size();
+    qint64 sourceModified = source.lastModified().toMSecsSinceEpoch();
+    QElapsedTimer timer;
+    timer.start();
+
+    // a snapshot of an unchanged list is shown without parsing anything;
+    // its nodes are mapped read-only and cannot link, so a list that may
+    // share subtrees with one already loaded is parsed instead
+    bool mayLink = subtreeIndex && !subtreeIndex->isEmpty();
+    if (!mayLink && ShowListing::ListingSnapshot::load(fileName, store)) {
+        loadStats.source = ShowListing::LoadStats::Snapshot;
+        loadStats.snapshotNsecs = timer.nsecsElapsed();
+        loadStats.nodes = store->nodeCount() - 1;
+        progressTotal.store(loadStats.fileBytes);
+        progressDone.store(loadStats.fileBytes);
+        emit signalSubtreesReady(store->finishedTopLevel(0), store->node(0).size);
+        addToIndexes();
+        emit signalWorkFinished(Finished, QString());
+        return;
+    }
+
     QString message;
+    QIODevice *io = openDevice(fileName, &message);
+    loadStats.openNsecs = timer.nsecsElapsed();
+    if (!io) {
+        emit signalWorkFinished(Failed, message);
+        return;
+    }
 
-    QObject::connect(&reader, SIGNAL(broadcastProgress(qint64)),
-                     this, SLOT(slotBroadcastProgressReceived(qint64)));
+    // compressed lists report how much of the file they have read, the
+    // reader's position in the document would not match the file size
+    QuaLz4File *lz4 = qobject_cast<QuaLz4File *>(io);
+    if (lz4) {
+        lz4->setProgressCounter(&progressDone);
+        reader.setProgressCounter(0);
+    } else {
+        reader.setProgressCounter(&progressDone);
+    }
+    progressTotal.store(loadStats.fileBytes);
 
-    runningReader = &reader;
-    int rc = reader.read(io, ppInsertedItem);
-    runningReader = 0;
-    if (rc != 0) {
+    int rc = Finished;
+    timer.restart();
+    store->setSubtreeIndex(subtreeIndex);
+    if (reader.read(io, store) != 0) {
+        rc = reader.isCancelled() ? Cancelled : Failed;
         message = reader.errorString();
     }
+    qint64 readNsecs = timer.nsecsElapsed();
+    qint64 deviceNsecs = reader.deviceNsecs();
+    if (lz4) {
+        loadStats.diskNsecs = lz4->fileReadNsecs();
+        loadStats.decodeNsecs = qMax(Q_INT64_C(0), deviceNsecs - loadStats.diskNsecs);
+        loadStats.xmlBytes = lz4->size();
+    } else {
+        loadStats.diskNsecs = deviceNsecs;
+        loadStats.xmlBytes = loadStats.fileBytes;
+    }
+    loadStats.parseNsecs = qMax(Q_INT64_C(0), readNsecs - deviceNsecs);
+    loadStats.nodes = store->nodeCount() - 1;
+    switch (reader.parserUsed()) {
+    case ShowListing::AdcListReader::ParallelParser: loadStats.source = ShowListing::LoadStats::ParallelParse; break;
+    case ShowListing::AdcListReader::FastParser: loadStats.source = ShowListing::LoadStats::FastParse; break;
+    case ShowListing::AdcListReader::StreamParser: loadStats.source = ShowListing::LoadStats::StreamParse; break;
+    }
+    delete io;
+    if (rc == Finished) {
+        timer.restart();
+        ShowListing::ListingSnapshot::save(fileName, *store, loadStats.fileBytes, sourceModified);
+        loadStats.snapshotNsecs = timer.nsecsElapsed();
+        addToIndexes();
+    }
     emit signalWorkFinished(rc, message);
 }
 
-void LoadPathWorker::slotBroadcastProgressReceived(qint64 pos)
+void LoadPathWorker::addToIndexes()
 {
-    lock->lockForWrite();
-    *pWritten = pos;
-    lock->unlock();
+    if (!searchIndex && !subtreeIndex) {
+        return;
+    }
+    QElapsedTimer timer;
+    timer.start();
+    if (searchIndex) {
+        searchIndex->addListing(store);
+    }
+    if (subtreeIndex) {
+        subtreeIndex->addListing(store);
+    }
+    loadStats.indexNsecs = timer.nsecsElapsed();
 }
 
 void LoadPathWorker::postCancelRequest()
 {
-    if (runningReader) {
-        runningReader->cancelProcessing();
-    }
+    reader.cancelProcessing();
 }
@@ -1,37 +1,75 @@
 #ifndef LOADPATHWORKER_H
 #define LOADPATHWORKER_H
 
+#include <QAtomicInteger>
 #include <QObject>
 #include <QRunnable>
-#include <QReadWriteLock>
-#include <QTreeWidgetItem>
 #include <QIODevice>
+#include <QVector>
 
-namespace ShowListing{class DirFileTree;class AdcListReader;}
+#include "adclistreader.h"
+#include "loadstats.h"
 
+namespace ShowListing{class ListingStore; class SearchIndex; class SubtreeIndex;}
+
+/// Opens and parses one FileListing on a QThreadPool thread.
+/** The worker is not auto-deleted: it lives in the GUI thread and relays
+ * the reader's batches there, so its owner deletes it once
+ * signalWorkFinished() has been received.
+ **/
 class LoadPathWorker : public QObject, public QRunnable
 {
     Q_OBJECT
 
 public:
-    LoadPathWorker(QIODevice *inputIo, ShowListing::DirFileTree *treewidget, qint64 *pWrittenTracker, QReadWriteLock *lock, QTreeWidgetItem **ppInsertedItem);
+    enum Status { Finished = 0, Failed = 1, Cancelled = 2 };
+
+    LoadPathWorker(const QString &fileName, ShowListing::ListingStore *store);
 public:
     void run();
     void postCancelRequest();
+    /// Index the listing is added to once it is read, none by default.
+    void setSearchIndex(ShowListing::SearchIndex *index) { searchIndex = index; }
+    /// Index directories are shared through, none by default.
+    /** The list links to matching subtrees of listings already in the
+     * index, and is added to it once read. While the index holds any
+     * listing the snapshot is skipped and the list parsed, and a list that
+     * got links is not saved as a snapshot: sharing trades load time for
+     * memory.
+     **/
+    void setSubtreeIndex(ShowListing::SubtreeIndex *index) { subtreeIndex = index; }
+    /// Bytes of the file processed so far, out of \a total.
+    /** May be polled from any thread at any rate, it only reads two atomic
+     * counters. Compressed lists count compressed bytes.
+     **/
+    qint64 progress(qint64 *total) const { *total = progressTotal.load(); return progressDone.load(); }
+    /// Phases of the load, complete once signalWorkFinished() was emitted.
+    /** Only the GUI side phases, insertNsecs and totalNsecs, are left for
+     * the owner to fill in.
+     **/
+    const ShowListing::LoadStats &stats() const { return loadStats; }
+
+    /// Opens \a fileName for reading, decompressing .xmlz4 lists on the fly.
+    /** Returns 0 and sets \a message when it cannot be opened.
+     **/
+    static QIODevice *openDevice(const QString &fileName, QString *message);
 
 private:
-    QIODevice *io;
-    ShowListing::DirFileTree *tree;
-    qint64 *pWritten;
-    QReadWriteLock *lock;
-    QTreeWidgetItem **ppInsertedItem;
+    void addToIndexes();
 
-    ShowListing::AdcListReader *runningReader;
+    QString fileName;
+    ShowListing::ListingStore *store;
+    ShowListing::SearchIndex *searchIndex;
+    ShowListing::SubtreeIndex *subtreeIndex;
+    QAtomicInteger<qint64> progressDone;
+    QAtomicInteger<qint64> progressTotal;
 
-private slots:
-    void slotBroadcastProgressReceived(qint64 pos);
+    ShowListing::AdcListReader reader;
+    ShowListing::LoadStats loadStats;
 
 signals:
+    void signalSubtreesReady(const QVector<quint32> &ids, quint64 totalSize);
+    void signalRestarted();
     void signalWorkFinished(int status, const QString& message);
 };
 
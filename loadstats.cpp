@@ -0,0 +1,102 @@
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonDocument>
+#include <QStringList>
+#include <QSysInfo>
+#include <QThread>
+
+#include "loadstats.h"
+
+using ShowListing::LoadStats;
+
+namespace {
+
+const char *const SOURCE_NAMES[] = { "snapshot", "parallel", "fast", "stream" };
+
+QString seconds(qint64 nsecs)
+{
+    return QString::number(nsecs / 1e9, 'f', 2);
+}
+
+double milliseconds(qint64 nsecs)
+{
+    return nsecs < 0 ? -1.0 : nsecs / 1e6;
+}
+
+}
+
+LoadStats::LoadStats()
+    : source(StreamParse), fileBytes(0), xmlBytes(-1), nodes(0), openNsecs(-1), diskNsecs(-1),
+      decodeNsecs(-1), parseNsecs(-1), snapshotNsecs(-1), indexNsecs(-1), insertNsecs(-1), totalNsecs(-1)
+{
+}
+
+QString LoadStats::summary() const
+{
+    QStringList phases;
+    if (source == Snapshot) {
+        phases << QCoreApplication::translate("LoadStats", "snapshot %1 s").arg(seconds(snapshotNsecs));
+    } else {
+        phases << QCoreApplication::translate("LoadStats", "disk %1 s").arg(seconds(diskNsecs));
+        if (decodeNsecs >= 0) {
+            phases << QCoreApplication::translate("LoadStats", "LZ4 %1 s").arg(seconds(decodeNsecs));
+        }
+        phases << QCoreApplication::translate("LoadStats", "parse %1 s").arg(seconds(parseNsecs));
+    }
+    if (indexNsecs >= 0) {
+        phases << QCoreApplication::translate("LoadStats", "index %1 s").arg(seconds(indexNsecs));
+    }
+    phases << QCoreApplication::translate("LoadStats", "tree %1 s").arg(seconds(insertNsecs));
+
+    double total = totalNsecs / 1e9;
+    return QCoreApplication::translate("LoadStats", "%1 entries in %2 s (%3), %4 entries/s, %5 MiB/s")
+            .arg(nodes)
+            .arg(seconds(totalNsecs))
+            .arg(phases.join(", "))
+            .arg(total > 0 ? qint64(nodes / total) : 0)
+            .arg(total > 0 ? QString::number(fileBytes / 1048576.0 / total, 'f', 1) : QString("-"));
+}
+
+QJsonObject LoadStats::toJson() const
+{
+    double total = totalNsecs / 1e9;
+    QJsonObject o;
+    o["path"] = QFileInfo(path).absoluteFilePath();
+    o["source"] = QString(SOURCE_NAMES[source]);
+    o["file_bytes"] = double(fileBytes);
+    o["xml_bytes"] = double(xmlBytes);
+    o["nodes"] = double(nodes);
+    o["open_ms"] = milliseconds(openNsecs);
+    o["disk_ms"] = milliseconds(diskNsecs);
+    o["decode_ms"] = milliseconds(decodeNsecs);
+    o["parse_ms"] = milliseconds(parseNsecs);
+    o["snapshot_ms"] = milliseconds(snapshotNsecs);
+    o["index_ms"] = milliseconds(indexNsecs);
+    o["insert_ms"] = milliseconds(insertNsecs);
+    o["total_ms"] = milliseconds(totalNsecs);
+    o["entries_per_s"] = total > 0 ? nodes / total : 0.0;
+    o["bytes_per_s"] = total > 0 ? fileBytes / total : 0.0;
+    return o;
+}
+
+bool LoadStats::appendTo(const QString &fileName, const QString &status) const
+{
+    QJsonObject o = toJson();
+    o["time"] = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+    o["host"] = QSysInfo::machineHostName();
+    o["threads"] = QThread::idealThreadCount();
+    o["status"] = status;
+
+    if (!QDir().mkpath(QFileInfo(fileName).absolutePath())) {
+        return false;
+    }
+    QFile log(fileName);
+    if (!log.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        return false;
+    }
+    QByteArray line = QJsonDocument(o).toJson(QJsonDocument::Compact) + '\n';
+    return log.write(line) == line.size();
+}
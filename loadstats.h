@@ -0,0 +1,44 @@
+#ifndef LOADSTATS_H
+#define LOADSTATS_H
+
+#include <QJsonObject>
+#include <QString>
+
+namespace ShowListing{
+
+/// Where the time went while a list was opened.
+/** Reading the file, decompressing and parsing overlap: disk and LZ4 time
+ * are what the parser spent waiting for its device, parsing is the rest.
+ * Durations are in nanoseconds, -1 when a phase did not happen.
+ **/
+struct LoadStats
+{
+    enum Source { Snapshot, ParallelParse, FastParse, StreamParse };
+
+    LoadStats();
+
+    QString path;
+    int source;
+    qint64 fileBytes;       // size on disk
+    qint64 xmlBytes;        // uncompressed size, -1 if unknown
+    quint32 nodes;
+
+    qint64 openNsecs;       // looking for a snapshot and opening the file
+    qint64 diskNsecs;
+    qint64 decodeNsecs;
+    qint64 parseNsecs;
+    qint64 snapshotNsecs;   // loading or saving the snapshot
+    qint64 indexNsecs;      // adding names and entries to the search and subtree indexes
+    qint64 insertNsecs;     // handing subtrees to the model, in the GUI thread
+    qint64 totalNsecs;      // from the request to the list being shown
+
+    /// One line for the status bar.
+    QString summary() const;
+    QJsonObject toJson() const;
+    /// Appends toJson() plus \a status as one line of JSON to \a fileName.
+    bool appendTo(const QString &fileName, const QString &status) const;
+};
+
+}
+
+#endif // LOADSTATS_H
@@ -0,0 +1,173 @@
+#include "lz4framewriter.h"
+
+#include <QtEndian>
+
+#include <string.h>
+
+#include "lz4.h"
+
+namespace {
+
+const quint32 FRAME_MAGIC = 0x184D2204;
+const quint32 STORED_BLOCK = 0x80000000;
+const int BLOCK_SIZE_ID = 7;
+const int BLOCK_SIZE = 4 << 20;
+
+// version 01, independent blocks, content checksum
+const uchar FLAGS = 0x40 | 0x20 | 0x04;
+const uchar BLOCK_CHECKSUM_FLAG = 0x10;
+const uchar CONTENT_SIZE_FLAG = 0x08;
+
+}
+
+Lz4FrameWriter::Lz4FrameWriter(QIODevice *target, QObject *parent) :
+    QIODevice(parent), _target(target), _blockFill(0), _contentSize(0), _headerPos(0),
+    _sizeInHeader(false), _blockChecksums(false), _finished(false), _failed(false)
+{
+}
+
+Lz4FrameWriter::~Lz4FrameWriter()
+{
+    close();
+}
+
+bool Lz4FrameWriter::open(OpenMode mode)
+{
+    if ((mode & ReadOnly) || !(mode & WriteOnly) || !_target->isWritable()) {
+        return false;
+    }
+    _sizeInHeader = !_target->isSequential();
+    _headerPos = _target->pos();
+    _block.resize(BLOCK_SIZE);
+    _compressed.resize(LZ4_compressBound(BLOCK_SIZE));
+    _blockFill = 0;
+    _contentHash.reset();
+    _contentSize = 0;
+    _finished = false;
+    _failed = false;
+
+    // a zero content size is a placeholder until finish()
+    uchar header[4 + 2 + 8 + 1];
+    qToLittleEndian<quint32>(FRAME_MAGIC, header);
+    header[4] = FLAGS | (_blockChecksums ? BLOCK_CHECKSUM_FLAG : 0) | (_sizeInHeader ? CONTENT_SIZE_FLAG : 0);
+    header[5] = BLOCK_SIZE_ID << 4;
+    int descriptor = 2;
+    if (_sizeInHeader) {
+        memset(header + 6, 0, 8);
+        descriptor += 8;
+    }
+    header[4 + descriptor] = uchar(Xxh32::hash(header + 4, descriptor) >> 8);
+    if (!writeTarget(reinterpret_cast<const char *>(header), 4 + descriptor + 1)) {
+        return false;
+    }
+    return QIODevice::open(mode | Unbuffered);
+}
+
+bool Lz4FrameWriter::finish()
+{
+    if (!isOpen() || _finished) {
+        return !_failed;
+    }
+    _finished = true;
+    if (_blockFill > 0 && !writeBlock()) {
+        return false;
+    }
+    uchar end[8];
+    qToLittleEndian<quint32>(0, end);
+    qToLittleEndian<quint32>(_contentHash.digest(), end + 4);
+    if (!writeTarget(reinterpret_cast<const char *>(end), 8)) {
+        return false;
+    }
+
+    if (_sizeInHeader) {
+        uchar descriptor[2 + 8 + 1];
+        descriptor[0] = FLAGS | (_blockChecksums ? BLOCK_CHECKSUM_FLAG : 0) | CONTENT_SIZE_FLAG;
+        descriptor[1] = BLOCK_SIZE_ID << 4;
+        qToLittleEndian<quint64>(_contentSize, descriptor + 2);
+        descriptor[10] = uchar(Xxh32::hash(descriptor, 10) >> 8);
+        qint64 endPos = _target->pos();
+        if (!_target->seek(_headerPos + 4)
+                || !writeTarget(reinterpret_cast<const char *>(descriptor), sizeof(descriptor))
+                || !_target->seek(endPos)) {
+            _failed = true;
+            setErrorString(tr("Cannot update the frame header: %1").arg(_target->errorString()));
+            return false;
+        }
+    }
+    return true;
+}
+
+void Lz4FrameWriter::close()
+{
+    if (!isOpen()) {
+        return;
+    }
+    finish();
+    QIODevice::close();
+    _block.clear();
+    _compressed.clear();
+}
+
+qint64 Lz4FrameWriter::readData(char *, qint64)
+{
+    return -1;
+}
+
+qint64 Lz4FrameWriter::writeData(const char *data, qint64 maxSize)
+{
+    if (_failed || _finished) {
+        return -1;
+    }
+    qint64 done = 0;
+    while (done < maxSize) {
+        int n = int(qMin(maxSize - done, qint64(BLOCK_SIZE - _blockFill)));
+        memcpy(_block.data() + _blockFill, data + done, n);
+        _blockFill += n;
+        done += n;
+        if (_blockFill == BLOCK_SIZE && !writeBlock()) {
+            return -1;
+        }
+    }
+    return done;
+}
+
+/// Compresses the buffered block, storing it as is if it does not shrink.
+bool Lz4FrameWriter::writeBlock()
+{
+    const char *block = _block.constData();
+    int size = LZ4_compress_limitedOutput(block, _compressed.data(), _blockFill, _blockFill - 1);
+    quint32 word = quint32(size);
+    if (size <= 0) {
+        size = _blockFill;
+        word = quint32(size) | STORED_BLOCK;
+    } else {
+        block = _compressed.constData();
+    }
+
+    uchar sizeWord[4];
+    qToLittleEndian<quint32>(word, sizeWord);
+    if (!writeTarget(reinterpret_cast<const char *>(sizeWord), 4) || !writeTarget(block, size)) {
+        return false;
+    }
+    if (_blockChecksums) {
+        uchar checksum[4];
+        qToLittleEndian<quint32>(Xxh32::hash(block, size), checksum);
+        if (!writeTarget(reinterpret_cast<const char *>(checksum), 4)) {
+            return false;
+        }
+    }
+    _contentHash.update(_block.constData(), _blockFill);
+    _contentSize += _blockFill;
+    _blockFill = 0;
+    return true;
+}
+
+bool Lz4FrameWriter::writeTarget(const char *data, qint64 size)
+{
+    if (_target->write(data, size) != size) {
+        _failed = true;
+        setErrorString(_target->errorString());
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,57 @@
+#ifndef LZ4FRAMEWRITER_H
+#define LZ4FRAMEWRITER_H
+
+#include <QByteArray>
+#include <QIODevice>
+
+#include "xxh32.h"
+
+/// Compresses everything written to it into one LZ4 frame on another device.
+/** The frame uses independent 4 MiB blocks and a content checksum, so
+ * QuaLz4File decompresses it on all cores. When the target can seek, the
+ * content size is filled into the frame header by finish().
+ *
+ * The target must already be open for writing and outlive the writer.
+ **/
+class Lz4FrameWriter : public QIODevice
+{
+    Q_OBJECT
+public:
+    explicit Lz4FrameWriter(QIODevice *target, QObject *parent = 0);
+    virtual ~Lz4FrameWriter();
+
+    /// Adds a checksum to every block, to be called before open().
+    void setBlockChecksums(bool enabled) { _blockChecksums = enabled; }
+
+    /// Writes the frame header. Only QIODevice::WriteOnly is supported.
+    virtual bool open(OpenMode mode);
+    /// Compresses what is left and ends the frame.
+    /** Returns \c false if anything could not be written to the target,
+     * errorString() then tells why. Called by close() if need be.
+     **/
+    bool finish();
+    virtual void close();
+    virtual bool isSequential() const { return true; }
+
+protected:
+    virtual qint64 readData(char *data, qint64 maxSize);
+    virtual qint64 writeData(const char *data, qint64 maxSize);
+
+private:
+    bool writeBlock();
+    bool writeTarget(const char *data, qint64 size);
+
+    QIODevice *_target;
+    QByteArray _block;
+    int _blockFill;
+    QByteArray _compressed;
+    Xxh32 _contentHash;
+    qint64 _contentSize;
+    qint64 _headerPos;
+    bool _sizeInHeader;
+    bool _blockChecksums;
+    bool _finished;
+    bool _failed;
+};
+
+#endif // LZ4FRAMEWRITER_H
@@ -1,32 +1,86 @@
 #include <QApplication>
 #include <QtGui>
+#include <QDockWidget>
 #include <QFileDialog>
+#include <QLineEdit>
 #include <QMessageBox>
 #include <QMenuBar>
-#include <QIODevice>
-#include <QtConcurrent/QtConcurrentRun>
-#include <QFuture>
 #include <QProgressDialog>
+#include <QStandardPaths>
+#include <QThreadPool>
+#include <QToolBar>
+#include <QTreeWidget>
+
+#include <algorithm>
 
 #include "mainwindow.h"
 
 #include "dirfiletree.h"
-#include "adclistreader.h"
-
+#include "listingmodel.h"
+#include "listingstore.h"
+#include "searchindex.h"
+#include "util.h"
+
+#include "diffworker.h"
+#include "duplicatefinder.h"
+#include "duplicateworker.h"
+#include "exportworker.h"
+#include "filterworker.h"
+#include "largestworker.h"
+#include "listingdiff.h"
+#include "listingstatistics.h"
 #include "loadpathworker.h"
-
-#include "qualz4file.h"
+#include "statisticsworker.h"
 
 using ShowListing::DirFileTree;
-using ShowListing::AdcListReader;
+using ShowListing::DuplicateFinder;
+using ShowListing::ListingDiff;
+using ShowListing::ListingStatistics;
+using ShowListing::ListingStore;
+using ShowListing::SearchIndex;
+
+namespace {
+
+const int SEARCH_RESULT_LIMIT = 1000;
+const int LARGEST_COUNT = 100;
+const int DUPLICATE_GROUPS = 200;
+const int STATISTICS_EXTENSIONS = 50;
+const int FILTER_DELAY_MS = 150;
+// matches whose directories are expanded as they come in, the rest is one click away
+const int FILTER_EXPAND_LIMIT = 200;
+
+QTreeWidgetItem *statisticsItem(QTreeWidgetItem *parent, const QString &label, quint64 entries, quint64 bytes)
+{
+    QTreeWidgetItem *item = new QTreeWidgetItem(parent);
+    item->setText(0, label);
+    item->setText(1, QString::number(entries));
+    item->setText(2, humanizeBigNums(bytes, 2));
+    item->setTextAlignment(1, Qt::AlignRight | Qt::AlignVCenter);
+    item->setTextAlignment(2, Qt::AlignRight | Qt::AlignVCenter);
+    return item;
+}
+
+}
 
-MainWindow::MainWindow(QApplication &application, QWidget *parent) : QMainWindow(parent)
+MainWindow::MainWindow(QApplication &application, QWidget *parent) : QMainWindow(parent),
+    insertNsecs(0), progress(0), worker(0), loadedListing(0),
+    filterWorker(0), filterGeneration(0), filterExpanded(0), statisticsStore(0), statisticsNode(0),
+    statisticsWorker(0), statisticsPending(false),
+    exportWorker(0), diffWorker(0), largestWorker(0), largestPending(false),
+    duplicateWorker(0), duplicatesPending(false)
 {
     app = &application;
+    qRegisterMetaType<quint64>("quint64");
+    qRegisterMetaType<QVector<quint32> >("QVector<quint32>");
+    qRegisterMetaType<const ShowListing::ListingStore *>("const ShowListing::ListingStore*");
     dirFileTree = new DirFileTree;
     setCentralWidget(dirFileTree);
 
     createActions();
+    createSearch();
+    createLargest();
+    createDuplicates();
+    createStatistics();
     createMenus();
     setAcceptDrops(true);
 
@@ -48,6 +102,9 @@ MainWindow::MainWindow(QApplication &application, QWidget *parent) : QMainWindow
         resize(1024, 768);
     }
     lastOpenPath = QDir::currentPath();
+
+    QObject::connect(&timer, SIGNAL(timeout()),
+                     this, SLOT(slotTimer()));
 }
 
 void MainWindow::open()
@@ -72,155 +129,696 @@ void MainWindow::open()
 }
 
 void MainWindow::openPath(const QString& fileName)
+{
+    // one list is parsed at a time, others wait for their turn
+    if (worker) {
+        pendingPaths.append(fileName);
+        return;
+    }
+    startLoad(fileName);
+}
+
+void MainWindow::startLoad(const QString& fileName)
 {
     QFileInfo fi(fileName);
     lastOpenPath = fi.dir().absolutePath();
     lastOpenFilePath = fileName;
 
-    if (fi.suffix().toLower() == "xmlz4") {
-        source = new QuaLz4File(fileName);
-        if (!source->open(QFile::ReadOnly)) {
-            QMessageBox::warning(this, tr("ShowListing - Cannot open file list"),
-                                 tr("Cannot open or read file %1.\nThe compressed bytestream may be corrupt.")
-                                 .arg(fileName));
-            delete source;
-            source = 0;
-            return;
-        }
-    } else {
-        source = new QFile(fileName);
-        if (!source->open(QFile::ReadOnly | QFile::Text)) {
-            QMessageBox::warning(this, tr("ShowListing - Cannot open file list"),
-                                 tr("Cannot open or read file %1:\n%2.")
-                                 .arg(fileName)
-                                 .arg(source->errorString()));
-            delete source;
-            source = 0;
-            return;
-        }
-    }
+    loadTimer.start();
+    insertNsecs = 0;
+    loadedListing = new ListingStore(dirFileTree->listingModel()->namePool());
+    loadedListing->sourcePath = lastOpenFilePath;
+    dirFileTree->listingModel()->addListing(loadedListing);
 
-#if 0
-    progressValue = 0;
-    insertedRow = 0;
-    listReader = new ShowListing::AdcListReader(dirFileTree);
-    watcher = new QFutureWatcher<void>();
+    worker = new LoadPathWorker(fileName, loadedListing);
+    worker->setSearchIndex(dirFileTree->listingModel()->searchIndex());
+    if (shareAct->isChecked()) {
+        worker->setSubtreeIndex(dirFileTree->listingModel()->subtreeIndex());
+    }
 
     progress = new QProgressDialog(tr("Processing %1...").arg(QDir::toNativeSeparators(fileName)),
-                                                    QString(), 0, fi.size(), this);
-    progress->setWindowModality(Qt::WindowModal);
-    progress->show();
-
-    QFuture<void> future = QtConcurrent::run(listReader, &ShowListing::AdcListReader::read, source, &insertedRow);
+                                   tr("Cancel"), 0, 0, this);
+    // not modal: what has been published so far can be browsed meanwhile
+    progress->setWindowModality(Qt::NonModal);
+    progress->setMinimumDuration(500);
 
     QObject::connect(progress, SIGNAL(canceled()),
-                   this, SLOT(slotOpenPathCancelled()));
-    QObject::connect(listReader, SIGNAL(broadcastProgress(qint64)),
-                   this, SLOT(slotBroadcastProgressReceived(qint64)));
-    QObject::connect(watcher, SIGNAL(finished()),
-                     this, SLOT(slotFutureWatchNotify()));
-    watcher->setFuture(future);
-    timer.start(500);
-#else
-    //FIXME: temporarily do everything ins GUI thread until a proper way is implemented
-    progress = new QProgressDialog(QString(), QString(), 0, 0, this);
-    watcher = new QFutureWatcher<void>();
-    listReader = new ShowListing::AdcListReader(dirFileTree);
-    listReader->read(source, &insertedRow);
-    slotFutureWatchNotify();
-#endif
+                     this, SLOT(slotOpenPathCancelled()));
+    QObject::connect(worker, SIGNAL(signalSubtreesReady(QVector<quint32>,quint64)),
+                     this, SLOT(slotSubtreesReady(QVector<quint32>,quint64)));
+    QObject::connect(worker, SIGNAL(signalRestarted()),
+                     this, SLOT(slotLoadRestarted()));
+    QObject::connect(worker, SIGNAL(signalWorkFinished(int,QString)),
+                     this, SLOT(slotLoadFinished(int,QString)));
+
+    statusBar()->showMessage(tr("Loading %1...").arg(QDir::toNativeSeparators(fileName)));
+    timer.start(100);
+    QThreadPool::globalInstance()->start(worker);
 }
 
-void MainWindow::slotFutureWatchNotify()
+void MainWindow::slotSubtreesReady(const QVector<quint32> &ids, quint64 totalSize)
+{
+    if (!loadedListing) {
+        return;
+    }
+    QElapsedTimer publishTimer;
+    publishTimer.start();
+    ShowListing::ListingModel *model = dirFileTree->listingModel();
+    model->publishSubtrees(loadedListing, ids, totalSize);
+    QModelIndex listingRow = model->index(model->listingCount() - 1, 0);
+    if (!ids.isEmpty() && !dirFileTree->isExpanded(listingRow)) {
+        dirFileTree->expand(listingRow);
+    }
+    insertNsecs += publishTimer.nsecsElapsed();
+}
+
+void MainWindow::slotLoadRestarted()
+{
+    if (loadedListing) {
+        dirFileTree->listingModel()->unpublishSubtrees(loadedListing);
+    }
+}
+
+void MainWindow::slotLoadFinished(int status, const QString &message)
 {
-    qDebug("call slotFutureWatchNotify()\n");
     timer.stop();
-    Q_ASSERT_X(listReader != 0, "slotFutureWatchNotify()", "use-after-free listReader");
-    Q_ASSERT_X(source != 0, "slotFutureWatchNotify()", "use-after-free source");
-    if (!listReader->hasError() && insertedRow) {
-        progress->reset();
-
-        insertedRow->setData(0, Qt::UserRole, QString("%1").arg(QDir::toNativeSeparators(lastOpenFilePath)));
-        insertedRow->setText(0, QString("[%1] %2").arg(lastOpenFilePath).arg(insertedRow->text(0)));
-        insertedRow->setExpanded(true);
-        // modify UI in GUI thread.
-        dirFileTree->setUpdatesEnabled(false);
-        dirFileTree->addTopLevelItem(insertedRow);
-        dirFileTree->header()->resizeSections(QHeaderView::ResizeToContents);
-        dirFileTree->setUpdatesEnabled(true);
-
-        statusBar()->showMessage(tr("File loaded:%1:").arg(dirFileTree->property("base").toString()));
-    } else {
-        if (insertedRow) {
-            dirFileTree->setUpdatesEnabled(false);
-            dirFileTree->addTopLevelItem(insertedRow);
-            delete insertedRow;
-            dirFileTree->setUpdatesEnabled(true);
+    Q_ASSERT_X(worker != 0, "slotLoadFinished()", "use-after-free worker");
+    ShowListing::LoadStats stats = worker->stats();
+    if (status == LoadPathWorker::Finished) {
+        QElapsedTimer resizeTimer;
+        resizeTimer.start();
+        dirFileTree->setProperty("generator", loadedListing->generator);
+        dirFileTree->setProperty("base", loadedListing->base);
+        dirFileTree->fitColumnsToVisibleRows();
+        insertNsecs += resizeTimer.nsecsElapsed();
+        if (filterAct->isChecked() && dirFileTree->listingModel()->isFiltering()) {
+            filterText.clear();
+            slotStartFilter();
         }
+    }
+    stats.insertNsecs = insertNsecs;
+    stats.totalNsecs = loadTimer.nsecsElapsed();
+    QString log = loadStatsLog();
+    if (!log.isEmpty()) {
+        static const char *const statusNames[] = { "finished", "failed", "cancelled" };
+        stats.appendTo(log, statusNames[status]);
+    }
+
+    if (status == LoadPathWorker::Finished) {
+        statusBar()->showMessage(tr("File loaded:%1: %2")
+                                 .arg(dirFileTree->property("base").toString())
+                                 .arg(stats.summary()));
+    } else if (status == LoadPathWorker::Cancelled) {
+        dirFileTree->listingModel()->removeListing(loadedListing);
+        statusBar()->showMessage(tr("Loading cancelled"), 2000);
+    } else {
+        dirFileTree->listingModel()->removeListing(loadedListing);
+        statusBar()->showMessage(tr("Ready"));
+    }
+    loadedListing = 0;
+    if (status == LoadPathWorker::Finished) {
+        slotRefreshLargest();
+        slotRefreshDuplicates();
+        slotRefreshStatistics();
+    }
+    progress->reset();
+    progress->deleteLater();
+    progress = 0;
+    worker->deleteLater();
+    worker = 0;
+
+    if (status == LoadPathWorker::Failed) {
         QMessageBox::warning(this, tr("ShowListing - Failed to open file list"),
                              tr("Cannot open file list %1, maybe the file is corrupt.\n\n%2")
                              .arg(lastOpenFilePath)
-                             .arg(listReader->errorString()));
-        progress->reset();
+                             .arg(message));
+    }
+    if (!worker && !pendingPaths.isEmpty()) {
+        startLoad(pendingPaths.takeFirst());
     }
-    delete watcher;
-    watcher = 0;
-    delete progress;
-    progress = 0;
-    delete listReader;
-    listReader = 0;
-    delete source;
-    source = 0;
 }
 
-void MainWindow::slotBroadcastProgressReceived(qint64 pos)
+/// JSON lines file every load is recorded in, none if the setting is empty.
+QString MainWindow::loadStatsLog() const
 {
-    lock_progressValue.lockForWrite();
-    progressValue = pos;
-    lock_progressValue.unlock();
-    if (progress) {
-        progress->setValue(pos);
-    }
+    QSettings settings("ShowListing", "ShowListing 1");
+    return settings.value("loadStatsLog", QStandardPaths::writableLocation(QStandardPaths::DataLocation)
+                          + "/load-stats.jsonl").toString();
 }
 
 void MainWindow::slotOpenPathCancelled()
 {
-    if (listReader) {
-        listReader->cancelProcessing();
+    if (worker) {
+        worker->postCancelRequest();
     }
 }
 
 void MainWindow::slotTimer()
 {
-    if (progress != 0)
+    if (progress != 0 && worker != 0)
     {
-        lock_progressValue.lockForRead();
-        progress->setValue(progressValue);
-        lock_progressValue.unlock();
+        qint64 total;
+        qint64 value = worker->progress(&total);
+        if (total > 0) {
+            // QProgressDialog works with ints, scale down to KiB
+            progress->setMaximum(int(total >> 10));
+            progress->setValue(int(qMin(value, total) >> 10));
+        }
+    }
+}
+
+
+void MainWindow::slotSearch()
+{
+    searchResults->clear();
+    QString text = searchEdit->text().trimmed();
+    if (text.isEmpty()) {
+        return;
+    }
+    QElapsedTimer searchTimer;
+    searchTimer.start();
+    QVector<SearchIndex::Hit> hits;
+    int total = dirFileTree->listingModel()->searchIndex()->search(text, SEARCH_RESULT_LIMIT, &hits);
+    qint64 searchNsecs = searchTimer.nsecsElapsed();
+
+    QList<QTreeWidgetItem *> items;
+    for (int i = 0; i < hits.size(); ++i) {
+        items.append(entryItem(hits.at(i).store, hits.at(i).node, hits.at(i).listing));
+    }
+    searchResults->addTopLevelItems(items);
+    searchDock->show();
+
+    if (total > hits.size()) {
+        statusBar()->showMessage(tr("%1 entries match \"%2\", showing the first %3 (%4 ms)")
+                                 .arg(total).arg(text).arg(hits.size())
+                                 .arg(searchNsecs / 1e6, 0, 'f', 1));
+    } else {
+        statusBar()->showMessage(tr("%1 entries match \"%2\" (%3 ms)")
+                                 .arg(total).arg(text)
+                                 .arg(searchNsecs / 1e6, 0, 'f', 1));
     }
 }
 
+/// Row for an entry in the search results, the largest items or the duplicates, found through \a listing if given.
+QTreeWidgetItem *MainWindow::entryItem(const ListingStore *store, quint32 node, const ListingStore *listing) const
+{
+    const ShowListing::ListingNode &n = store->node(node);
+    QTreeWidgetItem *item = new QTreeWidgetItem;
+    item->setText(0, store->name(node));
+    if (!(n.flags & ShowListing::ListingNode::NoSize)) {
+        item->setText(1, humanizeBigNums(n.size, 2));
+    }
+    item->setText(2, QDir::toNativeSeparators(store->path(node, QDir::separator())));
+    item->setIcon(0, n.type == ShowListing::ListingNode::Directory ? dirFileTree->folderIcon : dirFileTree->fileIcon);
+    if (listing && listing != store) {
+        item->setToolTip(2, tr("%1\nshared with %2").arg(QDir::toNativeSeparators(listing->sourcePath))
+                         .arg(QDir::toNativeSeparators(store->sourcePath)));
+    } else {
+        item->setToolTip(2, QDir::toNativeSeparators(store->sourcePath));
+    }
+    item->setData(0, Qt::UserRole, qulonglong(quintptr(store)));
+    item->setData(0, Qt::UserRole + 1, node);
+    return item;
+}
+
+/// Starts looking for the largest files and directories of the loaded lists, if shown.
+void MainWindow::slotRefreshLargest()
+{
+    if (!largestDock->isVisible()) {
+        return;
+    }
+    if (largestWorker) {
+        largestPending = true;
+        return;
+    }
+    QVector<const ListingStore *> stores;
+    ShowListing::ListingModel *model = dirFileTree->listingModel();
+    for (int i = 0; i < model->listingCount(); ++i) {
+        // the list being loaded is still growing on another thread
+        if (model->listing(i) != loadedListing) {
+            stores.append(model->listing(i));
+        }
+    }
+    largestWorker = new LargestWorker(stores, LARGEST_COUNT);
+    QObject::connect(largestWorker, SIGNAL(signalLargestFinished()), this, SLOT(slotLargestFinished()));
+    largestDock->setWindowTitle(tr("Largest items (searching)"));
+    QThreadPool::globalInstance()->start(largestWorker);
+}
 
+/// Shows the largest files and directories, or looks again if the lists changed meanwhile.
+void MainWindow::slotLargestFinished()
+{
+    LargestWorker *finished = largestWorker;
+    largestWorker = 0;
+    finished->deleteLater();
+    if (largestPending) {
+        largestPending = false;
+        slotRefreshLargest();
+        return;
+    }
+
+    const QVector<LargestWorker::Entry> &files = finished->files();
+    const QVector<LargestWorker::Entry> &directories = finished->directories();
+    largestView->clear();
+    QTreeWidgetItem *fileGroup = new QTreeWidgetItem(QStringList() << tr("Files"));
+    QTreeWidgetItem *directoryGroup = new QTreeWidgetItem(QStringList() << tr("Directories"));
+    for (int i = 0; i < files.size(); ++i) {
+        fileGroup->addChild(entryItem(files.at(i).store, files.at(i).node, files.at(i).listing));
+    }
+    for (int i = 0; i < directories.size(); ++i) {
+        directoryGroup->addChild(entryItem(directories.at(i).store, directories.at(i).node,
+                                           directories.at(i).listing));
+    }
+    largestView->addTopLevelItem(fileGroup);
+    largestView->addTopLevelItem(directoryGroup);
+    fileGroup->setExpanded(true);
+    directoryGroup->setExpanded(true);
+    largestDock->setWindowTitle(tr("Largest items (%1 ms)").arg(finished->nsecs() / 1e6, 0, 'f', 1));
+}
+
+/// Starts grouping the files found in several places across the loaded lists, if shown.
+void MainWindow::slotRefreshDuplicates()
+{
+    if (!duplicatesDock->isVisible()) {
+        return;
+    }
+    if (duplicateWorker) {
+        duplicatesPending = true;
+        return;
+    }
+    QVector<const ListingStore *> stores;
+    ShowListing::ListingModel *model = dirFileTree->listingModel();
+    for (int i = 0; i < model->listingCount(); ++i) {
+        // the list being loaded is still growing on another thread
+        if (model->listing(i) != loadedListing) {
+            stores.append(model->listing(i));
+        }
+    }
+    duplicateWorker = new DuplicateWorker(stores);
+    QObject::connect(duplicateWorker, SIGNAL(signalDuplicatesFinished()), this, SLOT(slotDuplicatesFinished()));
+    duplicatesDock->setWindowTitle(tr("Duplicates (searching)"));
+    QThreadPool::globalInstance()->start(duplicateWorker);
+}
+
+/// Shows the biggest groups of duplicates, or looks again if the lists changed meanwhile.
+void MainWindow::slotDuplicatesFinished()
+{
+    DuplicateWorker *finished = duplicateWorker;
+    duplicateWorker = 0;
+    finished->deleteLater();
+    if (duplicatesPending) {
+        duplicatesPending = false;
+        slotRefreshDuplicates();
+        return;
+    }
+
+    const DuplicateFinder &duplicates = *finished->duplicates();
+    duplicatesView->clear();
+    QList<QTreeWidgetItem *> items;
+    const QVector<DuplicateFinder::Group> &groups = duplicates.groups();
+    for (int g = 0; g < groups.size() && g < DUPLICATE_GROUPS; ++g) {
+        const DuplicateFinder::Group &group = groups.at(g);
+        const DuplicateFinder::Copy &first = duplicates.copies().at(group.firstCopy);
+        QTreeWidgetItem *item = new QTreeWidgetItem;
+        item->setText(0, first.store->name(first.node));
+        item->setText(1, humanizeBigNums(group.reclaimable, 2));
+        item->setText(2, tr("%1 copies in %2 lists").arg(group.copyCount).arg(group.listings));
+        item->setIcon(0, dirFileTree->fileIcon);
+        item->setToolTip(1, tr("Reclaimable by keeping one copy of %1").arg(humanizeBigNums(group.size, 2)));
+        if (group.byTth) {
+            item->setToolTip(0, tr("Same TTH: %1").arg(QString::fromLatin1(first.store->tth(first.node)->toBase32())));
+        } else {
+            item->setToolTip(0, tr("Same name and size, no TTH"));
+        }
+        for (int c = 0; c < group.copyCount; ++c) {
+            const DuplicateFinder::Copy &copy = duplicates.copies().at(group.firstCopy + c);
+            item->addChild(entryItem(copy.store, copy.node, copy.listing));
+        }
+        items.append(item);
+    }
+    duplicatesView->addTopLevelItems(items);
+    duplicatesDock->setWindowTitle(tr("Duplicates: %1 reclaimable in %2 groups (%3 ms)")
+                                   .arg(humanizeBigNums(duplicates.reclaimable(), 2))
+                                   .arg(groups.size())
+                                   .arg(finished->nsecs() / 1e6, 0, 'f', 1));
+}
+
+/// Shows the statistics of the current directory, or of the list if it is a file.
+void MainWindow::slotRefreshStatistics()
+{
+    if (!statisticsDock->isVisible()) {
+        return;
+    }
+    const ListingStore *store = 0;
+    quint32 node = 0;
+    if (dirFileTree->listingModel()->entryAt(dirFileTree->currentIndex(), &store, &node)
+            && store != loadedListing && store->node(node).type == ShowListing::ListingNode::File) {
+        node = store->node(node).parent;
+    }
+    if (store == statisticsStore && node == statisticsNode
+            && (statisticsWorker || statisticsView->topLevelItemCount() > 0)) {
+        return;
+    }
+    if (statisticsWorker) {
+        statisticsPending = true;
+        return;
+    }
+    statisticsView->clear();
+    statisticsDock->setWindowTitle(tr("Statistics"));
+    statisticsStore = 0;
+    if (!store) {
+        return;
+    }
+    if (store == loadedListing) {
+        statisticsDock->setWindowTitle(tr("Statistics (loading)"));
+        return;
+    }
+    statisticsStore = store;
+    statisticsNode = node;
+
+    // a linked directory is counted in the listing it shares its entries with
+    quint32 contentNode;
+    const ListingStore *contents = store->resolve(node, &contentNode);
+    statisticsWorker = new StatisticsWorker(contents, contentNode);
+    QObject::connect(statisticsWorker, SIGNAL(signalStatisticsFinished()), this, SLOT(slotStatisticsFinished()));
+    statisticsDock->setWindowTitle(tr("Statistics (counting)"));
+    QThreadPool::globalInstance()->start(statisticsWorker);
+}
+
+/// Shows the statistics counted, then looks again if the current directory changed meanwhile.
+void MainWindow::slotStatisticsFinished()
+{
+    StatisticsWorker *finished = statisticsWorker;
+    statisticsWorker = 0;
+    finished->deleteLater();
+
+    const ListingStore *store = statisticsStore;
+    quint32 node = statisticsNode;
+    const ListingStatistics &statistics = *finished->statistics();
+    QTreeWidgetItem *summary = new QTreeWidgetItem(QStringList()
+            << (node == 0 ? QDir::toNativeSeparators(store->sourcePath) : store->name(node)));
+    statisticsItem(summary, tr("Files"), statistics.files(), statistics.bytes());
+    QTreeWidgetItem *directories = new QTreeWidgetItem(summary, QStringList() << tr("Directories"));
+    directories->setText(1, QString::number(statistics.directories()));
+    directories->setTextAlignment(1, Qt::AlignRight | Qt::AlignVCenter);
+
+    QTreeWidgetItem *sizes = new QTreeWidgetItem(QStringList() << tr("File sizes"));
+    for (int b = 0; b < ListingStatistics::BucketCount; ++b) {
+        if (statistics.bucketFiles().at(b) == 0) {
+            continue;
+        }
+        QString label = b == 0 ? tr("empty")
+                : tr("%1 to %2").arg(humanizeBigNums(ListingStatistics::bucketStart(b), 0))
+                  .arg(b + 1 < ListingStatistics::BucketCount
+                       ? humanizeBigNums(ListingStatistics::bucketStart(b + 1), 0) : QString::fromLatin1("..."));
+        statisticsItem(sizes, label, statistics.bucketFiles().at(b), statistics.bucketBytes().at(b));
+    }
+
+    const QVector<ListingStatistics::Extension> &extensionStats = statistics.extensions();
+    QTreeWidgetItem *extensions = new QTreeWidgetItem(QStringList() << tr("Extensions"));
+    for (int i = 0; i < extensionStats.size() && i < STATISTICS_EXTENSIONS; ++i) {
+        const ListingStatistics::Extension &extension = extensionStats.at(i);
+        statisticsItem(extensions, extension.name.isEmpty() ? tr("(none)") : extension.name,
+                       extension.files, extension.bytes);
+    }
+
+    QTreeWidgetItem *depths = new QTreeWidgetItem(QStringList() << tr("Entries by depth"));
+    for (int d = 1; d < statistics.depthEntries().size(); ++d) {
+        QTreeWidgetItem *depth = new QTreeWidgetItem(depths, QStringList() << QString::number(d));
+        depth->setText(1, QString::number(statistics.depthEntries().at(d)));
+        depth->setTextAlignment(1, Qt::AlignRight | Qt::AlignVCenter);
+    }
+
+    statisticsView->addTopLevelItems(QList<QTreeWidgetItem *>() << summary << sizes << extensions << depths);
+    summary->setExpanded(true);
+    sizes->setExpanded(true);
+    extensions->setExpanded(true);
+    statisticsDock->setWindowTitle(tr("Statistics (%1 ms)").arg(finished->nsecs() / 1e6, 0, 'f', 1));
+
+    if (statisticsPending) {
+        statisticsPending = false;
+        slotRefreshStatistics();
+    }
+}
+
+void MainWindow::slotEntryActivated(QTreeWidgetItem *item)
+{
+    if (item->data(0, Qt::UserRole).isNull()) {
+        return;
+    }
+    const ListingStore *store = reinterpret_cast<const ListingStore *>(quintptr(item->data(0, Qt::UserRole).toULongLong()));
+    quint32 node = item->data(0, Qt::UserRole + 1).toUInt();
+    QModelIndex index = dirFileTree->listingModel()->indexOf(store, node);
+    if (!index.isValid()) {
+        return;
+    }
+    for (QModelIndex parent = index.parent(); parent.isValid(); parent = parent.parent()) {
+        dirFileTree->expand(parent);
+    }
+    dirFileTree->setCurrentIndex(index);
+    dirFileTree->scrollTo(index, QAbstractItemView::PositionAtCenter);
+}
+
+void MainWindow::slotFilterToggled(bool on)
+{
+    filterTimer.stop();
+    if (on) {
+        compareAct->setChecked(false);
+        slotStartFilter();
+        return;
+    }
+    if (filterWorker) {
+        filterWorker->postCancelRequest();
+    }
+    ++filterGeneration;
+    filterText.clear();
+    dirFileTree->listingModel()->setFiltering(false);
+    expandListings();
+}
+
+void MainWindow::slotFilterTextEdited()
+{
+    if (filterAct->isChecked()) {
+        filterTimer.start(FILTER_DELAY_MS);
+    }
+}
+
+/// Filters the tree with the search text, refining the last result when it can.
+void MainWindow::slotStartFilter()
+{
+    ShowListing::ListingModel *model = dirFileTree->listingModel();
+    if (filterWorker) {
+        filterWorker->postCancelRequest();
+    }
+    ++filterGeneration;
+    QString text = searchEdit->text().trimmed();
+    if (text.isEmpty()) {
+        filterText.clear();
+        if (model->isFiltering()) {
+            model->setFiltering(false);
+            expandListings();
+        }
+        return;
+    }
+
+    bool refine = model->isFiltering() && !filterText.isEmpty()
+            && SearchIndex::fold(text).contains(SearchIndex::fold(filterText));
+    QList<QVector<quint32> > previous;
+    for (int i = 0; refine && i < model->listingCount(); ++i) {
+        previous.append(model->filterMatches(model->listing(i)));
+    }
+
+    filterWorker = new FilterWorker(model->searchIndex(), filterGeneration, text);
+    for (int i = 0; i < model->listingCount(); ++i) {
+        filterWorker->addListing(model->listing(i), refine ? &previous.at(i) : 0);
+    }
+    model->setFiltering(true);
+    expandListings();
+    filterExpanded = 0;
+    filterText.clear();
+    pendingFilterText = text;
+
+    QObject::connect(filterWorker, SIGNAL(signalMatchesReady(int,const ShowListing::ListingStore*,QVector<quint32>)),
+                     this, SLOT(slotFilterMatches(int,const ShowListing::ListingStore*,QVector<quint32>)));
+    QObject::connect(filterWorker, SIGNAL(signalFilterFinished(int,int,bool)),
+                     this, SLOT(slotFilterFinished(int,int,bool)));
+    QThreadPool::globalInstance()->start(filterWorker);
+}
+
+void MainWindow::slotFilterMatches(int generation, const ShowListing::ListingStore *store, const QVector<quint32> &nodes)
+{
+    if (generation != filterGeneration) {
+        return;
+    }
+    dirFileTree->listingModel()->addFilterMatches(store, nodes);
+    revealEntries(store, nodes);
+}
+
+void MainWindow::slotFilterFinished(int generation, int total, bool cancelled)
+{
+    FilterWorker *finished = qobject_cast<FilterWorker *>(sender());
+    if (finished == filterWorker) {
+        filterWorker = 0;
+    }
+    finished->deleteLater();
+    if (generation != filterGeneration || cancelled) {
+        return;
+    }
+    filterText = pendingFilterText;
+    statusBar()->showMessage(tr("%1 entries match the filter \"%2\"").arg(total).arg(filterText));
+}
+
+/// Shows what changed between the two lists loaded last, over the tree.
+void MainWindow::slotCompareToggled(bool on)
+{
+    ShowListing::ListingModel *model = dirFileTree->listingModel();
+    if (!on) {
+        // a comparison still running is dropped when it finishes
+        if (diffWorker) {
+            diffWorker = 0;
+            statusBar()->clearMessage();
+        }
+        model->setFiltering(false);
+        expandListings();
+        return;
+    }
+    QVector<const ListingStore *> finished;
+    for (int i = 0; i < model->listingCount(); ++i) {
+        if (model->listing(i) != loadedListing) {
+            finished.append(model->listing(i));
+        }
+    }
+    if (finished.size() < 2) {
+        statusBar()->showMessage(tr("Load two versions of a list to compare them"), 3000);
+        // the tree was left alone, there is nothing to undo
+        compareAct->blockSignals(true);
+        compareAct->setChecked(false);
+        compareAct->blockSignals(false);
+        return;
+    }
+    filterAct->setChecked(false);
+
+    diffWorker = new DiffWorker(finished.at(finished.size() - 2), finished.last());
+    QObject::connect(diffWorker, SIGNAL(signalDiffFinished()), this, SLOT(slotDiffFinished()));
+    statusBar()->showMessage(tr("Comparing lists..."));
+    QThreadPool::globalInstance()->start(diffWorker);
+}
+
+/// Shows the changes found by the comparison, unless it was turned off meanwhile.
+void MainWindow::slotDiffFinished()
+{
+    DiffWorker *finished = qobject_cast<DiffWorker *>(sender());
+    finished->deleteLater();
+    if (finished != diffWorker) {
+        return;
+    }
+    diffWorker = 0;
+
+    ShowListing::ListingModel *model = dirFileTree->listingModel();
+    const ListingStore *oldStore = finished->oldListing();
+    const ListingStore *newStore = finished->newListing();
+    const ListingDiff &diff = *finished->diff();
+    QVector<quint32> changed;
+    for (int i = 0; i < diff.changed().size(); ++i) {
+        changed.append(diff.changed().at(i).newNode);
+    }
+    QVector<quint32> shown = diff.added() + changed;
+    std::sort(shown.begin(), shown.end());
+
+    model->setFiltering(true);
+    model->addMarks(oldStore, diff.removed(), ShowListing::ListingModel::RemovedMark);
+    model->addMarks(newStore, diff.added(), ShowListing::ListingModel::AddedMark);
+    model->addMarks(newStore, changed, ShowListing::ListingModel::ChangedMark);
+    model->addFilterMatches(oldStore, diff.removed());
+    model->addFilterMatches(newStore, shown);
+    expandListings();
+    filterExpanded = 0;
+    revealEntries(oldStore, diff.removed());
+    revealEntries(newStore, shown);
+    statusBar()->showMessage(tr("%1 added, %2 removed, %3 changed, %4 entries identical (%5 ms)")
+                             .arg(diff.added().size()).arg(diff.removed().size())
+                             .arg(diff.changed().size()).arg(diff.identical())
+                             .arg(finished->nsecs() / 1e6, 0, 'f', 1));
+}
+
+/// Expands the directories leading to \a nodes, up to FILTER_EXPAND_LIMIT entries in all.
+void MainWindow::revealEntries(const ListingStore *store, const QVector<quint32> &nodes)
+{
+    ShowListing::ListingModel *model = dirFileTree->listingModel();
+    for (int i = 0; i < nodes.size() && filterExpanded < FILTER_EXPAND_LIMIT; ++i, ++filterExpanded) {
+        QModelIndex index = model->indexOf(store, nodes.at(i));
+        for (QModelIndex parent = index.parent(); parent.isValid(); parent = parent.parent()) {
+            dirFileTree->expand(parent);
+        }
+    }
+}
+
+void MainWindow::expandListings()
+{
+    ShowListing::ListingModel *model = dirFileTree->listingModel();
+    for (int i = 0; i < model->listingCount(); ++i) {
+        dirFileTree->expand(model->index(i, 0));
+    }
+}
+
+/// Exports the current list or folder, the folder of the current file.
 void MainWindow::onExport()
 {
+    if (exportWorker) {
+        statusBar()->showMessage(tr("An export is still running"), 2000);
+        return;
+    }
+    ShowListing::ListingModel *model = dirFileTree->listingModel();
+    QModelIndex index = dirFileTree->currentIndex().sibling(dirFileTree->currentIndex().row(), 0);
+    const ListingStore *store = 0;
+    quint32 node = 0;
+    if (!model->entryAt(index, &store, &node)) {
+        statusBar()->showMessage(tr("Select a list or a folder to export"), 2000);
+        return;
+    }
+    if (store->node(node).type == ShowListing::ListingNode::File) {
+        index = index.parent();
+        model->entryAt(index, &store, &node);
+    }
+    if (store == loadedListing) {
+        statusBar()->showMessage(tr("The list is still loading"), 2000);
+        return;
+    }
+
     QString fileName =
             QFileDialog::getSaveFileName(this, tr("ShowListing - Export Filelisting"),
                                          lastOpenPath,
-                                         tr("Text Files (*.txt)"));
+                                         tr("CSV Files (*.csv *.csv.lz4);;JSON Files (*.json *.json.lz4);;Text Files (*.txt *.txt.lz4)"));
     if (fileName.isEmpty())
         return;
 
-    QFile file(fileName);
-    if (!file.open(QFile::WriteOnly | QFile::Text)) {
-        QMessageBox::warning(this, tr("ShowListing"),
-                             tr("Cannot write file %1:\n%2.")
-                             .arg(fileName)
-                             .arg(file.errorString()));
-        return;
+    // the path of the parent, the exported entry adds its own name
+    QString parentPath;
+    if (node != 0) {
+        parentPath = model->data(index, ShowListing::ListingModel::PathRole).toString();
+        parentPath.truncate(qMax(0, parentPath.lastIndexOf(QDir::separator())));
     }
+    exportWorker = new ExportWorker(fileName, ExportWorker::formatFor(fileName), store, node, parentPath);
+    QObject::connect(exportWorker, SIGNAL(signalExportFinished(int,QString)),
+                     this, SLOT(slotExportFinished(int,QString)));
+    exportTimer.start();
+    statusBar()->showMessage(tr("Exporting to %1...").arg(QDir::toNativeSeparators(fileName)));
+    QThreadPool::globalInstance()->start(exportWorker);
+}
 
-    //if (dirFileTree->write(&file))
-        //statusBar()->showMessage(tr("File saved"), 2000);
+void MainWindow::slotExportFinished(int status, const QString &message)
+{
+    ExportWorker *finished = exportWorker;
+    exportWorker = 0;
+    finished->deleteLater();
+    if (status == ExportWorker::Failed) {
+        statusBar()->clearMessage();
+        QMessageBox::warning(this, tr("ShowListing"), message);
+    } else if (status == ExportWorker::Finished) {
+        statusBar()->showMessage(tr("Exported %1 entries in %2 s")
+                                 .arg(finished->rows())
+                                 .arg(exportTimer.nsecsElapsed() / 1e9, 0, 'f', 2));
+    }
 }
 
 void MainWindow::about()
@@ -240,6 +838,14 @@ void MainWindow::createActions()
     exportAct->setShortcuts(QKeySequence::SaveAs);
     connect(exportAct, SIGNAL(triggered()), this, SLOT(onExport()));
 
+    // only lists loaded afterwards are affected, so it is a setting rather than a command
+    shareAct = new QAction(tr("&Share identical subtrees"), this);
+    shareAct->setCheckable(true);
+    shareAct->setToolTip(tr("Store folders found unchanged in a list loaded earlier only once.\n"
+                            "Such lists are always parsed rather than read from a snapshot."));
+    QSettings settings("ShowListing", "ShowListing 1");
+    shareAct->setChecked(settings.value("shareSubtrees", false).toBool());
+
     exitAct = new QAction(tr("&Quit"), this);
     exitAct->setShortcuts(QKeySequence::Quit);
     connect(exitAct, SIGNAL(triggered()), this, SLOT(close()));
@@ -252,22 +858,136 @@ void MainWindow::createMenus()
 {
     fileMenu = menuBar()->addMenu(tr("&File"));
     fileMenu->addAction(openAct);
-#if 0
+    fileMenu->addAction(shareAct);
     fileMenu->addAction(exportAct);
-#endif
     fileMenu->addAction(exitAct);
 
+    viewMenu = menuBar()->addMenu(tr("&View"));
+    viewMenu->addAction(searchDock->toggleViewAction());
+    viewMenu->addAction(largestDock->toggleViewAction());
+    viewMenu->addAction(duplicatesDock->toggleViewAction());
+    viewMenu->addAction(statisticsDock->toggleViewAction());
+    viewMenu->addAction(filterAct);
+    viewMenu->addAction(compareAct);
+
     menuBar()->addSeparator();
 
     helpMenu = menuBar()->addMenu(tr("&Help"));
     helpMenu->addAction(aboutAct);
 }
 
+void MainWindow::createSearch()
+{
+    searchEdit = new QLineEdit;
+    searchEdit->setPlaceholderText(tr("Search names"));
+    connect(searchEdit, SIGNAL(returnPressed()), this, SLOT(slotSearch()));
+    connect(searchEdit, SIGNAL(textEdited(QString)), this, SLOT(slotFilterTextEdited()));
+
+    filterAct = new QAction(tr("&Filter tree"), this);
+    filterAct->setCheckable(true);
+    filterAct->setToolTip(tr("Only show entries whose name contains the search text"));
+    connect(filterAct, SIGNAL(toggled(bool)), this, SLOT(slotFilterToggled(bool)));
+    filterTimer.setSingleShot(true);
+    connect(&filterTimer, SIGNAL(timeout()), this, SLOT(slotStartFilter()));
+
+    compareAct = new QAction(tr("&Compare lists"), this);
+    compareAct->setCheckable(true);
+    compareAct->setToolTip(tr("Only show what was added, removed or changed between the two lists loaded last"));
+    connect(compareAct, SIGNAL(toggled(bool)), this, SLOT(slotCompareToggled(bool)));
+
+    QToolBar *searchBar = addToolBar(tr("Search"));
+    searchBar->setObjectName("searchToolBar");
+    searchBar->addWidget(searchEdit);
+    searchBar->addAction(filterAct);
+    searchBar->addAction(compareAct);
+
+    searchResults = new QTreeWidget;
+    searchResults->setColumnCount(3);
+    searchResults->setHeaderLabels(QStringList() << tr("Name") << tr("Size") << tr("Path"));
+    searchResults->setRootIsDecorated(false);
+    searchResults->setUniformRowHeights(true);
+    connect(searchResults, SIGNAL(itemActivated(QTreeWidgetItem*,int)),
+            this, SLOT(slotEntryActivated(QTreeWidgetItem*)));
+
+    searchDock = new QDockWidget(tr("Search results"), this);
+    searchDock->setObjectName("searchDock");
+    searchDock->setWidget(searchResults);
+    addDockWidget(Qt::BottomDockWidgetArea, searchDock);
+    searchDock->hide();
+}
+
+void MainWindow::createLargest()
+{
+    largestView = new QTreeWidget;
+    largestView->setColumnCount(3);
+    largestView->setHeaderLabels(QStringList() << tr("Name") << tr("Size") << tr("Path"));
+    largestView->setUniformRowHeights(true);
+    connect(largestView, SIGNAL(itemActivated(QTreeWidgetItem*,int)),
+            this, SLOT(slotEntryActivated(QTreeWidgetItem*)));
+
+    largestDock = new QDockWidget(tr("Largest items"), this);
+    largestDock->setObjectName("largestDock");
+    largestDock->setWidget(largestView);
+    addDockWidget(Qt::RightDockWidgetArea, largestDock);
+    largestDock->hide();
+    connect(largestDock, SIGNAL(visibilityChanged(bool)), this, SLOT(slotRefreshLargest()));
+}
+
+void MainWindow::createDuplicates()
+{
+    duplicatesView = new QTreeWidget;
+    duplicatesView->setColumnCount(3);
+    duplicatesView->setHeaderLabels(QStringList() << tr("Name") << tr("Size") << tr("Path"));
+    duplicatesView->setUniformRowHeights(true);
+    connect(duplicatesView, SIGNAL(itemActivated(QTreeWidgetItem*,int)),
+            this, SLOT(slotEntryActivated(QTreeWidgetItem*)));
+
+    duplicatesDock = new QDockWidget(tr("Duplicates"), this);
+    duplicatesDock->setObjectName("duplicatesDock");
+    duplicatesDock->setWidget(duplicatesView);
+    addDockWidget(Qt::RightDockWidgetArea, duplicatesDock);
+    duplicatesDock->hide();
+    connect(duplicatesDock, SIGNAL(visibilityChanged(bool)), this, SLOT(slotRefreshDuplicates()));
+}
+
+void MainWindow::createStatistics()
+{
+    statisticsView = new QTreeWidget;
+    statisticsView->setColumnCount(3);
+    statisticsView->setHeaderLabels(QStringList() << QString() << tr("Entries") << tr("Size"));
+    statisticsView->setUniformRowHeights(true);
+
+    statisticsDock = new QDockWidget(tr("Statistics"), this);
+    statisticsDock->setObjectName("statisticsDock");
+    statisticsDock->setWidget(statisticsView);
+    addDockWidget(Qt::RightDockWidgetArea, statisticsDock);
+    statisticsDock->hide();
+    connect(statisticsDock, SIGNAL(visibilityChanged(bool)), this, SLOT(slotRefreshStatistics()));
+    statisticsTimer.setSingleShot(true);
+    statisticsTimer.setInterval(200);
+    connect(&statisticsTimer, SIGNAL(timeout()), this, SLOT(slotRefreshStatistics()));
+    connect(dirFileTree->selectionModel(), SIGNAL(currentChanged(QModelIndex,QModelIndex)),
+            &statisticsTimer, SLOT(start()));
+}
+
 void MainWindow::closeEvent(QCloseEvent *event)
 {
+    if (filterWorker) {
+        filterWorker->postCancelRequest();
+    }
+    if (worker) {
+        pendingPaths.clear();
+        worker->postCancelRequest();
+    }
+    if (exportWorker) {
+        exportWorker->postCancelRequest();
+    }
+    QThreadPool::globalInstance()->waitForDone();
+
     QSettings settings("ShowListing", "ShowListing 1");
     settings.setValue("geometry", saveGeometry());
     settings.setValue("windowState", saveState());
+    settings.setValue("shareSubtrees", shareAct->isChecked());
     if ( !isMaximized() ) {
             settings.setValue( "size", size() );
     }
@@ -1,18 +1,29 @@
 #ifndef MAINWINDOW_H
 #define MAINWINDOW_H
 
+#include <QElapsedTimer>
 #include <QMainWindow>
 #include <QStatusBar>
-#include <QReadWriteLock>
+#include <QStringList>
 #include <QTimer>
-#include <QFutureWatcher>
+#include <QVector>
 
 namespace ShowListing{
 class DirFileTree;
-class AdcListReader;
+class ListingStore;
 }
+class DiffWorker;
+class DuplicateWorker;
+class ExportWorker;
+class FilterWorker;
+class LargestWorker;
+class LoadPathWorker;
+class StatisticsWorker;
 QT_BEGIN_NAMESPACE
+class QDockWidget;
+class QLineEdit;
 class QProgressDialog;
+class QTreeWidget;
 class QTreeWidgetItem;
 QT_END_NAMESPACE
 
@@ -31,10 +42,27 @@ public slots:
     void about();
 
 private slots:
-    void slotFutureWatchNotify();
-    void slotBroadcastProgressReceived(qint64 pos);
+    void slotSubtreesReady(const QVector<quint32> &ids, quint64 totalSize);
+    void slotLoadRestarted();
+    void slotLoadFinished(int status, const QString &message);
     void slotOpenPathCancelled();
     void slotTimer();
+    void slotSearch();
+    void slotEntryActivated(QTreeWidgetItem *item);
+    void slotRefreshLargest();
+    void slotLargestFinished();
+    void slotRefreshDuplicates();
+    void slotDuplicatesFinished();
+    void slotRefreshStatistics();
+    void slotStatisticsFinished();
+    void slotFilterToggled(bool on);
+    void slotFilterTextEdited();
+    void slotStartFilter();
+    void slotFilterMatches(int generation, const ShowListing::ListingStore *store, const QVector<quint32> &nodes);
+    void slotFilterFinished(int generation, int total, bool cancelled);
+    void slotCompareToggled(bool on);
+    void slotDiffFinished();
+    void slotExportFinished(int status, const QString &message);
 
 protected:
     virtual void closeEvent(QCloseEvent *);
@@ -46,28 +74,71 @@ protected:
 private:
     void createActions();
     void createMenus();
+    void createSearch();
+    void createLargest();
+    void createDuplicates();
+    void createStatistics();
+    QTreeWidgetItem *entryItem(const ShowListing::ListingStore *store, quint32 node,
+                               const ShowListing::ListingStore *listing = 0) const;
+    void expandListings();
+    void revealEntries(const ShowListing::ListingStore *store, const QVector<quint32> &nodes);
+    void startLoad(const QString& fileName);
+    QString loadStatsLog() const;
 
     ShowListing::DirFileTree *dirFileTree;
 
     QApplication *app;
     QMenu *fileMenu;
+    QMenu *viewMenu;
     QMenu *helpMenu;
     QAction *openAct;
+    QAction *shareAct;
     QAction *exportAct;
     QAction *exitAct;
     QAction *aboutAct;
 
+    QLineEdit *searchEdit;
+    QDockWidget *searchDock;
+    QTreeWidget *searchResults;
+    QAction *filterAct;
+    QAction *compareAct;
+    QDockWidget *largestDock;
+    QTreeWidget *largestView;
+    QDockWidget *duplicatesDock;
+    QTreeWidget *duplicatesView;
+    QDockWidget *statisticsDock;
+    QTreeWidget *statisticsView;
+    QTimer statisticsTimer;     // waits for the cursor to settle
+    const ShowListing::ListingStore *statisticsStore;
+    quint32 statisticsNode;     // what statisticsView shows, or statisticsWorker counts
+    StatisticsWorker *statisticsWorker;
+    bool statisticsPending;     // the current directory changed while statisticsWorker ran
+
+    QTimer filterTimer;         // debounces typing in filter mode
+    FilterWorker *filterWorker;
+    int filterGeneration;
+    int filterExpanded;         // matches revealed so far by the current filter or comparison
+    QString filterText;         // text of the last complete filter, if any
+    QString pendingFilterText;
+
     QString lastOpenPath;
     QString lastOpenFilePath;
 
     QTimer timer;
+    QElapsedTimer loadTimer;
+    qint64 insertNsecs;     // spent publishing the list being loaded
     QProgressDialog *progress;
-    QReadWriteLock lock_progressValue;
-    qint64 progressValue;
-    ShowListing::AdcListReader *listReader;
-    QIODevice *source;
-    QTreeWidgetItem *insertedRow;
-    QFutureWatcher<void> *watcher;
+    LoadPathWorker *worker;
+    ShowListing::ListingStore *loadedListing;
+    QStringList pendingPaths;
+
+    ExportWorker *exportWorker;
+    QElapsedTimer exportTimer;
+    DiffWorker *diffWorker;     // comparison running for compareAct, if any
+    LargestWorker *largestWorker;
+    bool largestPending;        // the lists changed while largestWorker ran
+    DuplicateWorker *duplicateWorker;
+    bool duplicatesPending;     // the lists changed while duplicateWorker ran
 };
 
 #endif
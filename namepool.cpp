@@ -0,0 +1,141 @@
+#include <QMutexLocker>
+
+#include <string.h>
+
+#include "namepool.h"
+
+using ShowListing::NamePool;
+using ShowListing::NameCache;
+
+namespace {
+
+const int INITIAL_TABLE_SIZE = 1 << 10;
+
+}
+
+NamePool::NamePool()
+{
+    for (int i = 0; i < ShardCount; ++i) {
+        _shards[i].table.fill(0, INITIAL_TABLE_SIZE);
+    }
+}
+
+NamePool::~NamePool()
+{
+}
+
+quint32 NamePool::hash(const char *utf8, int len)
+{
+    // FNV-1a; names are short, and the final mix spreads the shard bits
+    quint32 h = 2166136261U;
+    for (int i = 0; i < len; ++i) {
+        h ^= uchar(utf8[i]);
+        h *= 16777619U;
+    }
+    h ^= h >> 15;
+    h *= 0x2c1b3c6dU;
+    h ^= h >> 12;
+    return h;
+}
+
+quint32 NamePool::intern(const char *utf8, int len)
+{
+    return intern(utf8, len, hash(utf8, len));
+}
+
+quint32 NamePool::intern(const char *utf8, int len, quint32 hash)
+{
+    int s = int(hash >> LocalBits);
+    Shard &shard = _shards[s];
+    QMutexLocker locker(&shard.mutex);
+
+    quint32 mask = quint32(shard.table.size() - 1);
+    quint32 slot = hash & mask;
+    for (;;) {
+        quint32 entry = shard.table.at(slot);
+        if (entry == 0) {
+            break;
+        }
+        quint32 local = entry - 1;
+        if (shard.hashes.at(local) == hash) {
+            quint32 offset = shard.offsets.at(local);
+            if (shard.strings.length(offset) == len && memcmp(shard.strings.data(offset), utf8, len) == 0) {
+                return makeId(s, local);
+            }
+        }
+        slot = (slot + 1) & mask;
+    }
+
+    quint32 local = shard.offsets.append(shard.strings.add(utf8, len));
+    Q_ASSERT_X(local < (1U << LocalBits), "NamePool::intern()", "too many distinct names");
+    shard.hashes.append(hash);
+    shard.table[slot] = local + 1;
+    if (shard.offsets.size() * 2 > quint32(shard.table.size())) {
+        grow(shard);
+    }
+    return makeId(s, local);
+}
+
+void NamePool::grow(Shard &s)
+{
+    QVector<quint32> table(s.table.size() * 2, 0);
+    quint32 mask = quint32(table.size() - 1);
+    for (quint32 local = 0; local < s.offsets.size(); ++local) {
+        quint32 slot = s.hashes.at(local) & mask;
+        while (table.at(slot) != 0) {
+            slot = (slot + 1) & mask;
+        }
+        table[slot] = local + 1;
+    }
+    s.table.swap(table);
+}
+
+quint32 NamePool::shardCount(int s) const
+{
+    QMutexLocker locker(&_shards[s].mutex);
+    return _shards[s].offsets.size();
+}
+
+quint32 NamePool::count() const
+{
+    quint32 total = 0;
+    for (int s = 0; s < ShardCount; ++s) {
+        total += shardCount(s);
+    }
+    return total;
+}
+
+qint64 NamePool::memoryUsage() const
+{
+    qint64 total = 0;
+    for (int s = 0; s < ShardCount; ++s) {
+        const Shard &shard = _shards[s];
+        QMutexLocker locker(&shard.mutex);
+        total += shard.strings.capacityBytes() + shard.offsets.capacityBytes()
+                + shard.hashes.capacityBytes() + qint64(shard.table.size()) * sizeof(quint32);
+    }
+    return total;
+}
+
+NameCache::NameCache(NamePool *pool)
+    : _pool(pool)
+{
+    Slot empty = { 0, 0 };
+    _slots.fill(empty, 1 << CacheBits);
+}
+
+quint32 NameCache::intern(const char *utf8, int len)
+{
+    quint32 h = NamePool::hash(utf8, len);
+    Slot &slot = _slots[h & ((1 << CacheBits) - 1)];
+    if (slot.id != 0 && slot.hash == h) {
+        quint32 id = slot.id - 1;
+        if (_pool->length(id) == len && memcmp(_pool->data(id), utf8, len) == 0) {
+            return id;
+        }
+    }
+    quint32 id = _pool->intern(utf8, len, h);
+    slot.hash = h;
+    slot.id = id + 1;
+    return id;
+}
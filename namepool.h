@@ -0,0 +1,92 @@
+#ifndef NAMEPOOL_H
+#define NAMEPOOL_H
+
+#include <QMutex>
+#include <QString>
+#include <QVector>
+
+#include "chunkedarray.h"
+#include "stringarena.h"
+
+namespace ShowListing{
+
+/// Interning pool for file and directory names, shared by every listing.
+/** Each distinct name is stored once as UTF-8 and identified by a 32-bit
+ * id. The pool is split in shards selected by hash, each with its own
+ * lock, so that several parsers can intern at the same time. Resolving an
+ * id takes no lock: ids are only handed out once their bytes are written.
+ **/
+class NamePool
+{
+public:
+    enum { ShardBits = 6, ShardCount = 1 << ShardBits, LocalBits = 32 - ShardBits };
+
+    NamePool();
+    ~NamePool();
+
+    quint32 intern(const char *utf8, int len);
+    quint32 intern(const char *utf8, int len, quint32 hash);
+
+    const char *data(quint32 id) const { return shard(id).strings.data(shard(id).offsets.at(local(id))); }
+    int length(quint32 id) const { return shard(id).strings.length(shard(id).offsets.at(local(id))); }
+    QString string(quint32 id) const { return QString::fromUtf8(data(id), length(id)); }
+    /// hash() of name \a id, which only depends on its bytes.
+    quint32 nameHash(quint32 id) const { return shard(id).hashes.at(local(id)); }
+
+    /// Number of distinct names.
+    quint32 count() const;
+    /// Names in shard \a s have ids (s << LocalBits) + [0, shardCount(s)).
+    quint32 shardCount(int s) const;
+    qint64 memoryUsage() const;
+
+    static quint32 hash(const char *utf8, int len);
+    static quint32 makeId(int s, quint32 local) { return (quint32(s) << LocalBits) | local; }
+
+private:
+    NamePool(const NamePool &);
+    NamePool &operator=(const NamePool &);
+
+    struct Shard
+    {
+        mutable QMutex mutex;
+        StringArena strings;
+        ChunkedArray<quint32, 12> offsets;  // local id -> offset in strings
+        ChunkedArray<quint32, 12> hashes;   // local id -> hash, for rehashing
+        QVector<quint32> table;             // open addressing, local id + 1, 0 when empty
+    };
+
+    static quint32 local(quint32 id) { return id & ((1U << LocalBits) - 1); }
+    const Shard &shard(quint32 id) const { return _shards[id >> LocalBits]; }
+    static void grow(Shard &s);
+
+    Shard _shards[ShardCount];
+};
+
+/// Small direct-mapped cache in front of a NamePool, for one thread.
+/** Repeated names ("Sample", "CD1", "cover.jpg"...) are resolved without
+ * touching the pool's locks.
+ **/
+class NameCache
+{
+public:
+    explicit NameCache(NamePool *pool);
+
+    NamePool *pool() const { return _pool; }
+    quint32 intern(const char *utf8, int len);
+
+private:
+    enum { CacheBits = 12 };
+
+    struct Slot
+    {
+        quint32 hash;
+        quint32 id;     // id + 1, 0 when empty
+    };
+
+    NamePool *_pool;
+    QVector<Slot> _slots;
+};
+
+}
+
+#endif // NAMEPOOL_H
@@ -0,0 +1,84 @@
+#include <QAtomicInt>
+#include <QRunnable>
+#include <QThread>
+#include <QThreadPool>
+
+#include "parallelwork.h"
+#include "listingstore.h"
+
+using ShowListing::ListingNode;
+using ShowListing::ListingStore;
+using ShowListing::NodeRange;
+using ShowListing::ParallelWork;
+
+namespace {
+
+/// Does items [0, count) of \a work, claiming them one at a time.
+class Task : public QRunnable
+{
+public:
+    Task(ParallelWork *work, int count, QAtomicInt *next)
+        : work(work), count(count), next(next) {}
+
+    void run()
+    {
+        int i;
+        while ((i = next->fetchAndAddRelaxed(1)) < count) {
+            work->process(i);
+        }
+    }
+
+private:
+    ParallelWork *work;
+    int count;
+    QAtomicInt *next;
+};
+
+}
+
+void ParallelWork::run(int count, int threads)
+{
+    threads = qMin(threads, count);
+    if (threads <= 1) {
+        for (int i = 0; i < count; ++i) {
+            process(i);
+        }
+        return;
+    }
+    QThreadPool pool;
+    pool.setMaxThreadCount(threads);
+    QAtomicInt next(0);
+    for (int i = 0; i < threads; ++i) {
+        pool.start(new Task(this, count, &next));
+    }
+    pool.waitForDone();
+}
+
+int ParallelWork::threadCount(int threads, quint64 nodes)
+{
+    if (threads > 0) {
+        return threads;
+    }
+    return nodes > quint64(RangeSize) ? QThread::idealThreadCount() : 1;
+}
+
+void ParallelWork::addRanges(quint32 begin, quint32 end, QVector<NodeRange> *ranges)
+{
+    for (; begin < end; begin += RangeSize) {
+        NodeRange range = { begin, qMin(end, begin + quint32(RangeSize)) };
+        ranges->append(range);
+    }
+}
+
+quint64 ParallelWork::addTopLevelRanges(const ListingStore &store, QVector<NodeRange> *ranges)
+{
+    quint64 nodes = 0;
+    const ListingNode &root = store.node(0);
+    for (quint32 row = 0; row < root.childCount; ++row) {
+        quint32 top = store.child(0, row);
+        quint32 end = store.node(top).subtreeEnd;
+        nodes += end - top;
+        addRanges(top, end, ranges);
+    }
+    return nodes;
+}
@@ -0,0 +1,50 @@
+#ifndef PARALLELWORK_H
+#define PARALLELWORK_H
+
+#include <QVector>
+
+namespace ShowListing{
+
+class ListingStore;
+
+/// Nodes [begin, end) of a node table.
+struct NodeRange
+{
+    quint32 begin;
+    quint32 end;
+};
+
+/// Items of work done on a private thread pool, claimed one at a time.
+/** Each thread takes the next item left until none is, so that uneven
+ * items even out without any planning. Scans of finished listings cut the
+ * node table into ranges of at most RangeSize nodes with addRanges() or
+ * addTopLevelRanges(), and make each range an item.
+ **/
+class ParallelWork
+{
+public:
+    /// Nodes in one range at most, and below which no thread is started.
+    enum { RangeSize = 1 << 18 };
+
+    virtual ~ParallelWork() {}
+
+    /// Does item \a i, concurrently with other items.
+    virtual void process(int i) = 0;
+
+    /// Does items [0, count) on up to \a threads threads, in this thread for a single one.
+    void run(int count, int threads);
+
+    /// \a threads, or for 0 the ideal thread count above RangeSize nodes and 1 otherwise.
+    static int threadCount(int threads, quint64 nodes);
+    /// Appends [begin, end) to \a ranges, cut up into ranges of at most RangeSize nodes.
+    static void addRanges(quint32 begin, quint32 end, QVector<NodeRange> *ranges);
+    /// Appends the top-level subtrees of \a store and returns their node count.
+    /** Every top-level subtree is contiguous; nodes left behind by a restart
+     * of the reader are skipped this way.
+     **/
+    static quint64 addTopLevelRanges(const ListingStore &store, QVector<NodeRange> *ranges);
+};
+
+}
+
+#endif // PARALLELWORK_H
@@ -1,17 +1,94 @@
 #include "qualz4file.h"
 
-#include <QFile>
+#include <QElapsedTimer>
+#include <QRunnable>
+#include <QThread>
 #include <QtEndian>
+
+#include <string.h>
+
 #include "lz4.h"
 
+namespace {
+
+const int HEADER_SIZE = 8;
+const int INPUT_CHUNK_SIZE = 256 << 10;
+// LZ4 matches reach at most 64 KiB back
+const int WINDOW_SIZE = 64 << 10;
+const int OUTPUT_CHUNK_SIZE = 1 << 20;
+const int MIN_MATCH = 4;
+
+const quint32 FRAME_MAGIC = 0x184D2204;
+const quint32 SKIPPABLE_MAGIC = 0x184D2A50;   // low 4 bits are free
+const quint32 STORED_BLOCK = 0x80000000;
+// read-ahead batches hold at least this much output, and a block per thread
+const qint64 BATCH_OUTPUT_SIZE = 16 << 20;
+
+}
+
+/// Decompresses the independent blocks of a read-ahead batch.
+/** Every task keeps claiming the next block until none are left. Block
+ * checksums are verified here too, for linked blocks as well.
+ **/
+class QuaLz4File::BlockTask : public QRunnable
+{
+public:
+    BlockTask(FrameBlock *blocks, int count, QAtomicInt *next) : blocks(blocks), count(count), next(next) {}
+
+    void run()
+    {
+        int i;
+        while ((i = next->fetchAndAddRelaxed(1)) < count) {
+            process(blocks[i]);
+        }
+    }
+
+private:
+    static void process(FrameBlock &b)
+    {
+        if (b.endsFrame || b.corrupt) {
+            return;
+        }
+        int csize = b.compressed.size();
+        if (b.hasChecksum && Xxh32::hash(b.compressed.constData(), csize) != b.checksum) {
+            b.corrupt = true;
+            return;
+        }
+        if (b.linked) {
+            return;
+        }
+        if (b.stored) {
+            b.output = b.compressed;
+            b.size = csize;
+            return;
+        }
+        if (b.output.size() < b.blockMax) {
+            b.output.resize(b.blockMax);
+        }
+        b.size = LZ4_decompress_safe(b.compressed.constData(), b.output.data(), csize, b.blockMax);
+        b.corrupt = b.size < 0;
+    }
+
+    FrameBlock *blocks;
+    int count;
+    QAtomicInt *next;
+};
+
 QuaLz4File::QuaLz4File(QObject *parent) :
-    QBuffer(parent), _compressed_size(-1)
+    QIODevice(parent), _compressed_size(-1), _uncompressed_size(-1), _format(BlockFormat),
+    _fileNsecs(0), _progress(0), _batchCount(0), _aheadCount(0)
 {
 }
 
 QuaLz4File::QuaLz4File(const QString& fileName, QObject *parent) :
-    QBuffer(parent), _filename(fileName), _compressed_size(-1)
+    QIODevice(parent), _filename(fileName), _compressed_size(-1), _uncompressed_size(-1), _format(BlockFormat),
+    _fileNsecs(0), _progress(0), _batchCount(0), _aheadCount(0)
+{
+}
+
+QuaLz4File::~QuaLz4File()
 {
+    close();
 }
 
 void QuaLz4File::setFileName(const QString &fileName)
@@ -26,40 +103,582 @@ QString QuaLz4File::fileName() const
 
 bool QuaLz4File::open(OpenMode openMode)
 {
-    if(_filename.isEmpty()) { return false; }
-    QFile file(_filename);
-    if (!file.open(QFile::ReadOnly)) { return false; }
-    qint64 assumedcompressed_size = file.size() - 8; if(assumedcompressed_size < 4)  { return false; }
-    QByteArray carray = file.readAll();
-    qint32 declaredUncompressedSize = qFromLittleEndian<qint32>(*reinterpret_cast<const qint32*>(carray.constData()));
-    carray.remove(0, 4);
-    qint32 declaredCompressedSize = qFromLittleEndian<qint32>(*reinterpret_cast<const qint32*>(carray.constData()));
-    carray.remove(0, 4);
-    if (declaredCompressedSize == 0 || declaredUncompressedSize == 0 || declaredCompressedSize > assumedcompressed_size) { return false; }
+    if(_filename.isEmpty() || (openMode & WriteOnly)) { return false; }
+    _file.setFileName(_filename);
+    if (!_file.open(QFile::ReadOnly)) { return false; }
+    _fileNsecs = 0;
+    qint64 assumedcompressed_size = _file.size() - HEADER_SIZE;
+    uchar header[HEADER_SIZE];
+    if (_file.read(reinterpret_cast<char *>(header), 4) != 4) {
+        _file.close();
+        return false;
+    }
+
+    quint32 magic = qFromLittleEndian<quint32>(header);
+    if (magic == FRAME_MAGIC || (magic & 0xFFFFFFF0) == SKIPPABLE_MAGIC) {
+        _format = FrameFormat;
+        _compressed_size = _file.size();
+        _pool.setMaxThreadCount(QThread::idealThreadCount());
+        if (!_file.seek(0) || !scanFrames(&_uncompressed_size) || !restart()) {
+            close();
+            return false;
+        }
+        return QIODevice::open(openMode | Unbuffered);
+    }
+
+    _format = BlockFormat;
+    if (assumedcompressed_size < 4 || _file.read(reinterpret_cast<char *>(header) + 4, 4) != 4) {
+        _file.close();
+        return false;
+    }
+    qint32 declaredUncompressedSize = qFromLittleEndian<qint32>(header);
+    qint32 declaredCompressedSize = qFromLittleEndian<qint32>(header + 4);
+    if (declaredCompressedSize <= 0 || declaredUncompressedSize <= 0 || declaredCompressedSize > assumedcompressed_size) {
+        _file.close();
+        return false;
+    }
     _compressed_size = declaredCompressedSize;  // assume trailing data is garbage
-#if 1
-    // size check for our specific purposes
-    if (declaredUncompressedSize > (1LL << 30)) { _compressed_size = -1; return false; }
-#endif
-
-    // assume it is a simple copy if sizes match (uncompressible)
-    if (declaredCompressedSize == declaredUncompressedSize) {
-        carray.resize(declaredCompressedSize);
-        setData(carray);
-        return QBuffer::open(openMode);
-    }
-    carray.resize(declaredCompressedSize);
-    QByteArray darray;
-    darray.reserve(declaredUncompressedSize);
-
-    int const decSize = LZ4_decompress_safe(carray.data(), darray.data(), declaredCompressedSize, declaredUncompressedSize);
-    if(decSize < 0) { _compressed_size = -1; return false; }
-    darray.resize(decSize);
-    setData(darray);
-    return QBuffer::open(openMode);
+    _uncompressed_size = declaredUncompressedSize;
+
+    _in.resize(INPUT_CHUNK_SIZE);
+    _out.resize(WINDOW_SIZE + OUTPUT_CHUNK_SIZE);
+    if (!restart()) {
+        close();
+        return false;
+    }
+    return QIODevice::open(openMode | Unbuffered);
+}
+
+void QuaLz4File::close()
+{
+    if (isOpen()) {
+        QIODevice::close();
+    }
+    // tasks may still be working on the read-ahead batch
+    _pool.waitForDone();
+    _file.close();
+    _in.clear();
+    _out.clear();
+    _batch.clear();
+    _ahead.clear();
+    _batchCount = 0;
+    _aheadCount = 0;
+    _compressed_size = -1;
+    _uncompressed_size = -1;
 }
+
 qint64 QuaLz4File::csize() const
 {
     if (_filename.isEmpty() || !isOpen()) return -1;
     return _compressed_size;
 }
+
+qint64 QuaLz4File::size() const
+{
+    return _uncompressed_size;
+}
+
+bool QuaLz4File::atEnd() const
+{
+    return !isOpen() || (_state == Done && _outPos == _outEnd);
+}
+
+qint64 QuaLz4File::bytesAvailable() const
+{
+    if (_uncompressed_size < 0) {
+        return _outEnd - _outPos;
+    }
+    return QIODevice::bytesAvailable();
+}
+
+bool QuaLz4File::restart()
+{
+    _outFloor = _outPos = _outEnd = 0;
+    _produced = 0;
+    if (_format == FrameFormat) {
+        _pool.waitForDone();
+        _inFrame = false;
+        _streamEnd = false;
+        _frameStart = true;
+        _contentHash.reset();
+        _batchCount = _batchPos = 0;
+        _aheadCount = 0;
+        _frameBlockMax = WINDOW_SIZE;
+        _state = Token;
+        if (!_file.seek(0)) {
+            return false;
+        }
+        readAhead();
+        return true;
+    }
+
+    if (!_file.seek(HEADER_SIZE)) {
+        return false;
+    }
+    _inPos = _inEnd = 0;
+    _inLeft = _compressed_size;
+    // a file that did not compress is stored as is
+    if (_compressed_size == _uncompressed_size) {
+        _state = Literals;
+        _length = _uncompressed_size;
+    } else {
+        _state = Token;
+        _length = 0;
+    }
+    _offset = 0;
+    return true;
+}
+
+bool QuaLz4File::seek(qint64 pos)
+{
+    if (!isOpen() || pos < 0 || (_uncompressed_size >= 0 && pos > _uncompressed_size)) {
+        return false;
+    }
+    if (pos < _produced - (_outEnd - _outFloor) && !restart()) {
+        return false;
+    }
+    // skip whatever lies between, one chunk at a time
+    while (pos > _produced) {
+        _outPos = _outEnd;
+        if (_state == Done || !decode()) {
+            return false;
+        }
+    }
+    _outPos = int(pos - (_produced - _outEnd));
+    return QIODevice::seek(pos);
+}
+
+qint64 QuaLz4File::readData(char *data, qint64 maxSize)
+{
+    qint64 done = 0;
+    while (done < maxSize) {
+        if (_outPos == _outEnd) {
+            if (_state == Done) {
+                break;
+            }
+            if (!decode()) {
+                return done > 0 ? done : -1;
+            }
+        }
+        int n = int(qMin(maxSize - done, qint64(_outEnd - _outPos)));
+        memcpy(data + done, _out.constData() + _outPos, n);
+        _outPos += n;
+        done += n;
+    }
+    return done;
+}
+
+qint64 QuaLz4File::writeData(const char *, qint64)
+{
+    return -1;
+}
+
+bool QuaLz4File::fail(const QString &message)
+{
+    setErrorString(message);
+    _state = Done;
+    return false;
+}
+
+bool QuaLz4File::refill()
+{
+    if (_inLeft == 0) {
+        return false;
+    }
+    int n = int(qMin(qint64(_in.size()), _inLeft));
+    QElapsedTimer timer;
+    timer.start();
+    bool ok = _file.read(_in.data(), n) == n;
+    _fileNsecs += timer.nsecsElapsed();
+    if (!ok) {
+        return false;
+    }
+    if (_progress) {
+        _progress->store(_file.pos());
+    }
+    _inLeft -= n;
+    _inPos = 0;
+    _inEnd = n;
+    return true;
+}
+
+inline int QuaLz4File::inputByte()
+{
+    if (_inPos == _inEnd && !refill()) {
+        return -1;
+    }
+    return uchar(_in.at(_inPos++));
+}
+
+/// Moves the last \a keep bytes of output to the front of the buffer.
+void QuaLz4File::slide(int keep)
+{
+    int drop = _outEnd - keep;
+    memmove(_out.data(), _out.constData() + drop, keep);
+    _outPos -= drop;
+    _outEnd = keep;
+    _outFloor = qMax(0, _outFloor - drop);
+}
+
+/// Makes the next piece of output available, once everything before was read.
+bool QuaLz4File::decode()
+{
+    return _format == FrameFormat ? decodeFrame() : decodeBlock();
+}
+
+/// Decompresses up to a chunk of output after the retained history.
+/** Literal runs and matches may be cut at the end of the chunk and resume
+ * on the next call; everything else in a sequence is read in one go.
+ **/
+bool QuaLz4File::decodeBlock()
+{
+    // keep the last WINDOW_SIZE bytes, matches may refer to them
+    if (_outEnd > WINDOW_SIZE) {
+        slide(WINDOW_SIZE);
+    }
+    uchar *out = reinterpret_cast<uchar *>(_out.data());
+    const int capacity = _out.size();
+
+    while (_outEnd < capacity && _state != Done) {
+        switch (_state) {
+        case Token: {
+            int token = inputByte();
+            if (token < 0) {
+                return fail(tr("The compressed bytestream is truncated."));
+            }
+            _length = token >> 4;
+            if (_length == 15) {
+                int b;
+                do {
+                    if ((b = inputByte()) < 0) {
+                        return fail(tr("The compressed bytestream is truncated."));
+                    }
+                    _length += b;
+                } while (b == 255);
+            }
+            // the match length is completed once the literals are copied
+            _offset = token & 0x0F;
+            _state = Literals;
+            break;
+        }
+        case Literals: {
+            if (_length > 0) {
+                if (_inPos == _inEnd && !refill()) {
+                    return fail(tr("The compressed bytestream is truncated."));
+                }
+                int n = int(qMin(_length, qint64(qMin(_inEnd - _inPos, capacity - _outEnd))));
+                memcpy(out + _outEnd, _in.constData() + _inPos, n);
+                _inPos += n;
+                _outEnd += n;
+                _produced += n;
+                _length -= n;
+                break;
+            }
+            // the last sequence of a block only has literals
+            if (_inPos == _inEnd && _inLeft == 0) {
+                _state = Done;
+                break;
+            }
+            qint64 matchLength = _offset;
+            int lo = inputByte();
+            int hi = inputByte();
+            if (lo < 0 || hi < 0) {
+                return fail(tr("The compressed bytestream is truncated."));
+            }
+            _offset = lo | (hi << 8);
+            if (matchLength == 15) {
+                int b;
+                do {
+                    if ((b = inputByte()) < 0) {
+                        return fail(tr("The compressed bytestream is truncated."));
+                    }
+                    matchLength += b;
+                } while (b == 255);
+            }
+            _length = matchLength + MIN_MATCH;
+            if (_offset == 0 || _offset > _outEnd) {
+                return fail(tr("The compressed bytestream is corrupt."));
+            }
+            _state = Match;
+            break;
+        }
+        case Match: {
+            int n = int(qMin(_length, qint64(capacity - _outEnd)));
+            uchar *dst = out + _outEnd;
+            const uchar *src = dst - _offset;
+            if (_offset >= n) {
+                memcpy(dst, src, n);
+            } else {
+                // overlapping copy repeats the last _offset bytes
+                for (int i = 0; i < n; ++i) {
+                    dst[i] = src[i];
+                }
+            }
+            _outEnd += n;
+            _produced += n;
+            _length -= n;
+            if (_length == 0) {
+                _state = Token;
+            }
+            break;
+        }
+        case Done:
+            break;
+        }
+        if (_produced > _uncompressed_size) {
+            return fail(tr("The compressed bytestream is corrupt."));
+        }
+    }
+    if (_state == Done && _produced != _uncompressed_size) {
+        return fail(tr("The compressed bytestream is corrupt."));
+    }
+    return true;
+}
+
+bool QuaLz4File::readLE32(quint32 *value)
+{
+    uchar bytes[4];
+    if (_file.read(reinterpret_cast<char *>(bytes), 4) != 4) {
+        return false;
+    }
+    *value = qFromLittleEndian<quint32>(bytes);
+    return true;
+}
+
+/// Reads the next frame descriptor, skipping skippable frames.
+/** Sets \a end instead at the end of the file. \a contentSize, if given,
+ * receives the declared size of the frame's content or -1.
+ **/
+bool QuaLz4File::readFrameHeader(bool *end, qint64 *contentSize)
+{
+    quint32 magic;
+    for (;;) {
+        *end = _file.atEnd();
+        if (*end) {
+            return true;
+        }
+        if (!readLE32(&magic)) {
+            return false;
+        }
+        if ((magic & 0xFFFFFFF0) != SKIPPABLE_MAGIC) {
+            break;
+        }
+        quint32 skip;
+        if (!readLE32(&skip) || !_file.seek(_file.pos() + skip)) {
+            return false;
+        }
+    }
+    if (magic != FRAME_MAGIC) {
+        return false;
+    }
+
+    uchar descriptor[14];
+    if (_file.read(reinterpret_cast<char *>(descriptor), 2) != 2) {
+        return false;
+    }
+    uchar flags = descriptor[0];
+    uchar bd = descriptor[1];
+    int blockSizeId = (bd >> 4) & 0x07;
+    // version 01, no reserved bit set, no dictionary
+    if ((flags >> 6) != 1 || (flags & 0x03) || (bd & 0x8F) || blockSizeId < 4) {
+        return false;
+    }
+    int length = 2 + ((flags & 0x08) ? 8 : 0);
+    uchar hc;
+    if (_file.read(reinterpret_cast<char *>(descriptor) + 2, length - 2) != length - 2
+            || !_file.getChar(reinterpret_cast<char *>(&hc))
+            || hc != ((Xxh32::hash(descriptor, length) >> 8) & 0xFF)) {
+        return false;
+    }
+    if (contentSize) {
+        *contentSize = (flags & 0x08) ? qFromLittleEndian<qint64>(descriptor + 2) : -1;
+    }
+    _frameLinked = !(flags & 0x20);
+    _frameBlockChecksum = flags & 0x10;
+    _frameContentChecksum = flags & 0x04;
+    _frameBlockMax = 1 << (8 + 2 * blockSizeId);
+    _inFrame = true;
+    return true;
+}
+
+/// Reads the next block or end mark, and the next frame header if needed.
+/** Sets _streamEnd instead at the end of the file.
+ **/
+bool QuaLz4File::readFrameBlock(FrameBlock *b)
+{
+    if (!_inFrame) {
+        if (!readFrameHeader(&_streamEnd)) {
+            return false;
+        }
+        if (_streamEnd) {
+            return true;
+        }
+    }
+    quint32 word;
+    b->corrupt = false;
+    if (!readLE32(&word)) {
+        return false;
+    }
+    b->endsFrame = word == 0;
+    if (b->endsFrame) {
+        _inFrame = false;
+        b->size = 0;
+        b->hasContentChecksum = _frameContentChecksum;
+        return !b->hasContentChecksum || readLE32(&b->contentChecksum);
+    }
+
+    int csize = int(word & ~STORED_BLOCK);
+    if (csize > _frameBlockMax) {
+        return false;
+    }
+    b->stored = word & STORED_BLOCK;
+    b->linked = _frameLinked;
+    b->checkContent = _frameContentChecksum;
+    b->blockMax = _frameBlockMax;
+    b->hasChecksum = _frameBlockChecksum;
+    b->size = -1;
+    b->compressed.resize(csize);
+    if (_file.read(b->compressed.data(), csize) != csize) {
+        return false;
+    }
+    return !b->hasChecksum || readLE32(&b->checksum);
+}
+
+/// Walks all frames at open time, adding up their declared content sizes.
+bool QuaLz4File::scanFrames(qint64 *contentSize)
+{
+    *contentSize = 0;
+    for (;;) {
+        bool end;
+        qint64 frameSize;
+        if (!readFrameHeader(&end, &frameSize)) {
+            return false;
+        }
+        if (end) {
+            return true;
+        }
+        *contentSize = (*contentSize < 0 || frameSize < 0) ? -1 : *contentSize + frameSize;
+        // only the block sizes are read, the data is skipped
+        quint32 word;
+        do {
+            if (!readLE32(&word)) {
+                return false;
+            }
+            qint64 skip = word ? qint64(word & ~STORED_BLOCK) + (_frameBlockChecksum ? 4 : 0)
+                               : (_frameContentChecksum ? 4 : 0);
+            if (_file.pos() + skip > _compressed_size || !_file.seek(_file.pos() + skip)) {
+                return false;
+            }
+        } while (word != 0);
+        _inFrame = false;
+    }
+}
+
+/// Reads the next batch of blocks and starts decompressing them on the pool.
+/** A block that cannot be read ends the batch marked as corrupt, so the
+ * error is reported once the output before it was read.
+ **/
+void QuaLz4File::readAhead()
+{
+    int threads = _pool.maxThreadCount();
+    QElapsedTimer timer;
+    timer.start();
+    _aheadCount = 0;
+    while (!_streamEnd && (_aheadCount < threads || qint64(_aheadCount) * _frameBlockMax < BATCH_OUTPUT_SIZE)) {
+        if (_ahead.size() == _aheadCount) {
+            _ahead.resize(_aheadCount + 1);
+        }
+        FrameBlock &b = _ahead[_aheadCount];
+        if (!readFrameBlock(&b)) {
+            b.endsFrame = false;
+            b.corrupt = true;
+            _streamEnd = true;
+            ++_aheadCount;
+            break;
+        }
+        if (!_streamEnd) {
+            ++_aheadCount;
+        }
+    }
+    _fileNsecs += timer.nsecsElapsed();
+    if (_progress) {
+        _progress->store(_file.pos());
+    }
+    _nextTask.store(0);
+    for (int i = 0; i < threads && i < _aheadCount; ++i) {
+        _pool.start(new BlockTask(_ahead.data(), _aheadCount, &_nextTask));
+    }
+}
+
+/// Serves the next block of the current batch, moving to the next batch as needed.
+bool QuaLz4File::decodeFrame()
+{
+    for (;;) {
+        if (_batchPos == _batchCount) {
+            if (_aheadCount == 0) {
+                _state = Done;
+                if (_uncompressed_size >= 0 && _produced != _uncompressed_size) {
+                    return fail(tr("The compressed bytestream is corrupt."));
+                }
+                return true;
+            }
+            _pool.waitForDone();
+            _batch.swap(_ahead);
+            _batchCount = _aheadCount;
+            _batchPos = 0;
+            readAhead();
+        }
+
+        FrameBlock &b = _batch[_batchPos++];
+        if (b.corrupt) {
+            return fail(tr("The compressed bytestream is corrupt."));
+        }
+        if (b.endsFrame) {
+            if (b.hasContentChecksum && _contentHash.digest() != b.contentChecksum) {
+                return fail(tr("The compressed bytestream is corrupt."));
+            }
+            _contentHash.reset();
+            _frameStart = true;
+            continue;
+        }
+
+        if (b.linked) {
+            // decoded here, right after the previous 64 KiB of output
+            if (_out.size() < WINDOW_SIZE + b.blockMax) {
+                _out.resize(WINDOW_SIZE + b.blockMax);
+            }
+            if (_frameStart) {
+                memset(_out.data(), 0, WINDOW_SIZE);
+                _outFloor = _outPos = _outEnd = WINDOW_SIZE;
+            } else if (_outEnd > WINDOW_SIZE) {
+                slide(WINDOW_SIZE);
+            }
+            char *dst = _out.data() + _outEnd;
+            if (b.stored) {
+                b.size = b.compressed.size();
+                memcpy(dst, b.compressed.constData(), b.size);
+            } else {
+                b.size = LZ4_decompress_safe_withPrefix64k(b.compressed.constData(), dst,
+                                                           b.compressed.size(), b.blockMax);
+                if (b.size < 0) {
+                    return fail(tr("The compressed bytestream is corrupt."));
+                }
+            }
+            _outEnd += b.size;
+        } else {
+            // keeps our previous buffer for a later batch
+            _out.swap(b.output);
+            _outFloor = _outPos = 0;
+            _outEnd = b.size;
+        }
+        if (b.checkContent) {
+            _contentHash.update(_out.constData() + _outPos, b.size);
+        }
+        _produced += b.size;
+        _frameStart = false;
+        if (_uncompressed_size >= 0 && _produced > _uncompressed_size) {
+            return fail(tr("The compressed bytestream is corrupt."));
+        }
+        return true;
+    }
+}
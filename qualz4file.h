@@ -1,9 +1,17 @@
 #ifndef QUALZ4FILE_H
 #define QUALZ4FILE_H
 
-#include <QBuffer>
+#include <QAtomicInt>
+#include <QAtomicInteger>
+#include <QByteArray>
+#include <QFile>
+#include <QIODevice>
+#include <QThreadPool>
+#include <QVector>
 
-class QuaLz4File : public QBuffer
+#include "xxh32.h"
+
+class QuaLz4File : public QIODevice
 {
     Q_OBJECT
 public:
@@ -26,6 +34,7 @@ public:
     * only access.
     **/
     QuaLz4File(const QString& fileName, QObject *parent = 0);
+    virtual ~QuaLz4File();
 
     ///
     /** To be called before open()
@@ -38,26 +47,135 @@ public:
      * Returns blank string if there is no file name set yet.
      **/
     QString fileName() const;
-    /// Opens and decompresses an LZ4 file into the internal QByteArray.
+    /// Opens an LZ4 file and checks its header.
     /** Returns \c true on success, \c false otherwise.
+     *
+     * Two formats are understood: the original single LZ4 block behind an
+     * 8-byte header (uncompressed and compressed sizes, little endian), and
+     * the standard LZ4 frame format, possibly several concatenated frames.
+     *
+     * Data is decompressed as it is read. A single block is decoded one
+     * chunk at a time, keeping only the last 64 KiB of output as history.
+     * Frames with independent blocks are decompressed a batch of blocks
+     * ahead, in parallel on all cores; linked blocks are decoded in order.
+     * Block and content checksums are verified when present.
      *
      * \note Only QIODevice::ReadOnly is supported.
      *
      * \sa QuaLz4File::isOpen
      **/
     virtual bool open(OpenMode mode);
+    virtual void close();
+    /// Returns the uncompressed size.
+    /** -1 for frames that do not all declare their content size.
+     **/
+    virtual qint64 size() const;
+    virtual bool atEnd() const;
+    virtual qint64 bytesAvailable() const;
+    /// Moves the read position.
+    /** Moving forward decompresses and discards the data in between. Moving
+     * back beyond the chunk in memory starts over from the beginning of the
+     * file, which is meant for the occasional reset().
+     **/
+    virtual bool seek(qint64 pos);
     /// Returns compressed file size.
     /** File must be open for reading before calling this function.
      *
      * Returns -1 on error.
      **/
     qint64 csize()const;
+    /// Time spent reading the compressed file since open(), in nanoseconds.
+    /** The rest of the time spent in read() goes to decompression, or to
+     * waiting for it.
+     **/
+    qint64 fileReadNsecs() const { return _fileNsecs; }
+    /// Counter kept at the number of compressed bytes read, 0 for none.
+    void setProgressCounter(QAtomicInteger<qint64> *counter) { _progress = counter; }
 
 protected:
-    //QByteArray _arr;
+    virtual qint64 readData(char *data, qint64 maxSize);
+    virtual qint64 writeData(const char *data, qint64 maxSize);
+
     QString _filename;
     qint64 _compressed_size;
+    qint64 _uncompressed_size;
+
+private:
+    enum Format { BlockFormat, FrameFormat };
+    enum State { Token, Literals, Match, Done };
+
+    /// One block of a frame, read ahead of the output.
+    struct FrameBlock
+    {
+        QByteArray compressed;
+        QByteArray output;
+        int size;               // decompressed size, once known
+        int blockMax;
+        quint32 checksum;
+        quint32 contentChecksum;
+        bool hasChecksum;
+        bool stored;            // kept uncompressed by the writer
+        bool linked;            // may refer to the previous 64 KiB of output
+        bool checkContent;      // output goes into the frame's content checksum
+        bool endsFrame;         // no data, end mark of the frame
+        bool hasContentChecksum;
+        bool corrupt;
+    };
+    class BlockTask;
+    friend class BlockTask;
+
+    bool restart();
+    bool refill();
+    int inputByte();
+    bool decode();
+    bool decodeBlock();
+    bool fail(const QString &message);
+    void slide(int keep);
+
+    bool readLE32(quint32 *value);
+    bool readFrameHeader(bool *end, qint64 *contentSize = 0);
+    bool readFrameBlock(FrameBlock *block);
+    bool scanFrames(qint64 *contentSize);
+    void readAhead();
+    bool decodeFrame();
+
+    Format _format;
+
+    QFile _file;
+    qint64 _fileNsecs;
+    QAtomicInteger<qint64> *_progress;
+    QByteArray _in;
+    int _inPos;
+    int _inEnd;
+    qint64 _inLeft;         // compressed bytes not read from the file yet
+
+    // _out[_outFloor, _outEnd) is the output from _produced - _outEnd + _outFloor to _produced
+    QByteArray _out;
+    int _outFloor;
+    int _outPos;
+    int _outEnd;
+    qint64 _produced;
+
+    State _state;
+    qint64 _length;         // literal or match bytes left to copy
+    int _offset;
 
+    // frame format
+    bool _inFrame;          // between a frame header and its end mark
+    bool _streamEnd;        // no frame left in the file
+    bool _frameStart;       // next block served starts a frame
+    bool _frameLinked;
+    bool _frameBlockChecksum;
+    bool _frameContentChecksum;
+    int _frameBlockMax;
+    Xxh32 _contentHash;
+    QVector<FrameBlock> _batch;     // blocks being served
+    int _batchCount;
+    int _batchPos;
+    QVector<FrameBlock> _ahead;     // next blocks, decompressed on _pool meanwhile
+    int _aheadCount;
+    QAtomicInt _nextTask;
+    QThreadPool _pool;
 };
 
 #endif // QUALZ4FILE_H
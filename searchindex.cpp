@@ -0,0 +1,355 @@
+#include <QReadLocker>
+#include <QWriteLocker>
+
+#include <algorithm>
+
+#include "searchindex.h"
+#include "listingstore.h"
+
+using ShowListing::SearchIndex;
+using ShowListing::ListingNode;
+using ShowListing::ListingStore;
+using ShowListing::NamePool;
+
+namespace {
+
+inline uchar fold(uchar c)
+{
+    return c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c;
+}
+
+inline quint32 trigram(const uchar *p)
+{
+    return (quint32(fold(p[0])) << 16) | (quint32(fold(p[1])) << 8) | fold(p[2]);
+}
+
+/// Distinct trigrams of \a len bytes, sorted.
+void trigrams(const char *data, int len, QVector<quint32> *out)
+{
+    out->resize(0);
+    const uchar *p = reinterpret_cast<const uchar *>(data);
+    for (int i = 0; i + 3 <= len; ++i) {
+        out->append(trigram(p + i));
+    }
+    std::sort(out->begin(), out->end());
+    out->erase(std::unique(out->begin(), out->end()), out->end());
+}
+
+/// Whether \a name contains \a needle, which is already folded.
+bool containsFolded(const char *name, int len, const QByteArray &needle)
+{
+    const uchar *h = reinterpret_cast<const uchar *>(name);
+    const uchar *n = reinterpret_cast<const uchar *>(needle.constData());
+    int size = needle.size();
+    for (int i = 0; i + size <= len; ++i) {
+        if (fold(h[i]) != n[0]) {
+            continue;
+        }
+        int j = 1;
+        while (j < size && fold(h[i + j]) == n[j]) {
+            ++j;
+        }
+        if (j == size) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void appendVarint(QByteArray *out, quint32 value)
+{
+    while (value >= 0x80) {
+        out->append(char(value | 0x80));
+        value >>= 7;
+    }
+    out->append(char(value));
+}
+
+// ids of a shard grow, but shards are indexed one after the other
+inline quint32 zigzag(quint32 id, quint32 last)
+{
+    qint32 delta = qint32(id - last);
+    return (quint32(delta) << 1) ^ quint32(delta >> 31);
+}
+
+inline quint32 unzigzag(quint32 value, quint32 last)
+{
+    return last + ((value >> 1) ^ (0U - (value & 1)));
+}
+
+}
+
+SearchIndex::SearchIndex(const NamePool *names)
+    : _names(names)
+{
+    for (int s = 0; s < NamePool::ShardCount; ++s) {
+        _indexed[s] = 0;
+    }
+}
+
+SearchIndex::~SearchIndex()
+{
+    qDeleteAll(_listings);
+}
+
+void SearchIndex::addListing(const ListingStore *store)
+{
+    QMutexLocker updating(&_updateMutex);
+    indexNames();
+
+    // walk backwards so that chains come out in document order; nodes of
+    // subtrees dropped by a restart are not reachable from the root
+    Entries *entries = new Entries;
+    entries->store = store;
+    entries->next.fill(0, store->nodeCount());
+    for (quint32 r = store->node(0).childCount; r-- > 0; ) {
+        quint32 top = store->child(0, r);
+        for (quint32 id = store->node(top).subtreeEnd; id-- > top; ) {
+            if (store->node(id).flags & ListingNode::Linked) {
+                entries->linked.append(id);
+            }
+            quint32 name = store->nameId(id);
+            QHash<quint32, quint32>::iterator it = entries->first.find(name);
+            if (it == entries->first.end()) {
+                entries->first.insert(name, id);
+            } else {
+                entries->next[id] = it.value();
+                it.value() = id;
+            }
+        }
+    }
+
+    std::reverse(entries->linked.begin(), entries->linked.end());
+
+    QWriteLocker locker(&_lock);
+    _listings.append(entries);
+}
+
+void SearchIndex::removeListing(const ListingStore *store)
+{
+    QWriteLocker locker(&_lock);
+    for (int i = 0; i < _listings.size(); ++i) {
+        if (_listings.at(i)->store == store) {
+            delete _listings.takeAt(i);
+            return;
+        }
+    }
+}
+
+/// Adds the names interned since the last call to the posting lists.
+/** Trigrams are collected without holding the lock, searches only wait
+ * while they are appended.
+ **/
+void SearchIndex::indexNames()
+{
+    quint32 counts[NamePool::ShardCount];
+    QHash<quint32, QVector<quint32> > fresh;
+    QVector<quint32> grams;
+    for (int s = 0; s < NamePool::ShardCount; ++s) {
+        counts[s] = _names->shardCount(s);
+        for (quint32 local = _indexed[s]; local < counts[s]; ++local) {
+            quint32 id = NamePool::makeId(s, local);
+            trigrams(_names->data(id), _names->length(id), &grams);
+            for (int i = 0; i < grams.size(); ++i) {
+                fresh[grams.at(i)].append(id);
+            }
+        }
+    }
+
+    QWriteLocker locker(&_lock);
+    QHash<quint32, QVector<quint32> >::const_iterator it = fresh.constBegin();
+    for (; it != fresh.constEnd(); ++it) {
+        QHash<quint32, Posting>::iterator posting = _postings.find(it.key());
+        if (posting == _postings.end()) {
+            Posting empty = { QByteArray(), 0, 0 };
+            posting = _postings.insert(it.key(), empty);
+        }
+        const QVector<quint32> &ids = it.value();
+        for (int i = 0; i < ids.size(); ++i) {
+            appendVarint(&posting->ids, zigzag(ids.at(i), posting->last));
+            posting->last = ids.at(i);
+        }
+        posting->count += ids.size();
+    }
+    for (int s = 0; s < NamePool::ShardCount; ++s) {
+        _indexed[s] = counts[s];
+    }
+}
+
+/// Indexed names containing \a folded, called with the lock held.
+QVector<quint32> SearchIndex::matchingNames(const QByteArray &folded) const
+{
+    QVector<quint32> names;
+    if (folded.size() < 3) {
+        // too short for a trigram, check every name
+        for (int s = 0; s < NamePool::ShardCount; ++s) {
+            for (quint32 local = 0; local < _indexed[s]; ++local) {
+                quint32 id = NamePool::makeId(s, local);
+                if (containsFolded(_names->data(id), _names->length(id), folded)) {
+                    names.append(id);
+                }
+            }
+        }
+        return names;
+    }
+
+    QVector<quint32> grams;
+    trigrams(folded.constData(), folded.size(), &grams);
+    const Posting *rarest = 0;
+    for (int i = 0; i < grams.size(); ++i) {
+        QHash<quint32, Posting>::const_iterator it = _postings.constFind(grams.at(i));
+        if (it == _postings.constEnd()) {
+            return names;
+        }
+        if (!rarest || it->count < rarest->count) {
+            rarest = &it.value();
+        }
+    }
+
+    const uchar *p = reinterpret_cast<const uchar *>(rarest->ids.constData());
+    const uchar *end = p + rarest->ids.size();
+    quint32 id = 0;
+    while (p < end) {
+        quint32 value = 0;
+        int shift = 0;
+        while (*p & 0x80) {
+            value |= quint32(*p++ & 0x7f) << shift;
+            shift += 7;
+        }
+        value |= quint32(*p++) << shift;
+        id = unzigzag(value, id);
+        if (containsFolded(_names->data(id), _names->length(id), folded)) {
+            names.append(id);
+        }
+    }
+    return names;
+}
+
+/// Entries of an indexed listing, called with the lock held.
+const SearchIndex::Entries *SearchIndex::entriesOf(const ListingStore *store) const
+{
+    for (int l = 0; l < _listings.size(); ++l) {
+        if (_listings.at(l)->store == store) {
+            return _listings.at(l);
+        }
+    }
+    return 0;
+}
+
+/// Counts the entries named \a name among nodes [begin, end), following links, called with the lock held.
+/** The first \a limit of them go to \a hits, if any, as found in \a listing.
+ **/
+int SearchIndex::collect(const Entries *entries, quint32 name, quint32 begin, quint32 end,
+                         const ListingStore *listing, int limit, QVector<Hit> *hits) const
+{
+    // chains come in document order
+    int total = 0;
+    quint32 node = entries->first.value(name, 0);
+    for (; node != 0 && node < end; node = entries->next.at(node)) {
+        if (node < begin) {
+            continue;
+        }
+        if (hits && hits->size() < limit) {
+            Hit hit = { entries->store, node, listing };
+            hits->append(hit);
+        }
+        ++total;
+    }
+    QVector<quint32>::const_iterator it = std::lower_bound(entries->linked.begin(), entries->linked.end(), begin);
+    for (; it != entries->linked.end() && *it < end; ++it) {
+        quint32 target;
+        const ListingStore *shared = entries->store->resolve(*it, &target);
+        if (const Entries *sharedEntries = entriesOf(shared)) {
+            total += collect(sharedEntries, name, target + 1, shared->node(target).subtreeEnd, listing, limit, hits);
+        }
+    }
+    return total;
+}
+
+QByteArray SearchIndex::fold(const QString &text)
+{
+    QByteArray folded = text.toUtf8();
+    for (int i = 0; i < folded.size(); ++i) {
+        folded[i] = char(::fold(uchar(folded.at(i))));
+    }
+    return folded;
+}
+
+bool SearchIndex::nameContains(quint32 id, const QByteArray &folded) const
+{
+    return containsFolded(_names->data(id), _names->length(id), folded);
+}
+
+QVector<quint32> SearchIndex::entries(const ListingStore *store, const QByteArray &folded) const
+{
+    QVector<quint32> nodes;
+    if (folded.isEmpty()) {
+        return nodes;
+    }
+    QReadLocker locker(&_lock);
+    for (int l = 0; l < _listings.size(); ++l) {
+        const Entries *entries = _listings.at(l);
+        if (entries->store != store) {
+            continue;
+        }
+        QVector<quint32> names = matchingNames(folded);
+        for (int i = 0; i < names.size(); ++i) {
+            quint32 node = entries->first.value(names.at(i), 0);
+            for (; node != 0; node = entries->next.at(node)) {
+                nodes.append(node);
+            }
+        }
+        for (int d = 0; d < entries->linked.size(); ++d) {
+            quint32 target;
+            const ListingStore *shared = store->resolve(entries->linked.at(d), &target);
+            const Entries *sharedEntries = entriesOf(shared);
+            for (int i = 0; sharedEntries && i < names.size(); ++i) {
+                if (collect(sharedEntries, names.at(i), target + 1, shared->node(target).subtreeEnd, store, 0, 0) > 0) {
+                    nodes.append(entries->linked.at(d));
+                    break;
+                }
+            }
+        }
+        break;
+    }
+    // a linked directory may match by its own name as well
+    std::sort(nodes.begin(), nodes.end());
+    nodes.erase(std::unique(nodes.begin(), nodes.end()), nodes.end());
+    return nodes;
+}
+
+int SearchIndex::search(const QString &text, int limit, QVector<Hit> *hits) const
+{
+    hits->resize(0);
+    QByteArray folded = fold(text);
+    if (folded.isEmpty()) {
+        return 0;
+    }
+
+    QReadLocker locker(&_lock);
+    QVector<quint32> names = matchingNames(folded);
+    int total = 0;
+    for (int l = 0; l < _listings.size(); ++l) {
+        const Entries *entries = _listings.at(l);
+        for (int i = 0; i < names.size(); ++i) {
+            total += collect(entries, names.at(i), 0, entries->store->nodeCount(), entries->store, limit, hits);
+        }
+    }
+    return total;
+}
+
+qint64 SearchIndex::memoryUsage() const
+{
+    QReadLocker locker(&_lock);
+    qint64 total = qint64(_postings.capacity()) * (sizeof(quint32) + sizeof(Posting) + sizeof(void *));
+    QHash<quint32, Posting>::const_iterator it = _postings.constBegin();
+    for (; it != _postings.constEnd(); ++it) {
+        total += it->ids.capacity();
+    }
+    for (int l = 0; l < _listings.size(); ++l) {
+        const Entries *entries = _listings.at(l);
+        total += qint64(entries->first.capacity()) * (2 * sizeof(quint32) + sizeof(void *))
+                + qint64(entries->next.capacity() + entries->linked.capacity()) * sizeof(quint32);
+    }
+    return total;
+}
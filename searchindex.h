@@ -0,0 +1,101 @@
+#ifndef SEARCHINDEX_H
+#define SEARCHINDEX_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QReadWriteLock>
+#include <QString>
+#include <QVector>
+
+#include "namepool.h"
+
+namespace ShowListing{
+
+class ListingStore;
+
+/// Substring search over the entry names of every indexed listing.
+/** Each distinct name of the shared NamePool is indexed once by the byte
+ * trigrams it contains: a trigram maps to the delta-encoded ids of the
+ * names holding it. A query only checks the names listed under its rarest
+ * trigram, then follows, in every listing, the chain of entries sharing a
+ * matching name. Matching ignores the case of ASCII letters. Below a
+ * linked directory, the chains of the listing sharing the entries are
+ * followed over the range of the shared directory.
+ *
+ * addListing() may run on a loading thread while search() runs in the GUI.
+ **/
+class SearchIndex
+{
+public:
+    struct Hit
+    {
+        const ListingStore *store;      // holding the node
+        quint32 node;
+        const ListingStore *listing;    // the entry was found in, store unless it is shared through a link
+    };
+
+    explicit SearchIndex(const NamePool *names);
+    ~SearchIndex();
+
+    /// Indexes the names interned so far and the entries of \a store.
+    /** \a store must be finished and stay alive until removeListing().
+     **/
+    void addListing(const ListingStore *store);
+    void removeListing(const ListingStore *store);
+
+    /// Entries whose name contains \a text, the first \a limit of them in \a hits.
+    /** Returns how many entries match in total.
+     **/
+    int search(const QString &text, int limit, QVector<Hit> *hits) const;
+
+    /// \a text as the other calls expect it, UTF-8 with ASCII letters lowercased.
+    static QByteArray fold(const QString &text);
+    /// Entries of \a store whose name contains \a folded, in document order.
+    /** Linked directories holding such entries are listed in their place,
+     * as filter mode does not open them.
+     **/
+    QVector<quint32> entries(const ListingStore *store, const QByteArray &folded) const;
+    /// Whether name \a id contains \a folded, to refine an earlier result.
+    bool nameContains(quint32 id, const QByteArray &folded) const;
+
+    qint64 memoryUsage() const;
+
+private:
+    SearchIndex(const SearchIndex &);
+    SearchIndex &operator=(const SearchIndex &);
+
+    struct Posting
+    {
+        QByteArray ids;     // zigzag varint deltas
+        quint32 last;
+        quint32 count;
+    };
+
+    /// Entries of one listing, chained by name in document order.
+    struct Entries
+    {
+        const ListingStore *store;
+        QHash<quint32, quint32> first;  // name id -> first node
+        QVector<quint32> next;          // node -> next node with the same name, 0 at the end
+        QVector<quint32> linked;        // linked directories, in document order
+    };
+
+    void indexNames();
+    QVector<quint32> matchingNames(const QByteArray &folded) const;
+    const Entries *entriesOf(const ListingStore *store) const;
+    int collect(const Entries *entries, quint32 name, quint32 begin, quint32 end,
+                const ListingStore *listing, int limit, QVector<Hit> *hits) const;
+
+    const NamePool *_names;
+    QMutex _updateMutex;            // one indexNames() at a time
+    mutable QReadWriteLock _lock;   // guards everything below
+    quint32 _indexed[NamePool::ShardCount];
+    QHash<quint32, Posting> _postings;
+    QList<Entries *> _listings;
+};
+
+}
+
+#endif // SEARCHINDEX_H
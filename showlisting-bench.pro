@@ -0,0 +1,16 @@
+# Parse throughput benchmark, reporting JSON. Next to ShowListing.pro, so
+# generate its makefile under another name or in another build directory:
+#   qmake showlisting-bench.pro -o Makefile.bench
+# Run it on a fixed corpus, for instance lists written by showlisting-gen
+# with a given --seed.
+
+include(showlisting-core.pri)
+
+TEMPLATE      = app
+TARGET        = showlisting-bench
+QT           -= gui
+CONFIG       += console
+CONFIG       -= app_bundle
+win32: LIBS  += -lpsapi
+
+SOURCES      += showlistingbench.cpp
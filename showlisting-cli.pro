@@ -0,0 +1,13 @@
+# Headless front end, for batch jobs. Next to ShowListing.pro, so generate
+# its makefile under another name or in another build directory:
+#   qmake showlisting-cli.pro -o Makefile.cli
+
+include(showlisting-core.pri)
+
+TEMPLATE      = app
+TARGET        = showlisting-cli
+QT           -= gui
+CONFIG       += console
+CONFIG       -= app_bundle
+
+SOURCES      += showlistingcli.cpp
@@ -0,0 +1,69 @@
+# Reading, decompression and aggregation of FileListings, shared by the
+# ShowListing GUI and showlisting-cli. Depends on QtCore and QtXml only.
+
+INCLUDEPATH  += $$PWD
+DEPENDPATH   += $$PWD
+
+HEADERS      += $$PWD/adclistreader.h \
+    $$PWD/adclistscanner.h \
+    $$PWD/diffworker.h \
+    $$PWD/duplicatefinder.h \
+    $$PWD/duplicateworker.h \
+    $$PWD/exportworker.h \
+    $$PWD/filterworker.h \
+    $$PWD/largestentries.h \
+    $$PWD/largestworker.h \
+    $$PWD/qualz4file.h \
+    $$PWD/lz4framewriter.h \
+    $$PWD/lz4.h \
+    $$PWD/xxh32.h \
+    $$PWD/loadpathworker.h \
+    $$PWD/loadstats.h \
+    $$PWD/chunkedarray.h \
+    $$PWD/stringarena.h \
+    $$PWD/namepool.h \
+    $$PWD/listingdiff.h \
+    $$PWD/listingstore.h \
+    $$PWD/listingsnapshot.h \
+    $$PWD/listingstatistics.h \
+    $$PWD/parallelwork.h \
+    $$PWD/searchindex.h \
+    $$PWD/statisticsworker.h \
+    $$PWD/subtreeindex.h \
+    $$PWD/tth.h \
+    $$PWD/util.h
+SOURCES      += $$PWD/adclistreader.cpp \
+    $$PWD/adclistscanner.cpp \
+    $$PWD/diffworker.cpp \
+    $$PWD/duplicatefinder.cpp \
+    $$PWD/duplicateworker.cpp \
+    $$PWD/exportworker.cpp \
+    $$PWD/filterworker.cpp \
+    $$PWD/largestentries.cpp \
+    $$PWD/largestworker.cpp \
+    $$PWD/qualz4file.cpp \
+    $$PWD/lz4framewriter.cpp \
+    $$PWD/lz4.c \
+    $$PWD/xxh32.cpp \
+    $$PWD/loadpathworker.cpp \
+    $$PWD/loadstats.cpp \
+    $$PWD/stringarena.cpp \
+    $$PWD/namepool.cpp \
+    $$PWD/listingdiff.cpp \
+    $$PWD/listingstore.cpp \
+    $$PWD/listingsnapshot.cpp \
+    $$PWD/listingstatistics.cpp \
+    $$PWD/parallelwork.cpp \
+    $$PWD/searchindex.cpp \
+    $$PWD/statisticsworker.cpp \
+    $$PWD/subtreeindex.cpp \
+    $$PWD/tth.cpp
+
+QT           += xml
+
+# AdcListScanner and the TTH decoder use SSE2 when the compiler targets it;
+# opt in to AVX2 for the scanner with qmake CONFIG+=showlisting_avx2
+showlisting_avx2 {
+    *-g++*|*-clang*: QMAKE_CXXFLAGS += -mavx2
+    win32-msvc*: QMAKE_CXXFLAGS += /arch:AVX2
+}
@@ -0,0 +1,14 @@
+# Synthetic FileListing generator, for load and scale testing. Next to
+# ShowListing.pro, so generate its makefile under another name or in another
+# build directory:
+#   qmake showlisting-gen.pro -o Makefile.gen
+
+include(showlisting-core.pri)
+
+TEMPLATE      = app
+TARGET        = showlisting-gen
+QT           -= gui
+CONFIG       += console
+CONFIG       -= app_bundle
+
+SOURCES      += showlistinggen.cpp
@@ -0,0 +1,467 @@
+#include <QBuffer>
+#include <QByteArray>
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTextStream>
+#include <QThread>
+#include <QVector>
+
+#if defined(Q_OS_WIN)
+#include <windows.h>
+#include <psapi.h>
+#elif !defined(Q_OS_LINUX)
+#include <sys/resource.h>
+#endif
+
+#include "adclistreader.h"
+#include "adclistscanner.h"
+#include "listingstore.h"
+#include "loadpathworker.h"
+#include "namepool.h"
+#include "qualz4file.h"
+
+using ShowListing::AdcListReader;
+using ShowListing::AdcListScanner;
+using ShowListing::ListingNode;
+using ShowListing::ListingStore;
+using ShowListing::NamePool;
+
+namespace {
+
+const int READ_CHUNK_SIZE = 4 << 20;
+
+/// Resets the peak resident set size, where the system allows it.
+bool resetPeakRss()
+{
+#if defined(Q_OS_LINUX)
+    // "5" resets VmHWM, since Linux 4.0
+    QFile clearRefs("/proc/self/clear_refs");
+    return clearRefs.open(QIODevice::WriteOnly) && clearRefs.write("5") == 1;
+#else
+    return false;
+#endif
+}
+
+/// Peak resident set size in bytes, since the last successful resetPeakRss().
+qint64 peakRss()
+{
+#if defined(Q_OS_LINUX)
+    QFile status("/proc/self/status");
+    if (status.open(QIODevice::ReadOnly)) {
+        foreach (const QByteArray &line, status.readAll().split('\n')) {
+            if (line.startsWith("VmHWM:")) {
+                return line.mid(6).trimmed().split(' ').first().toLongLong() * 1024;
+            }
+        }
+    }
+    return -1;
+#elif defined(Q_OS_WIN)
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return qint64(counters.PeakWorkingSetSize);
+    }
+    return -1;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return -1;
+    }
+#if defined(Q_OS_MAC)
+    return qint64(usage.ru_maxrss);
+#else
+    return qint64(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
+
+/// Directory and file elements as the tokenizer saw them, to build a store from.
+struct Event
+{
+    enum Kind { OpenDirectory, CloseDirectory, AddFile };
+
+    quint8 kind;
+    bool flag;          // incomplete directory, or file with a size
+    quint16 nameLength;
+    quint32 date;
+    quint64 nameOffset;
+    quint64 size;
+};
+
+/// Runs the stages of opening one list, best of a few repetitions each.
+class ListBenchmark
+{
+public:
+    ListBenchmark(const QString &fileName, int repeat)
+        : _fileName(fileName), _repeat(repeat), _entries(0), _rssReset(false) {}
+
+    QJsonObject run();
+    bool rssReset() const { return _rssReset; }
+
+private:
+    /// Times \a stage, which returns false on failure, and records it.
+    bool measure(const QString &name, qint64 bytes, bool (ListBenchmark::*stage)());
+
+    bool readFile();
+    bool decompress();
+    bool tokenize();
+    bool record();
+    bool build();
+    bool aggregate();
+    bool parse(AdcListReader::ParserMode mode);
+    bool parseFast() { return parse(AdcListReader::FastParser); }
+    bool parseParallel() { return parse(AdcListReader::ParallelParser); }
+    bool load();
+
+    QString _fileName;
+    int _repeat;
+    QByteArray _file;
+    QByteArray _xml;
+    quint64 _entries;
+    QVector<Event> _events;
+    QByteArray _names;
+    NamePool *_pool;
+    ListingStore *_store;
+    QString _error;
+    QJsonArray _stages;
+    bool _rssReset;
+};
+
+bool ListBenchmark::measure(const QString &name, qint64 bytes, bool (ListBenchmark::*stage)())
+{
+    qint64 best = -1;
+    qint64 peak = -1;
+    for (int i = 0; i < _repeat; ++i) {
+        _rssReset = resetPeakRss();
+        QElapsedTimer timer;
+        timer.start();
+        if (!(this->*stage)()) {
+            return false;
+        }
+        qint64 elapsed = timer.nsecsElapsed();
+        best = best < 0 ? elapsed : qMin(best, elapsed);
+        peak = qMax(peak, peakRss());
+    }
+    double seconds = best / 1e9;
+    QJsonObject result;
+    result["stage"] = name;
+    result["seconds"] = seconds;
+    result["bytes"] = double(bytes);
+    result["mib_per_s"] = seconds > 0 ? bytes / 1048576.0 / seconds : 0.0;
+    result["peak_rss_bytes"] = double(peak);
+    _stages.append(result);
+    return true;
+}
+
+QJsonObject ListBenchmark::run()
+{
+    QJsonObject result;
+    result["path"] = QFileInfo(_fileName).absoluteFilePath();
+    bool compressed = QFileInfo(_fileName).suffix().toLower() == "xmlz4";
+
+    bool ok = measure("read", QFileInfo(_fileName).size(), &ListBenchmark::readFile);
+    if (ok && compressed) {
+        _file.clear();
+        ok = measure("decompress", QFileInfo(_fileName).size(), &ListBenchmark::decompress);
+    } else if (ok) {
+        _xml = _file;
+        _file.clear();
+    }
+    // entries are only known once tokenized, the rates are filled in below
+    ok = ok && measure("tokenize", _xml.size(), &ListBenchmark::tokenize);
+    ok = ok && record();
+    NamePool pool;
+    _pool = &pool;
+    _store = 0;
+    ok = ok && measure("build", _xml.size(), &ListBenchmark::build);
+    ok = ok && measure("aggregate", _xml.size(), &ListBenchmark::aggregate);
+    delete _store;
+    _store = 0;
+    _events.clear();
+    _names.clear();
+    ok = ok && measure("parse", _xml.size(), &ListBenchmark::parseFast);
+    if (ok && QThread::idealThreadCount() > 1) {
+        ok = measure("parse_parallel", _xml.size(), &ListBenchmark::parseParallel);
+    }
+    _xml.clear();
+    ok = ok && measure("load", QFileInfo(_fileName).size(), &ListBenchmark::load);
+
+    for (int i = 0; i < _stages.size(); ++i) {
+        QJsonObject stage = _stages.at(i).toObject();
+        double seconds = stage["seconds"].toDouble();
+        stage["entries_per_s"] = seconds > 0 ? _entries / seconds : 0.0;
+        _stages[i] = stage;
+    }
+    result["file_bytes"] = double(QFileInfo(_fileName).size());
+    result["entries"] = double(_entries);
+    result["stages"] = _stages;
+    if (!ok) {
+        result["error"] = _error;
+    }
+    return result;
+}
+
+/// Reads the file into memory, chunk by chunk like the parsers do.
+bool ListBenchmark::readFile()
+{
+    QFile file(_fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        _error = file.errorString();
+        return false;
+    }
+    _file.resize(int(qMin(file.size(), qint64(0x7fffffff))));
+    qint64 done = 0;
+    qint64 n;
+    while (done < _file.size() && (n = file.read(_file.data() + done, qMin(qint64(READ_CHUNK_SIZE), _file.size() - done))) > 0) {
+        done += n;
+    }
+    if (done != file.size()) {
+        _error = QCoreApplication::translate("showlisting-bench", "Cannot read the whole file into memory.");
+        return false;
+    }
+    return true;
+}
+
+bool ListBenchmark::decompress()
+{
+    QuaLz4File lz4(_fileName);
+    if (!lz4.open(QIODevice::ReadOnly)) {
+        _error = lz4.errorString();
+        return false;
+    }
+    _xml.resize(0);
+    QByteArray chunk(READ_CHUNK_SIZE, '\0');
+    qint64 n;
+    while ((n = lz4.read(chunk.data(), chunk.size())) > 0) {
+        if (qint64(_xml.size()) + n > 0x7fffffff) {
+            _error = QCoreApplication::translate("showlisting-bench", "The list does not fit into memory.");
+            return false;
+        }
+        _xml.append(chunk.constData(), int(n));
+    }
+    if (n < 0) {
+        _error = lz4.errorString();
+        return false;
+    }
+    return true;
+}
+
+/// Only pulls tokens, counting directories and files.
+bool ListBenchmark::tokenize()
+{
+    AdcListScanner scanner(_xml.constData(), _xml.size());
+    quint64 entries = 0;
+    for (;;) {
+        switch (scanner.next()) {
+        case AdcListScanner::StartElement:
+            if (scanner.element() == AdcListScanner::DirectoryElement
+                    || scanner.element() == AdcListScanner::FileElement) {
+                ++entries;
+            }
+            break;
+        case AdcListScanner::EndElement:
+            break;
+        case AdcListScanner::EndDocument:
+            _entries = entries;
+            return true;
+        case AdcListScanner::Unsupported:
+            _error = QString::fromLatin1(scanner.unsupportedReason());
+            return false;
+        }
+    }
+}
+
+/// Keeps the tokens as events, so that building can be timed on its own.
+bool ListBenchmark::record()
+{
+    AdcListScanner scanner(_xml.constData(), _xml.size());
+    _events.reserve(int(qMin(_entries * 2, quint64(0x7fffffff / sizeof(Event)))));
+    QVector<bool> openFile;
+    for (;;) {
+        AdcListScanner::Token token = scanner.next();
+        if (token == AdcListScanner::EndDocument) {
+            return true;
+        }
+        if (token == AdcListScanner::Unsupported) {
+            _error = QString::fromLatin1(scanner.unsupportedReason());
+            return false;
+        }
+        AdcListScanner::Element element = scanner.element();
+        if (element != AdcListScanner::DirectoryElement && element != AdcListScanner::FileElement) {
+            continue;
+        }
+        if (token == AdcListScanner::EndElement) {
+            if (element == AdcListScanner::DirectoryElement) {
+                Event e = { Event::CloseDirectory, false, 0, 0, 0, 0 };
+                _events.append(e);
+            }
+            continue;
+        }
+
+        int len;
+        const char *value = scanner.attribute(AdcListScanner::NameAttribute, &len);
+        Event e = { Event::AddFile, false, quint16(qMin(len, 0xffff)), 0, quint64(_names.size()), 0 };
+        _names.append(value, e.nameLength);
+        if (element == AdcListScanner::DirectoryElement) {
+            quint64 date = 0;
+            e.kind = Event::OpenDirectory;
+            value = scanner.attribute(AdcListScanner::DateAttribute, &len);
+            e.date = AdcListScanner::parseNumber(value, len, &date) ? quint32(date) : 0;
+            value = scanner.attribute(AdcListScanner::IncompleteAttribute, &len);
+            e.flag = len == 1 && value[0] == '1';
+        } else {
+            value = scanner.attribute(AdcListScanner::SizeAttribute, &len);
+            e.flag = AdcListScanner::parseNumber(value, len, &e.size);
+        }
+        _events.append(e);
+    }
+}
+
+/// Creates the nodes from the recorded events, names interned in a fresh pool.
+bool ListBenchmark::build()
+{
+    delete _store;
+    _store = new ListingStore(_pool);
+    const char *names = _names.constData();
+    for (int i = 0; i < _events.size(); ++i) {
+        const Event &e = _events.at(i);
+        switch (e.kind) {
+        case Event::OpenDirectory:
+            _store->openDirectory(names + e.nameOffset, e.nameLength, e.date, e.flag);
+            break;
+        case Event::CloseDirectory:
+            _store->closeDirectory();
+            break;
+        case Event::AddFile:
+            _store->addFile(names + e.nameOffset, e.nameLength, e.size, e.flag);
+            break;
+        }
+    }
+    _store->finish();
+    return true;
+}
+
+/// Cumulates directory sizes again over the finished node array.
+/** The store adds sizes up while it is being built, this pass measures the
+ * same work on its own and checks the result.
+ **/
+bool ListBenchmark::aggregate()
+{
+    quint32 count = _store->nodeCount();
+    QVector<quint64> sizes(int(count), 0);
+    // children come after their parent, so a reverse walk sees them first
+    for (quint32 id = count - 1; id > 0; --id) {
+        const ListingNode &n = _store->node(id);
+        if (n.type == ListingNode::File) {
+            sizes[int(id)] = n.size;
+        }
+        sizes[int(n.parent)] += sizes.at(int(id));
+    }
+    if (sizes.at(0) != _store->node(0).size) {
+        _error = QCoreApplication::translate("showlisting-bench", "Aggregated sizes differ from the store's.");
+        return false;
+    }
+    return true;
+}
+
+/// Tokenizes and builds in one go from memory, as AdcListReader does.
+bool ListBenchmark::parse(AdcListReader::ParserMode mode)
+{
+    NamePool pool;
+    ListingStore store(&pool);
+    QBuffer buffer(&_xml);
+    buffer.open(QIODevice::ReadOnly);
+    AdcListReader reader;
+    reader.setParserMode(mode);
+    if (reader.read(&buffer, &store) != 0) {
+        _error = reader.errorString();
+        return false;
+    }
+    return true;
+}
+
+/// Everything from the file on disk, as the application opens lists.
+bool ListBenchmark::load()
+{
+    NamePool pool;
+    ListingStore store(&pool);
+    QIODevice *io = LoadPathWorker::openDevice(_fileName, &_error);
+    if (!io) {
+        return false;
+    }
+    AdcListReader reader;
+    bool ok = reader.read(io, &store) == 0;
+    if (!ok) {
+        _error = reader.errorString();
+    }
+    delete io;
+    return ok;
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QTextStream err(stderr);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Times the stages of opening FileListings and prints the results as JSON.");
+    parser.addHelpOption();
+    QCommandLineOption repeatOption(QStringList() << "r" << "repeat", "Runs of each stage, the fastest counts (default 3).", "count", "3");
+    QCommandLineOption outputOption(QStringList() << "o" << "output", "Writes the JSON report to <file> instead of stdout.", "file");
+    parser.addOption(repeatOption);
+    parser.addOption(outputOption);
+    parser.addPositionalArgument("lists", "Corpus of .xml and .xmlz4 lists, for instance written by showlisting-gen.", "lists...");
+    parser.process(app);
+
+    bool ok;
+    int repeat = parser.value(repeatOption).toInt(&ok);
+    if (!ok || repeat < 1 || parser.positionalArguments().isEmpty()) {
+        parser.showHelp(2);
+    }
+
+    QJsonArray lists;
+    bool failed = false;
+    bool rssReset = true;
+    foreach (const QString &fileName, parser.positionalArguments()) {
+        err << "benchmarking " << fileName << "\n";
+        err.flush();
+        ListBenchmark benchmark(fileName, repeat);
+        QJsonObject list = benchmark.run();
+        if (list.contains("error")) {
+            err << fileName << ": " << list["error"].toString() << "\n";
+            failed = true;
+        }
+        rssReset = rssReset && benchmark.rssReset();
+        lists.append(list);
+    }
+
+    QJsonObject report;
+    report["tool"] = QString("showlisting-bench");
+    report["format"] = 1;
+    report["date"] = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+    report["threads"] = QThread::idealThreadCount();
+    report["repeat"] = repeat;
+    // otherwise peaks are those of the whole process so far
+    report["peak_rss_per_stage"] = rssReset;
+    report["lists"] = lists;
+    QByteArray json = QJsonDocument(report).toJson();
+
+    if (parser.isSet(outputOption)) {
+        QFile output(parser.value(outputOption));
+        if (!output.open(QIODevice::WriteOnly | QIODevice::Truncate) || output.write(json) != json.size()) {
+            err << output.fileName() << ": " << output.errorString() << "\n";
+            return 1;
+        }
+    } else {
+        QTextStream(stdout) << json;
+    }
+    return failed ? 1 : 0;
+}
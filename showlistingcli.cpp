@@ -0,0 +1,221 @@
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QIODevice>
+#include <QPair>
+#include <QTextStream>
+#include <QVector>
+
+#include <algorithm>
+
+#include "adclistreader.h"
+#include "largestentries.h"
+#include "listingsnapshot.h"
+#include "listingstore.h"
+#include "loadpathworker.h"
+#include "namepool.h"
+
+using ShowListing::AdcListReader;
+using ShowListing::LargestEntries;
+using ShowListing::ListingNode;
+using ShowListing::ListingSnapshot;
+using ShowListing::ListingStore;
+using ShowListing::NamePool;
+
+namespace {
+
+struct ListStats
+{
+    quint64 files;
+    quint64 directories;
+    quint64 size;
+};
+
+struct Options
+{
+    int top;
+    int largest;
+    bool snapshots;
+};
+
+QTextStream out(stdout);
+QTextStream err(stderr);
+
+bool bySizeDescending(const QPair<quint64, quint32> &a, const QPair<quint64, quint32> &b)
+{
+    return a.first > b.first;
+}
+
+QString rate(double amount, qint64 ms)
+{
+    return ms > 0 ? QString::number(amount * 1000 / ms, 'f', 1) : QString("-");
+}
+
+/// Counts the entries below the root, one top-level subtree range at a time.
+ListStats collect(const ListingStore &store)
+{
+    ListStats stats = { 0, 0, store.node(0).size };
+    const ListingNode &root = store.node(0);
+    for (quint32 row = 0; row < root.childCount; ++row) {
+        quint32 top = store.child(0, row);
+        for (quint32 id = top; id < store.node(top).subtreeEnd; ++id) {
+            if (store.node(id).type == ListingNode::Directory) {
+                ++stats.directories;
+            } else {
+                ++stats.files;
+            }
+        }
+    }
+    return stats;
+}
+
+void printTopLevel(const ListingStore &store, int top)
+{
+    QVector<QPair<quint64, quint32> > dirs;
+    const ListingNode &root = store.node(0);
+    for (quint32 row = 0; row < root.childCount; ++row) {
+        quint32 id = store.child(0, row);
+        if (store.node(id).type == ListingNode::Directory) {
+            dirs.append(qMakePair(store.node(id).size, id));
+        }
+    }
+    std::stable_sort(dirs.begin(), dirs.end(), bySizeDescending);
+    int shown = top > 0 ? qMin(top, dirs.size()) : dirs.size();
+    out << "  top-level directories: " << dirs.size() << "\n";
+    for (int i = 0; i < shown; ++i) {
+        out << "    " << QString::number(dirs.at(i).first).rightJustified(16)
+            << "  " << store.name(dirs.at(i).second) << "\n";
+    }
+    if (shown < dirs.size()) {
+        out << "    ... " << dirs.size() - shown << " more\n";
+    }
+}
+
+void printEntries(const char *title, const QVector<LargestEntries::Entry> &entries)
+{
+    out << "  " << title << "\n";
+    for (int i = 0; i < entries.size(); ++i) {
+        out << "    " << QString::number(entries.at(i).size).rightJustified(16)
+            << "  " << QDir::toNativeSeparators(entries.at(i).store->path(entries.at(i).node, QDir::separator())) << "\n";
+    }
+}
+
+void printLargest(const ListingStore &store, int count)
+{
+    QElapsedTimer timer;
+    timer.start();
+    LargestEntries largest(store, count);
+    qint64 elapsed = timer.nsecsElapsed();
+    out << "  largest entries found in " << QString::number(elapsed / 1e6, 'f', 2) << " ms\n";
+    printEntries("largest files:", largest.files());
+    printEntries("largest directories:", largest.directories());
+}
+
+/// Loads one list and prints its statistics, adding them to \a total.
+bool processList(const QString &fileName, const Options &options, ListStats *total)
+{
+    NamePool names;
+    ListingStore store(&names);
+    store.sourcePath = fileName;
+
+    QFileInfo source(fileName);
+    qint64 sourceSize = source.size();
+    qint64 sourceModified = source.lastModified().toMSecsSinceEpoch();
+    QElapsedTimer timer;
+    timer.start();
+    bool fromSnapshot = options.snapshots && ListingSnapshot::load(fileName, &store);
+    if (!fromSnapshot) {
+        QString message;
+        QIODevice *io = LoadPathWorker::openDevice(fileName, &message);
+        if (!io) {
+            err << QDir::toNativeSeparators(fileName) << ": " << message << "\n";
+            err.flush();
+            return false;
+        }
+        AdcListReader reader;
+        int rc = reader.read(io, &store);
+        delete io;
+        if (rc != 0) {
+            err << QDir::toNativeSeparators(fileName) << ": " << reader.errorString() << "\n";
+            err.flush();
+            return false;
+        }
+        if (options.snapshots) {
+            ListingSnapshot::save(fileName, store, sourceSize, sourceModified);
+        }
+    }
+    qint64 elapsed = timer.elapsed();
+
+    ListStats stats = collect(store);
+    total->files += stats.files;
+    total->directories += stats.directories;
+    total->size += stats.size;
+
+    quint64 entries = stats.files + stats.directories;
+    out << QDir::toNativeSeparators(fileName) << "\n";
+    out << "  generator  " << store.generator << "\n";
+    out << "  base       " << store.base << "\n";
+    out << "  entries    " << entries << " (" << stats.files << " files, "
+        << stats.directories << " directories)\n";
+    out << "  size       " << stats.size << "\n";
+    out << "  load       " << elapsed << " ms" << (fromSnapshot ? " from snapshot" : "")
+        << ", " << rate(sourceSize / 1048576.0, elapsed) << " MiB/s of " << sourceSize << " bytes, "
+        << rate(entries, elapsed) << " entries/s\n";
+    out << "  memory     " << store.memoryUsage() << " bytes nodes, "
+        << names.memoryUsage() << " bytes for " << names.count() << " names\n";
+    printTopLevel(store, options.top);
+    if (options.largest > 0) {
+        printLargest(store, options.largest);
+    }
+    out.flush();
+    return true;
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    // same cache directory as the GUI, snapshots are shared
+    QCoreApplication::setApplicationName("ShowListing");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Prints totals, top-level directory sizes and statistics of FileListings.");
+    parser.addHelpOption();
+    QCommandLineOption topOption(QStringList() << "n" << "top",
+                                 "Show the <count> biggest top-level directories, 0 for all (default 10).",
+                                 "count", "10");
+    QCommandLineOption largestOption("largest", "Show the <count> biggest files and directories anywhere in the lists.",
+                                     "count", "0");
+    QCommandLineOption noSnapshotOption("no-snapshot", "Neither read nor write cached snapshots, always parse.");
+    parser.addOption(topOption);
+    parser.addOption(largestOption);
+    parser.addOption(noSnapshotOption);
+    parser.addPositionalArgument("lists", "FileListings to read, .xml or .xmlz4.", "lists...");
+    parser.process(app);
+
+    bool ok;
+    Options options;
+    options.top = parser.value(topOption).toInt(&ok);
+    bool largestOk;
+    options.largest = parser.value(largestOption).toInt(&largestOk);
+    options.snapshots = !parser.isSet(noSnapshotOption);
+    if (!ok || !largestOk || options.largest < 0 || options.top < 0 || parser.positionalArguments().isEmpty()) {
+        parser.showHelp(2);
+    }
+
+    ListStats total = { 0, 0, 0 };
+    int failed = 0;
+    QStringList lists = parser.positionalArguments();
+    for (int i = 0; i < lists.size(); ++i) {
+        if (!processList(QDir::fromNativeSeparators(lists.at(i)), options, &total)) {
+            ++failed;
+        }
+    }
+
+    out << "total: " << lists.size() - failed << " lists read, " << failed << " failed, "
+        << total.files << " files, " << total.directories << " directories, " << total.size << " bytes\n";
+    return failed > 0 ? 1 : 0;
+}
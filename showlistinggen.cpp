@@ -0,0 +1,334 @@
+#include <QByteArray>
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QFile>
+#include <QFileInfo>
+#include <QTextStream>
+
+#include <math.h>
+#include <string.h>
+
+#include "lz4framewriter.h"
+
+namespace {
+
+/// Parameters of the generated listing, see the command line help.
+struct Shape
+{
+    quint64 entries;
+    int depth;
+    int fanout;
+    double directoryShare;
+    double nameLength;
+    int nameMax;
+    double unicodeShare;
+    double entityShare;
+    double tthShare;
+    quint64 seed;
+};
+
+/// SplitMix64, so that a seed gives the same listing on every platform.
+class Random
+{
+public:
+    explicit Random(quint64 seed) : _state(seed) {}
+
+    quint64 next()
+    {
+        quint64 z = (_state += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+    /// Uniform in [0, n).
+    quint64 below(quint64 n) { return next() % n; }
+    /// Uniform in [0, 1).
+    double real() { return (next() >> 11) * (1.0 / 9007199254740992.0); }
+    bool chance(double p) { return real() < p; }
+    /// Roughly normal, from the sum of four uniforms.
+    double normal(double mean, double deviation)
+    {
+        return mean + deviation * (real() + real() + real() + real() - 2.0) * 1.7320508;
+    }
+
+private:
+    quint64 _state;
+};
+
+const char *const SYLLABLES[] = {
+    "ka", "ro", "mi", "sun", "tel", "va", "lo", "den", "ar", "is", "qu", "ent", "or", "pa", "zi", "mo",
+    "rec", "ord", "in", "gs", "the", "live", "mix", "cd", "set", "vol", "part", "best", "of", "new"
+};
+const int SYLLABLE_COUNT = sizeof(SYLLABLES) / sizeof(SYLLABLES[0]);
+
+const char *const EXTENSIONS[] = {
+    ".mp3", ".flac", ".mkv", ".avi", ".mp4", ".jpg", ".png", ".nfo", ".txt", ".pdf", ".epub",
+    ".iso", ".zip", ".rar", ".7z", ".exe", ".sfv", ".srt", ".ogg", ".cue"
+};
+const int EXTENSION_COUNT = sizeof(EXTENSIONS) / sizeof(EXTENSIONS[0]);
+
+// what escaping turns into entities or character references
+const char ENTITY_CHARS[] = "&<>\"'";
+
+// Latin-1 letters, Greek, Cyrillic, CJK ideographs and a few emoji
+const uint UNICODE_RANGES[][2] = {
+    { 0x00C0, 0x00FF }, { 0x0391, 0x03C9 }, { 0x0410, 0x044F }, { 0x4E00, 0x9FA5 }, { 0x1F600, 0x1F64F }
+};
+const int UNICODE_RANGE_COUNT = sizeof(UNICODE_RANGES) / sizeof(UNICODE_RANGES[0]);
+
+const char BASE32[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ234567";
+
+void appendUtf8(QByteArray *out, uint cp)
+{
+    if (cp < 0x80) {
+        out->append(char(cp));
+    } else if (cp < 0x800) {
+        out->append(char(0xC0 | (cp >> 6)));
+        out->append(char(0x80 | (cp & 0x3F)));
+    } else if (cp < 0x10000) {
+        out->append(char(0xE0 | (cp >> 12)));
+        out->append(char(0x80 | ((cp >> 6) & 0x3F)));
+        out->append(char(0x80 | (cp & 0x3F)));
+    } else {
+        out->append(char(0xF0 | (cp >> 18)));
+        out->append(char(0x80 | ((cp >> 12) & 0x3F)));
+        out->append(char(0x80 | ((cp >> 6) & 0x3F)));
+        out->append(char(0x80 | (cp & 0x3F)));
+    }
+}
+
+void appendEscaped(QByteArray *out, char c)
+{
+    switch (c) {
+    case '&': out->append("&amp;"); break;
+    case '<': out->append("&lt;"); break;
+    case '>': out->append("&gt;"); break;
+    case '"': out->append("&quot;"); break;
+    case '\'': out->append("&#39;"); break;
+    default: out->append(c); break;
+    }
+}
+
+/// Writes a FileListing of the requested shape, depth first.
+/** The root keeps getting top-level directories until the entry count is
+ * reached, every other directory gets a random number of children around
+ * the fan-out.
+ **/
+class ListingGenerator
+{
+public:
+    ListingGenerator(const Shape &shape, QIODevice *out)
+        : _shape(shape), _random(shape.seed), _out(out), _written(0), _failed(false)
+    {
+        _buffer.reserve(FlushSize + 4096);
+    }
+
+    bool run()
+    {
+        _buffer.append("<?xml version=\"1.0\" encoding=\"utf-8\" standalone=\"yes\"?>\r\n"
+                       "<FileListing Version=\"1\" CID=\"SHOWLISTINGGENERATEDLISTING0000000000000\" "
+                       "Base=\"/\" Generator=\"showlisting-gen\">\r\n");
+        while (_written < _shape.entries && !_failed) {
+            directory(1);
+        }
+        _buffer.append("</FileListing>\r\n");
+        flush();
+        return !_failed;
+    }
+
+    quint64 written() const { return _written; }
+
+private:
+    enum { FlushSize = 1 << 20 };
+
+    void directory(int level)
+    {
+        indent(level);
+        _buffer.append("<Directory Name=\"");
+        name(false);
+        _buffer.append("\" Date=\"");
+        _buffer.append(QByteArray::number(1262304000 + _random.below(400000000)));
+        _buffer.append("\">\r\n");
+        ++_written;
+
+        int children = 1 + int(_random.below(2 * _shape.fanout));
+        for (int i = 0; i < children && _written < _shape.entries && !_failed; ++i) {
+            if (level < _shape.depth && _random.chance(_shape.directoryShare)) {
+                directory(level + 1);
+            } else {
+                file(level + 1);
+            }
+        }
+
+        indent(level);
+        _buffer.append("</Directory>\r\n");
+        if (_buffer.size() >= FlushSize) {
+            flush();
+        }
+    }
+
+    void file(int level)
+    {
+        indent(level);
+        _buffer.append("<File Name=\"");
+        name(true);
+        // sizes spread evenly over magnitudes, 1 byte to 16 GiB
+        quint64 size = quint64(exp(_random.real() * 34 * 0.69314718));
+        _buffer.append("\" Size=\"");
+        _buffer.append(QByteArray::number(size));
+        if (_random.chance(_shape.tthShare)) {
+            _buffer.append("\" TTH=\"");
+            for (int i = 0; i < 39; ++i) {
+                _buffer.append(BASE32[_random.below(32)]);
+            }
+        }
+        _buffer.append("\"/>\r\n");
+        ++_written;
+    }
+
+    /// Appends an escaped name of random length made of syllables, with rare spaces.
+    void name(bool withExtension)
+    {
+        int length = qBound(1, int(_random.normal(_shape.nameLength, _shape.nameLength / 3) + 0.5), _shape.nameMax);
+        const char *extension = withExtension ? EXTENSIONS[_random.below(EXTENSION_COUNT)] : "";
+        int stem = qMax(1, length - int(strlen(extension)));
+
+        bool unicode = _random.chance(_shape.unicodeShare);
+        bool entity = _random.chance(_shape.entityShare);
+        int entityAt = entity ? int(_random.below(stem)) : -1;
+        int chars = 0;
+        while (chars < stem) {
+            if (chars == entityAt) {
+                appendEscaped(&_buffer, ENTITY_CHARS[_random.below(sizeof(ENTITY_CHARS) - 1)]);
+                ++chars;
+            } else if (unicode && _random.chance(0.3)) {
+                const uint *range = UNICODE_RANGES[_random.below(UNICODE_RANGE_COUNT)];
+                appendUtf8(&_buffer, range[0] + uint(_random.below(range[1] - range[0] + 1)));
+                ++chars;
+            } else if (chars > 0 && chars + 1 < stem && _random.chance(0.08)) {
+                _buffer.append(' ');
+                ++chars;
+            } else {
+                const char *syllable = SYLLABLES[_random.below(SYLLABLE_COUNT)];
+                for (; *syllable && chars < stem && chars != entityAt; ++syllable, ++chars) {
+                    _buffer.append(*syllable);
+                }
+            }
+        }
+        _buffer.append(extension);
+    }
+
+    void indent(int level)
+    {
+        _buffer.append(QByteArray(level, '\t'));
+    }
+
+    void flush()
+    {
+        if (!_failed && _out->write(_buffer) != _buffer.size()) {
+            _failed = true;
+        }
+        _buffer.resize(0);
+    }
+
+    Shape _shape;
+    Random _random;
+    QIODevice *_out;
+    QByteArray _buffer;
+    quint64 _written;
+    bool _failed;
+};
+
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QTextStream err(stderr);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Writes a synthetic ADC FileListing, as .xml or as LZ4 frame compressed .xmlz4.");
+    parser.addHelpOption();
+    QCommandLineOption entriesOption(QStringList() << "n" << "entries", "Total files and directories (default 1000000, at most 50000000).", "count", "1000000");
+    QCommandLineOption depthOption("depth", "Deepest directory level (default 6).", "levels", "6");
+    QCommandLineOption fanoutOption("fanout", "Average children per directory below the root (default 20).", "count", "20");
+    QCommandLineOption dirShareOption("dir-share", "Share of children that are directories, above the deepest level (default 0.1).", "ratio", "0.1");
+    QCommandLineOption nameLengthOption("name-length", "Average name length in characters (default 24).", "chars", "24");
+    QCommandLineOption nameMaxOption("name-max", "Longest name in characters (default 120).", "chars", "120");
+    QCommandLineOption unicodeOption("unicode", "Share of names with non-ASCII characters (default 0.05).", "ratio", "0.05");
+    QCommandLineOption entityOption("entities", "Share of names with a character written as an entity (default 0.02).", "ratio", "0.02");
+    QCommandLineOption tthOption("tth", "Share of files with a TTH attribute (default 1).", "ratio", "1");
+    QCommandLineOption seedOption("seed", "Random seed, the same seed gives the same listing (default 1).", "number", "1");
+    QCommandLineOption blockChecksumOption("block-checksums", "Add block checksums to .xmlz4 output.");
+    parser.addOption(entriesOption);
+    parser.addOption(depthOption);
+    parser.addOption(fanoutOption);
+    parser.addOption(dirShareOption);
+    parser.addOption(nameLengthOption);
+    parser.addOption(nameMaxOption);
+    parser.addOption(unicodeOption);
+    parser.addOption(entityOption);
+    parser.addOption(tthOption);
+    parser.addOption(seedOption);
+    parser.addOption(blockChecksumOption);
+    parser.addPositionalArgument("output", "Listing to write, compressed if its suffix is .xmlz4.");
+    parser.process(app);
+
+    bool ok[10];
+    Shape shape;
+    shape.entries = parser.value(entriesOption).toULongLong(&ok[0]);
+    shape.depth = parser.value(depthOption).toInt(&ok[1]);
+    shape.fanout = parser.value(fanoutOption).toInt(&ok[2]);
+    shape.directoryShare = parser.value(dirShareOption).toDouble(&ok[3]);
+    shape.nameLength = parser.value(nameLengthOption).toDouble(&ok[4]);
+    shape.nameMax = parser.value(nameMaxOption).toInt(&ok[5]);
+    shape.unicodeShare = parser.value(unicodeOption).toDouble(&ok[6]);
+    shape.entityShare = parser.value(entityOption).toDouble(&ok[7]);
+    shape.tthShare = parser.value(tthOption).toDouble(&ok[8]);
+    shape.seed = parser.value(seedOption).toULongLong(&ok[9]);
+    bool valid = parser.positionalArguments().size() == 1
+            && shape.entries > 0 && shape.entries <= 50000000 && shape.depth >= 1 && shape.fanout >= 1
+            && shape.nameLength >= 1 && shape.nameMax >= 1
+            && shape.directoryShare >= 0 && shape.directoryShare <= 1
+            && shape.unicodeShare >= 0 && shape.unicodeShare <= 1
+            && shape.entityShare >= 0 && shape.entityShare <= 1
+            && shape.tthShare >= 0 && shape.tthShare <= 1;
+    for (int i = 0; i < 10; ++i) {
+        valid = valid && ok[i];
+    }
+    if (!valid) {
+        parser.showHelp(2);
+    }
+
+    QString fileName = parser.positionalArguments().at(0);
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        err << fileName << ": " << file.errorString() << "\n";
+        return 1;
+    }
+    QIODevice *out = &file;
+    Lz4FrameWriter compressor(&file);
+    bool compressed = QFileInfo(fileName).suffix().toLower() == "xmlz4";
+    if (compressed) {
+        compressor.setBlockChecksums(parser.isSet(blockChecksumOption));
+        if (!compressor.open(QIODevice::WriteOnly)) {
+            err << fileName << ": " << file.errorString() << "\n";
+            return 1;
+        }
+        out = &compressor;
+    }
+
+    ListingGenerator generator(shape, out);
+    bool written = generator.run();
+    if (compressed) {
+        written = compressor.finish() && written;
+        compressor.close();
+    }
+    file.close();
+    if (!written || file.error() != QFile::NoError) {
+        err << fileName << ": " << (compressed ? compressor.errorString() : file.errorString()) << "\n";
+        return 1;
+    }
+    err << fileName << ": " << generator.written() << " entries, " << QFileInfo(fileName).size() << " bytes\n";
+    return 0;
+}
@@ -0,0 +1,25 @@
+#include <QElapsedTimer>
+
+#include "statisticsworker.h"
+
+#include "listingstatistics.h"
+
+StatisticsWorker::StatisticsWorker(const ShowListing::ListingStore *store, quint32 node)
+    : store(store), node(node), result(0), elapsed(0)
+{
+    setAutoDelete(false);
+}
+
+StatisticsWorker::~StatisticsWorker()
+{
+    delete result;
+}
+
+void StatisticsWorker::run()
+{
+    QElapsedTimer timer;
+    timer.start();
+    result = new ShowListing::ListingStatistics(*store, node);
+    elapsed = timer.nsecsElapsed();
+    emit signalStatisticsFinished();
+}
@@ -0,0 +1,39 @@
+#ifndef STATISTICSWORKER_H
+#define STATISTICSWORKER_H
+
+#include <QObject>
+#include <QRunnable>
+
+namespace ShowListing{class ListingStatistics; class ListingStore;}
+
+/// Computes the statistics of a subtree on a QThreadPool thread, see ListingStatistics.
+/** Like LoadPathWorker it lives in the GUI thread and is deleted by its
+ * owner once signalStatisticsFinished() has been received. The listing,
+ * and those it links to, must stay alive until then.
+ **/
+class StatisticsWorker : public QObject, public QRunnable
+{
+    Q_OBJECT
+
+public:
+    StatisticsWorker(const ShowListing::ListingStore *store, quint32 node);
+    ~StatisticsWorker();
+
+    void run();
+
+    /// Null until signalStatisticsFinished() was emitted.
+    const ShowListing::ListingStatistics *statistics() const { return result; }
+    /// Time the scan took.
+    qint64 nsecs() const { return elapsed; }
+
+private:
+    const ShowListing::ListingStore *store;
+    quint32 node;
+    ShowListing::ListingStatistics *result;
+    qint64 elapsed;
+
+signals:
+    void signalStatisticsFinished();
+};
+
+#endif // STATISTICSWORKER_H
@@ -0,0 +1,44 @@
+#include "stringarena.h"
+
+#include <string.h>
+
+using ShowListing::StringArena;
+
+StringArena::StringArena()
+    : _used(BlockSize)
+{
+}
+
+StringArena::~StringArena()
+{
+    clear();
+}
+
+quint32 StringArena::add(const char *utf8, int len)
+{
+    if (len > MaxLength) {
+        len = MaxLength;
+        // do not leave half of a multi-byte sequence behind
+        while (len > 0 && (uchar(utf8[len]) & 0xC0) == 0x80) {
+            --len;
+        }
+    }
+    if (_used + 2 + len > BlockSize) {
+        _blocks.append(new char[BlockSize]);
+        _used = 0;
+    }
+    char *p = _blocks.block(_blocks.count() - 1) + _used;
+    p[0] = char(len & 0xFF);
+    p[1] = char(len >> 8);
+    memcpy(p + 2, utf8, len);
+
+    quint32 offset = (quint32(_blocks.count() - 1) << BlockShift) | quint32(_used);
+    _used += 2 + len;
+    return offset;
+}
+
+void StringArena::clear()
+{
+    _blocks.clear();
+    _used = BlockSize;
+}
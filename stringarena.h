@@ -0,0 +1,50 @@
+#ifndef STRINGARENA_H
+#define STRINGARENA_H
+
+#include <QtGlobal>
+#include <QString>
+
+#include "chunkedarray.h"
+
+namespace ShowListing{
+
+/// Bump allocator for short UTF-8 strings.
+/** Strings are stored back to back in 64 KiB blocks, each prefixed with its
+ * 16-bit byte length, and are addressed by a 32-bit offset. A string never
+ * straddles two blocks. Nothing is freed before the arena itself.
+ **/
+class StringArena
+{
+public:
+    enum { BlockShift = 16, BlockSize = 1 << BlockShift, MaxLength = BlockSize - 2 };
+
+    StringArena();
+    ~StringArena();
+
+    /// Copies \a len bytes of UTF-8 and returns the offset of the copy.
+    /** Strings longer than MaxLength are cut on a character boundary.
+     **/
+    quint32 add(const char *utf8, int len);
+
+    const char *data(quint32 offset) const { return _blocks.block(offset >> BlockShift) + (offset & (BlockSize - 1)) + 2; }
+    int length(quint32 offset) const
+    {
+        const uchar *p = reinterpret_cast<const uchar *>(_blocks.block(offset >> BlockShift) + (offset & (BlockSize - 1)));
+        return p[0] | (p[1] << 8);
+    }
+    QString string(quint32 offset) const { return QString::fromUtf8(data(offset), length(offset)); }
+
+    void clear();
+    qint64 capacityBytes() const { return qint64(_blocks.count()) * BlockSize; }
+
+private:
+    StringArena(const StringArena &);
+    StringArena &operator=(const StringArena &);
+
+    BlockTable<char> _blocks;
+    int _used;      // bytes used in the last block
+};
+
+}
+
+#endif // STRINGARENA_H
@@ -0,0 +1,74 @@
+#include <QReadLocker>
+#include <QWriteLocker>
+
+#include "subtreeindex.h"
+#include "listingstore.h"
+
+using ShowListing::ListingNode;
+using ShowListing::ListingStore;
+using ShowListing::SubtreeIndex;
+
+void SubtreeIndex::addListing(const ListingStore *store)
+{
+    // collected without the lock, loads going on elsewhere keep looking up
+    QHash<quint64, Entry> fresh;
+    const ListingNode &root = store->node(0);
+    for (quint32 row = 0; row < root.childCount; ++row) {
+        quint32 top = store->child(0, row);
+        quint32 end = store->node(top).subtreeEnd;
+        for (quint32 id = top; id < end; ++id) {
+            const ListingNode &n = store->node(id);
+            if (n.type != ListingNode::Directory || (n.flags & ListingNode::Linked)
+                    || n.subtreeEnd - id < quint32(MinNodes)) {
+                continue;
+            }
+            quint64 hash = store->contentHash(id);
+            if (!fresh.contains(hash)) {
+                Entry entry = { store, id };
+                fresh.insert(hash, entry);
+            }
+        }
+    }
+
+    QWriteLocker locker(&_lock);
+    QHash<quint64, Entry>::const_iterator it = fresh.constBegin();
+    for (; it != fresh.constEnd(); ++it) {
+        if (!_entries.contains(it.key())) {
+            _entries.insert(it.key(), it.value());
+        }
+    }
+}
+
+void SubtreeIndex::removeListing(const ListingStore *store)
+{
+    QWriteLocker locker(&_lock);
+    QHash<quint64, Entry>::iterator it = _entries.begin();
+    while (it != _entries.end()) {
+        if (it.value().store == store) {
+            it = _entries.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+const ListingStore *SubtreeIndex::find(quint64 contentHash, quint64 size, quint32 childCount, quint32 *node) const
+{
+    QReadLocker locker(&_lock);
+    QHash<quint64, Entry>::const_iterator it = _entries.constFind(contentHash);
+    if (it == _entries.constEnd()) {
+        return 0;
+    }
+    const ListingNode &n = it.value().store->node(it.value().node);
+    if (n.size != size || n.childCount != childCount) {
+        return 0;
+    }
+    *node = it.value().node;
+    return it.value().store;
+}
+
+bool SubtreeIndex::isEmpty() const
+{
+    QReadLocker locker(&_lock);
+    return _entries.isEmpty();
+}
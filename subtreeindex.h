@@ -0,0 +1,59 @@
+#ifndef SUBTREEINDEX_H
+#define SUBTREEINDEX_H
+
+#include <QHash>
+#include <QReadWriteLock>
+
+namespace ShowListing{
+
+class ListingStore;
+
+/// Directories of finished listings by content hash, for others to share.
+/** A listing read with the index set links each directory matching an
+ * indexed one to it rather than keeping the nodes below, see
+ * ListingStore::setSubtreeIndex(). Only directories of at least MinNodes
+ * entries are indexed: below that a link saves too little to be worth the
+ * lookup. The first listing holding some content keeps it.
+ *
+ * addListing() and find() may run on loading threads while removeListing()
+ * runs in the GUI.
+ **/
+class SubtreeIndex
+{
+public:
+    enum { MinNodes = 64 };
+
+    SubtreeIndex() {}
+
+    /// Indexes the big directories of \a store.
+    /** \a store must be finished and stay alive until removeListing(), as
+     * must every listing linking to it.
+     **/
+    void addListing(const ListingStore *store);
+    void removeListing(const ListingStore *store);
+
+    /// Listing holding a directory with the given content, null if none.
+    /** Size and child count are checked as well, so that a hash collision
+     * alone does not graft foreign entries into a listing.
+     **/
+    const ListingStore *find(quint64 contentHash, quint64 size, quint32 childCount, quint32 *node) const;
+    /// Whether no listing has a directory to share.
+    bool isEmpty() const;
+
+private:
+    SubtreeIndex(const SubtreeIndex &);
+    SubtreeIndex &operator=(const SubtreeIndex &);
+
+    struct Entry
+    {
+        const ListingStore *store;
+        quint32 node;
+    };
+
+    mutable QReadWriteLock _lock;
+    QHash<quint64, Entry> _entries;
+};
+
+}
+
+#endif // SUBTREEINDEX_H
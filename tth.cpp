@@ -0,0 +1,101 @@
+#include "tth.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  include <emmintrin.h>
+#  define SHOWLISTING_SSE2
+#endif
+
+using ShowListing::Tth;
+
+namespace {
+
+const char ALPHABET[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ234567";
+// the 39 characters rounded up to whole 16-byte vectors
+const int PADDED_LENGTH = 48;
+
+/// Maps the 39 characters of \a text to their 5-bit values, all of \a values is written.
+inline bool translate(const char *text, uchar *values)
+{
+    uchar padded[PADDED_LENGTH];
+    memcpy(padded, text, Tth::Base32Length);
+    memset(padded + Tth::Base32Length, 'A', PADDED_LENGTH - Tth::Base32Length);
+#if defined(SHOWLISTING_SSE2)
+    // bytes above 0x7f compare as negative and fall outside both ranges
+    const __m128i caseBit = _mm_set1_epi8(0x20);
+    const __m128i beforeA = _mm_set1_epi8('a' - 1);
+    const __m128i afterZ = _mm_set1_epi8('z' + 1);
+    const __m128i before2 = _mm_set1_epi8('2' - 1);
+    const __m128i after7 = _mm_set1_epi8('7' + 1);
+    const __m128i letterBase = _mm_set1_epi8('a');
+    const __m128i digitBase = _mm_set1_epi8('2' - 26);
+    for (int i = 0; i < PADDED_LENGTH; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(padded + i));
+        __m128i lower = _mm_or_si128(v, caseBit);
+        __m128i isLetter = _mm_and_si128(_mm_cmpgt_epi8(lower, beforeA), _mm_cmplt_epi8(lower, afterZ));
+        __m128i isDigit = _mm_and_si128(_mm_cmpgt_epi8(v, before2), _mm_cmplt_epi8(v, after7));
+        if (_mm_movemask_epi8(_mm_or_si128(isLetter, isDigit)) != 0xffff) {
+            return false;
+        }
+        __m128i value = _mm_or_si128(_mm_and_si128(isLetter, _mm_sub_epi8(lower, letterBase)),
+                                     _mm_and_si128(isDigit, _mm_sub_epi8(v, digitBase)));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(values + i), value);
+    }
+#else
+    for (int i = 0; i < PADDED_LENGTH; ++i) {
+        uchar lower = padded[i] | 0x20;
+        if (lower >= 'a' && lower <= 'z') {
+            values[i] = lower - 'a';
+        } else if (padded[i] >= '2' && padded[i] <= '7') {
+            values[i] = padded[i] - '2' + 26;
+        } else {
+            return false;
+        }
+    }
+#endif
+    return true;
+}
+
+}
+
+bool Tth::fromBase32(const char *text, int len, Tth *out)
+{
+    uchar values[PADDED_LENGTH];
+    if (len != Base32Length || !translate(text, values)) {
+        return false;
+    }
+    // every 8 characters make 5 bytes; the last group has one character
+    // of padding and its fifth byte only holds the 3 spare bits
+    for (int group = 0; group < 5; ++group) {
+        const uchar *v = values + 8 * group;
+        quint64 bits = 0;
+        for (int i = 0; i < 8; ++i) {
+            bits = (bits << 5) | v[i];
+        }
+        int count = group < 4 ? 5 : 4;
+        for (int i = 0; i < count; ++i) {
+            out->bytes[5 * group + i] = uchar(bits >> (32 - 8 * i));
+        }
+    }
+    return true;
+}
+
+QByteArray Tth::toBase32() const
+{
+    QByteArray text(Base32Length, Qt::Uninitialized);
+    toBase32(text.data());
+    return text;
+}
+
+void Tth::toBase32(char *text) const
+{
+    for (int group = 0; group < 5; ++group) {
+        quint64 bits = 0;
+        for (int i = 0; i < 5; ++i) {
+            int b = 5 * group + i;
+            bits = (bits << 8) | (b < Size ? bytes[b] : 0);
+        }
+        for (int i = 0; i < 8 && 8 * group + i < Base32Length; ++i) {
+            text[8 * group + i] = ALPHABET[(bits >> (35 - 5 * i)) & 0x1f];
+        }
+    }
+}
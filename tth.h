@@ -0,0 +1,44 @@
+#ifndef TTH_H
+#define TTH_H
+
+#include <QByteArray>
+#include <QtGlobal>
+
+#include <string.h>
+
+namespace ShowListing{
+
+/// Root of the Tiger tree hash of a file, the TTH= attribute of a listing.
+/** Kept as its 24 raw bytes rather than the 39 base32 characters it is
+ * written with.
+ **/
+struct Tth
+{
+    enum { Size = 24, Base32Length = 39 };
+
+    uchar bytes[Size];
+
+    /// Decodes the base32 text of a TTH attribute into \a out.
+    /** Both letter cases are accepted. Returns \c false, leaving \a out
+     * undefined, unless \a text is exactly 39 valid characters.
+     **/
+    static bool fromBase32(const char *text, int len, Tth *out);
+    QByteArray toBase32() const;
+    /// Writes the Base32Length uppercase characters to \a text, without a terminator.
+    void toBase32(char *text) const;
+
+    bool operator==(const Tth &other) const { return memcmp(bytes, other.bytes, Size) == 0; }
+    bool operator!=(const Tth &other) const { return !(*this == other); }
+};
+
+/// The hash is already uniformly distributed, any word of it will do.
+inline uint qHash(const Tth &tth, uint seed = 0)
+{
+    uint h;
+    memcpy(&h, tth.bytes, sizeof(h));
+    return h ^ seed;
+}
+
+}
+
+#endif // TTH_H
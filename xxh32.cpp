@@ -0,0 +1,114 @@
+#include "xxh32.h"
+
+#include <string.h>
+
+namespace {
+
+const quint32 PRIME1 = 2654435761U;
+const quint32 PRIME2 = 2246822519U;
+const quint32 PRIME3 = 3266489917U;
+const quint32 PRIME4 = 668265263U;
+const quint32 PRIME5 = 374761393U;
+
+inline quint32 rotl(quint32 x, int r)
+{
+    return (x << r) | (x >> (32 - r));
+}
+
+inline quint32 read32(const uchar *p)
+{
+    return quint32(p[0]) | (quint32(p[1]) << 8) | (quint32(p[2]) << 16) | (quint32(p[3]) << 24);
+}
+
+inline quint32 mixRound(quint32 acc, quint32 input)
+{
+    return rotl(acc + input * PRIME2, 13) * PRIME1;
+}
+
+}
+
+Xxh32::Xxh32(quint32 seed)
+{
+    reset(seed);
+}
+
+void Xxh32::reset(quint32 seed)
+{
+    _v[0] = seed + PRIME1 + PRIME2;
+    _v[1] = seed + PRIME2;
+    _v[2] = seed;
+    _v[3] = seed - PRIME1;
+    _total = 0;
+    _buffered = 0;
+}
+
+void Xxh32::update(const void *data, qint64 len)
+{
+    const uchar *p = static_cast<const uchar *>(data);
+    const uchar *end = p + len;
+    _total += len;
+
+    if (_buffered + len < 16) {
+        memcpy(_buffer + _buffered, p, size_t(len));
+        _buffered += int(len);
+        return;
+    }
+    if (_buffered) {
+        int n = 16 - _buffered;
+        memcpy(_buffer + _buffered, p, n);
+        p += n;
+        for (int i = 0; i < 4; ++i) {
+            _v[i] = mixRound(_v[i], read32(_buffer + 4 * i));
+        }
+        _buffered = 0;
+    }
+    quint32 v0 = _v[0], v1 = _v[1], v2 = _v[2], v3 = _v[3];
+    while (end - p >= 16) {
+        v0 = mixRound(v0, read32(p));
+        v1 = mixRound(v1, read32(p + 4));
+        v2 = mixRound(v2, read32(p + 8));
+        v3 = mixRound(v3, read32(p + 12));
+        p += 16;
+    }
+    _v[0] = v0;
+    _v[1] = v1;
+    _v[2] = v2;
+    _v[3] = v3;
+    _buffered = int(end - p);
+    memcpy(_buffer, p, _buffered);
+}
+
+quint32 Xxh32::digest() const
+{
+    quint32 h;
+    if (_total >= 16) {
+        h = rotl(_v[0], 1) + rotl(_v[1], 7) + rotl(_v[2], 12) + rotl(_v[3], 18);
+    } else {
+        h = _v[2] + PRIME5;     // the seed
+    }
+    h += quint32(_total);
+
+    const uchar *p = _buffer;
+    const uchar *end = _buffer + _buffered;
+    while (end - p >= 4) {
+        h = rotl(h + read32(p) * PRIME3, 17) * PRIME4;
+        p += 4;
+    }
+    while (p < end) {
+        h = rotl(h + *p * PRIME5, 11) * PRIME1;
+        ++p;
+    }
+    h ^= h >> 15;
+    h *= PRIME2;
+    h ^= h >> 13;
+    h *= PRIME3;
+    h ^= h >> 16;
+    return h;
+}
+
+quint32 Xxh32::hash(const void *data, qint64 len, quint32 seed)
+{
+    Xxh32 state(seed);
+    state.update(data, len);
+    return state.digest();
+}
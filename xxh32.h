@@ -0,0 +1,25 @@
+#ifndef XXH32_H
+#define XXH32_H
+
+#include <QtGlobal>
+
+/// Streaming xxHash32, the checksum used by the LZ4 frame format.
+class Xxh32
+{
+public:
+    explicit Xxh32(quint32 seed = 0);
+
+    void reset(quint32 seed = 0);
+    void update(const void *data, qint64 len);
+    quint32 digest() const;
+
+    static quint32 hash(const void *data, qint64 len, quint32 seed = 0);
+
+private:
+    quint32 _v[4];
+    quint64 _total;
+    uchar _buffer[16];
+    int _buffered;
+};
+
+#endif // XXH32_H